@@ -135,6 +135,7 @@ setup(
             [
                 'src/recordpaint/recordpaintdevice.cpp',
                 'src/recordpaint/recordpaintengine.cpp',
+                'src/recordpaint/recordstream.cpp',
                 'src/recordpaint/recordpaint.sip'
             ],
             language="c++",
@@ -158,6 +159,8 @@ setup(
                 'src/qtloops/qtloops_helpers.cpp',
                 'src/qtloops/polygonclip.cpp',
                 'src/qtloops/polylineclip.cpp',
+                'src/qtloops/polygonbool.cpp',
+                'src/qtloops/axistransform.cpp',
                 'src/qtloops/beziers.cpp',
                 'src/qtloops/beziers_qtwrap.cpp',
                 'src/qtloops/numpyfuncs.cpp',
@@ -68,6 +68,14 @@ Agreement.
 #include "structmember.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
 
 #define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
 
@@ -220,6 +228,12 @@ Agreement.
  * case or open contours for the single level case, and removes all but
  * the actual start markers.  A second tracing pass can perform the
  * actual final trace.
+ *
+ * For the single level case, the first pass can store the points as
+ * it goes, as its saddle decisions are kept in the triangle array and
+ * the only curves it does not trace completely are open curves, which
+ * it traces in pieces ending at OPEN_END marks.  Joining the pieces
+ * gives the same curves as the second pass, so it is skipped.
  */
 
 /* ------------------------------------------------------------------------ */
@@ -251,7 +265,13 @@ struct Csite
 
     /* making the actual marks requires a bunch of other stuff */
     const double *x, *y, *z;    /* mesh coordinates and function values */
-    double *xcp, *ycp;          /* output contour points */
+    double *xy;                 /* output contour points, x and y
+                                 * interleaved, or NULL if not storing */
+    long xycap;                 /* number of points xy can hold */
+    long xyoff;                 /* index of first point of this curve */
+    int xyfail;                 /* set if xy could not be enlarged */
+    long open_end;              /* OPEN_END edge this curve stopped at,
+                                 * or -1 */
 };
 
 #if 0
@@ -344,6 +364,28 @@ static long curve_tracer (Csite * site, int pass2);
 /* this initializes the data array for curve_tracer */
 static void data_init (Csite * site, int region, long nchunk);
 
+/* store point n of the current curve in site->xy, enlarging it if
+ * necessary */
+static void
+store_point (Csite * site, long n, double x, double y)
+{
+    long i = site->xyoff + n;
+    if (i >= site->xycap)
+    {
+        long cap = 2 * i + 1024;
+        double *xy = (double *) realloc(site->xy, 2 * cap * sizeof(double));
+        if (xy == NULL)
+        {
+            site->xyfail = 1;
+            return;
+        }
+        site->xy = xy;
+        site->xycap = cap;
+    }
+    site->xy[2*i] = x;
+    site->xy[2*i+1] = y;
+}
+
 /* ------------------------------------------------------------------------ */
 
 /* zone_crosser assumes you are sitting at a cut edge about to cross
@@ -366,12 +408,10 @@ zone_crosser (Csite * site, int level, int pass2)
     int two_levels = site->zlevel[1] > site->zlevel[0];
     short *triangle = site->triangle;
 
-    const double *x = pass2 ? site->x : 0;
-    const double *y = pass2 ? site->y : 0;
-    const double *z = pass2 ? site->z : 0;
-    double zlevel = pass2 ? site->zlevel[level] : 0.0;
-    double *xcp = pass2 ? site->xcp : 0;
-    double *ycp = pass2 ? site->ycp : 0;
+    const double *x = site->x;
+    const double *y = site->y;
+    const double *z = site->z;
+    double zlevel = site->zlevel[level];
 
     int z0, z1, z2, z3;
     int keep_left = 0;          /* flag to try to minimize curvature in saddles */
@@ -387,12 +427,12 @@ zone_crosser (Csite * site, int level, int pass2)
         p1 = POINT1 (edge, fwd);
 
         /* always mark cut on current edge */
-        if (pass2)
+        if (site->xy)
         {
-            /* second pass actually computes and stores the point */
+            /* compute and store the point if wanted */
             double zcp = (zlevel - z[p0]) / (z[p1] - z[p0]);
-            xcp[n] = zcp * (x[p1] - x[p0]) + x[p0];
-            ycp[n] = zcp * (y[p1] - y[p0]) + y[p0];
+            store_point (site, n, zcp * (x[p1] - x[p0]) + x[p0],
+                         zcp * (y[p1] - y[p0]) + y[p0]);
         }
         if (!done && !jedge)
         {
@@ -403,6 +443,7 @@ zone_crosser (Csite * site, int level, int pass2)
                 if (!two_levels && !pass2 && (data[edge] & OPEN_END))
                 {
                     /* reached an OPEN_END mark, skip the n++ */
+                    site->open_end = edge;
                     done = 4;   /* same return value 4 used below */
                     break;
                 }
@@ -569,10 +610,8 @@ edge_walker (Csite * site,  int pass2)
     int level0 = site->level0 == 2;
     int marked;
 
-    const double *x = pass2 ? site->x : 0;
-    const double *y = pass2 ? site->y : 0;
-    double *xcp = pass2 ? site->xcp : 0;
-    double *ycp = pass2 ? site->ycp : 0;
+    const double *x = site->x;
+    const double *y = site->y;
 
     int z0, z1, heads_up = 0;
 
@@ -586,11 +625,8 @@ edge_walker (Csite * site,  int pass2)
         if (z0 == 1)
         {
             /* mark current boundary point */
-            if (pass2)
-            {
-                xcp[n] = x[p0];
-                ycp[n] = y[p0];
-            }
+            if (site->xy)
+                store_point (site, n, x[p0], y[p0]);
             marked = 1;
         }
         else if (!n)
@@ -598,12 +634,12 @@ edge_walker (Csite * site,  int pass2)
             /* if this is the first point is not between the levels
              * must do the job of the zone_crosser and mark the first cut here,
              * so that it will be marked again by zone_crosser as it closes */
-            if (pass2)
+            if (site->xy)
             {
                 double zcp = site->zlevel[(z0 != 0)];
                 zcp = (zcp - site->z[p0]) / (site->z[p1] - site->z[p0]);
-                xcp[n] = zcp * (x[p1] - x[p0]) + x[p0];
-                ycp[n] = zcp * (y[p1] - y[p0]) + y[p0];
+                store_point (site, n, zcp * (x[p1] - x[p0]) + x[p0],
+                             zcp * (y[p1] - y[p0]) + y[p0]);
             }
             marked = 1;
         }
@@ -700,10 +736,8 @@ slit_cutter (Csite * site, int up, int pass2)
     long imax = site->imax;
     long n = site->n;
 
-    const double *x = pass2 ? site->x : 0;
-    const double *y = pass2 ? site->y : 0;
-    double *xcp = pass2 ? site->xcp : 0;
-    double *ycp = pass2 ? site->ycp : 0;
+    const double *x = site->x;
+    const double *y = site->y;
 
     if (up)
     {
@@ -730,8 +764,7 @@ slit_cutter (Csite * site, int up, int pass2)
                 site->n = n;
                 return 2;
             }
-            xcp[n] = x[p1];
-            ycp[n] = y[p1];
+            store_point (site, n, x[p1], y[p1]);
             n++;
             p1 += imax;
         }
@@ -786,8 +819,7 @@ slit_cutter (Csite * site, int up, int pass2)
             }
             if (pass2)
             {
-                xcp[n] = x[p0];
-                ycp[n] = y[p0];
+                store_point (site, n, x[p0], y[p0]);
                 n++;
             }
             else
@@ -938,6 +970,7 @@ curve_tracer (Csite * site, int pass2)
              0) : ((data[edge0] & Z_VALUE) != 0);
 
     /* initialize site for this curve */
+    site->open_end = -1;
     site->edge = site->edge0 = edge0;
     site->left = site->left0 = left0;
     site->level0 = level0 = level;      /* for open curve detection only */
@@ -1283,8 +1316,7 @@ cntr_new(void)
     site->data = NULL;
     site->reg = NULL;
     site->triangle = NULL;
-    site->xcp = NULL;
-    site->ycp = NULL;
+    site->xy = NULL;
     site->x = NULL;
     site->y = NULL;
     site->z = NULL;
@@ -1332,8 +1364,7 @@ cntr_init(Csite *site, long iMax, long jMax, double *x, double *y,
     site->x = x;
     site->y = y;
     site->z = z;
-    site->xcp = NULL;
-    site->ycp = NULL;
+    site->xy = NULL;
     return 0;
 }
 
@@ -1350,24 +1381,22 @@ static void cntr_del(Csite *site)
    tuple.
 */
 static PyObject *
-build_cntr_list_p(long *np, double *xp, double *yp, int nparts, long ntotal)
+build_cntr_list_p(const double *xy, const npy_intp *offsets, long nparts)
 {
     PyObject *point, *contourList, *all_contours;
-    int start = 0, end = 0;
-    int i, j, k;
+    long i;
+    npy_intp j, k;
 
     all_contours = PyList_New(nparts);
     if (all_contours == NULL) return NULL;
 
     for (i = 0; i < nparts; i++)
     {
-        start = end;
-        end += np[i];
-        contourList = PyList_New(np[i]);
+        contourList = PyList_New(offsets[i+1] - offsets[i]);
 	if (contourList == NULL) goto error;
-        for (k = 0, j = start; j < end; j++, k++)
+        for (k = 0, j = offsets[i]; j < offsets[i+1]; j++, k++)
         {
-            point = Py_BuildValue("(dd)", xp[j], yp[j]);
+            point = Py_BuildValue("(dd)", xy[2*j], xy[2*j+1]);
             if (PyList_SetItem(contourList, k, point)) goto error;
         }
         if (PyList_SetItem(all_contours, i, contourList)) goto error;
@@ -1419,32 +1448,24 @@ build_cntr_list_v(long *np, double *xp, double *yp, int nparts, long ntotal)
 
 /* Build a list of XY 2-D arrays, shape (N,2) */
 static PyObject *
-build_cntr_list_v2(long *np, double *xp, double *yp, int nparts, long ntotal)
+build_cntr_list_v2(const double *xy, const npy_intp *offsets, long nparts)
 {
     PyObject *all_contours;
     PyArrayObject *xyv;
     npy_intp dims[2];
-    int i;
-    long j, k;
+    long i;
 
     all_contours = PyList_New(nparts);
     if (all_contours == NULL) return NULL;
 
-    k = 0;
     for (i = 0; i < nparts; i++)
     {
-        double *data;
-        dims[0] = np[i];
+        dims[0] = offsets[i+1] - offsets[i];
         dims[1] = 2;
         xyv = (PyArrayObject *) PyArray_SimpleNew(2, dims, NPY_DOUBLE);
         if (xyv == NULL)  goto error;
-	data = (double*)PyArray_DATA(xyv);
-        for (j = 0; j < dims[0]; j++)
-        {
-            data[2*j] = xp[k];
-            data[2*j+1] = yp[k];
-            k++;
-        }
+        memcpy(PyArray_DATA(xyv), xy + 2*offsets[i],
+               sizeof(double) * 2 * dims[0]);
         if (PyList_SetItem(all_contours, i, (PyObject *)xyv)) goto error;
     }
     return all_contours;
@@ -1454,41 +1475,225 @@ build_cntr_list_v2(long *np, double *xp, double *yp, int nparts, long ntotal)
     return NULL;
 }
 
+/* The points traced for a contour level or level pair.  xy holds
+   the x and y coordinates of the ntotal points interleaved, and part
+   i is made of the points offsets[i] to offsets[i+1]-1. */
+typedef struct
+{
+    double *xy;
+    npy_intp *offsets;
+    long nparts;
+    long ntotal;
+} Ctrace;
+
+#define TRACE_OK 0
+#define TRACE_NOMEM -1
+#define TRACE_EXCEEDED -2
+#define TRACE_NEGATIVE -3
+#define TRACE_NPARTS -4
+#define TRACE_UNJOINED -5
 
+static void
+ctrace_free(Ctrace *tr)
+{
+    free(tr->xy); free(tr->offsets);
+    tr->xy = NULL;
+    tr->offsets = NULL;
+    tr->nparts = tr->ntotal = 0;
+}
 
-/* cntr_trace is called once per contour level or level pair.
-   If nlevels is 1, a set of contour lines will be returned; if nlevels
-   is 2, the set of polygons bounded by the levels will be returned.
-   If points is True, the lines will be returned as a list of list
-   of points; otherwise, as a list of tuples of vectors.
-*/
+/* A curve traced by the first pass for the single level case.  Its
+   n points start at point start of the site output.  Pieces of open
+   curves have negative n, and begin at edge0.  If the curve stopped
+   at the start of such a piece, open_end is its edge0, else -1. */
+typedef struct
+{
+    long start;
+    long n;
+    long edge0;
+    long open_end;
+} Cpiece;
+
+/* find the piece of an open curve starting at edge among the npieces
+   in pieces, which are in order of edge0 */
+static const Cpiece *
+find_open_piece(const Cpiece *pieces, long npieces, long edge)
+{
+    long lo = 0, hi = npieces;
+    while (lo < hi)
+    {
+        long mid = (lo + hi) / 2;
+        if (pieces[mid].edge0 < edge)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return (lo < npieces && pieces[lo].edge0 == edge) ? &pieces[lo] : NULL;
+}
 
-static PyObject *
-cntr_trace(Csite *site, double levels[], int nlevels, int points, long nchunk)
+/* append the curve just traced by site to pieces, returning 0 if
+   there is no memory */
+static int
+add_piece(Cpiece **pieces, long *npieces, long *maxpieces,
+          const Csite *site, long n)
 {
-    PyObject *c_list;
-    double *xp0;
-    double *yp0;
-    long *nseg0;
-    int iseg;
+    Cpiece *piece;
+    if (*npieces == *maxpieces)
+    {
+        long max = 2 * *maxpieces + 64;
+        Cpiece *p = (Cpiece *) realloc(*pieces, max * sizeof(Cpiece));
+        if (p == NULL)
+            return 0;
+        *pieces = p;
+        *maxpieces = max;
+    }
+    piece = &(*pieces)[(*npieces)++];
+    piece->start = site->xyoff;
+    piece->n = n;
+    piece->edge0 = site->edge0;
+    piece->open_end = site->open_end;
+    return 1;
+}
 
-    /* long nchunk = 30; was hardwired */
+/* Trace the contour at level z0 in a single pass, storing the points
+   as they are found.  The pieces of open curves traced from inside
+   the mesh are appended to the curves which stop where they start,
+   which gives the curves the second pass would trace. */
+static int
+trace_site_single(Csite *site, Ctrace *tr)
+{
+    Cpiece *curves = NULL, *opens = NULL;
+    long ncurves = 0, nopens = 0, maxcurves = 0, maxopens = 0;
+    long n, i, ntotal;
+    int ok;
+    int retn = TRACE_OK;
+
+    site->xycap = 1024;
+    site->xy = (double *) malloc(2 * site->xycap * sizeof(double));
+    site->xyoff = 0;
+    site->xyfail = 0;
+    if (site->xy == NULL)
+    {
+        retn = TRACE_NOMEM;
+        goto error;
+    }
+
+    for (;;)
+    {
+        n = curve_tracer (site, 0);
+        if (!n)
+            break;
+        if (site->xyfail)
+        {
+            retn = TRACE_NOMEM;
+            goto error;
+        }
+
+        /* complete curves and pieces of open curves are kept apart */
+        if (n > 0)
+            ok = add_piece(&curves, &ncurves, &maxcurves, site, n);
+        else
+            ok = add_piece(&opens, &nopens, &maxopens, site, -n);
+        if (!ok)
+        {
+            retn = TRACE_NOMEM;
+            goto error;
+        }
+        site->xyoff += n > 0 ? n : -n;
+    }
+    ntotal = site->xyoff;
+
+    tr->offsets = (npy_intp *) malloc((ncurves+1) * sizeof(npy_intp));
+    if (tr->offsets == NULL)
+    {
+        retn = TRACE_NOMEM;
+        goto error;
+    }
+    tr->offsets[0] = 0;
+
+    if (nopens == 0)
+    {
+        /* the points are already in order */
+        for (i = 0; i < ncurves; i++)
+            tr->offsets[i+1] = tr->offsets[i] + curves[i].n;
+        tr->xy = (double *) realloc(site->xy, (2*ntotal+1) * sizeof(double));
+        if (tr->xy == NULL)
+            tr->xy = site->xy;
+        site->xy = NULL;
+    }
+    else
+    {
+        /* copy each curve followed by the pieces it continues into */
+        long nout = 0;
+        tr->xy = (double *) malloc((2*ntotal+1) * sizeof(double));
+        if (tr->xy == NULL)
+        {
+            retn = TRACE_NOMEM;
+            goto error;
+        }
+        for (i = 0; i < ncurves; i++)
+        {
+            const Cpiece *piece = &curves[i];
+            for (;;)
+            {
+                memcpy(tr->xy + 2*nout, site->xy + 2*piece->start,
+                       2 * piece->n * sizeof(double));
+                nout += piece->n;
+                if (piece->open_end < 0)
+                    break;
+                piece = find_open_piece(opens, nopens, piece->open_end);
+                if (piece == NULL || nout + piece->n > ntotal)
+                {
+                    retn = TRACE_UNJOINED;
+                    goto error;
+                }
+            }
+            tr->offsets[i+1] = nout;
+        }
+        /* every piece belongs to a curve */
+        if (nout != ntotal)
+        {
+            retn = TRACE_UNJOINED;
+            goto error;
+        }
+        free(site->xy);
+        site->xy = NULL;
+    }
+
+    tr->nparts = ncurves;
+    tr->ntotal = ntotal;
+    free(curves);
+    free(opens);
+    return TRACE_OK;
+
+    error:
+    ctrace_free(tr);
+    free(site->xy);
+    site->xy = NULL;
+    free(curves);
+    free(opens);
+    return retn;
+}
+
+/* Trace the polygons between z0 and z1.  The first pass finds the
+   start points and cuts the slits which join holes to the curves
+   around them, so the second pass, which stores the points, can trace
+   each polygon in one piece. */
+static int
+trace_site_double(Csite *site, Ctrace *tr)
+{
     long n;
+    long iseg;
     long nparts = 0;
     long ntotal = 0;
-    long nparts2 = 0;
     long ntotal2 = 0;
+    int retn = TRACE_OK;
 
-    site->zlevel[0] = levels[0];
-    site->zlevel[1] = levels[0];
-    if (nlevels == 2)
-    {
-        site->zlevel[1] = levels[1];
-    }
-    site->n = site->count = 0;
-    data_init (site, 0, nchunk);
-
-    /* make first pass to compute required sizes for second pass */
+    /* make first pass to compute upper bounds on the sizes for the
+     * second pass
+     * -- curves removed by slit_cutter (negative n) are counted in
+     *    ntotal, but are merged into others in the second pass, so
+     *    fewer points may be written */
     for (;;)
     {
         n = curve_tracer (site, 0);
@@ -1505,66 +1710,536 @@ cntr_trace(Csite *site, double levels[], int nlevels, int points, long nchunk)
             ntotal -= n;
         }
     }
-    xp0 = (double *) PyMem_Malloc(ntotal * sizeof(double));
-    yp0 = (double *) PyMem_Malloc(ntotal * sizeof(double));
-    nseg0 = (long *) PyMem_Malloc(nparts * sizeof(long));
-    if (xp0 == NULL || yp0 == NULL || nseg0 == NULL)
+    /* allocate at least one item so that NULL means failure */
+    site->xy = (double *) malloc((2*ntotal+1) * sizeof(double));
+    site->xycap = ntotal;
+    site->xyoff = 0;
+    site->xyfail = 0;
+    tr->offsets = (npy_intp *) malloc((nparts+1) * sizeof(npy_intp));
+    if (site->xy == NULL || tr->offsets == NULL)
     {
-	PyErr_NoMemory();
-	goto error;
+        retn = TRACE_NOMEM;
+        goto error;
     }
 
-    /* second pass */
-    site->xcp = xp0;
-    site->ycp = yp0;
-    iseg = 0;
-    for (;;iseg++)
+    /* second pass writes directly into the output */
+    tr->offsets[0] = 0;
+    for (iseg = 0;; iseg++)
     {
         n = curve_tracer (site, 1);
         if (ntotal2 + n > ntotal)
         {
-            PyErr_SetString(PyExc_RuntimeError,
-                "curve_tracer: ntotal2, pass 2 exceeds ntotal, pass 1");
+            retn = TRACE_EXCEEDED;
             goto error;
         }
         if (n == 0)
             break;
         if (n > 0)
         {
-            /* could add array bounds checking */
-            nseg0[iseg] = n;
-            site->xcp += n;
-            site->ycp += n;
+            if (iseg >= nparts)
+            {
+                retn = TRACE_NPARTS;
+                goto error;
+            }
+            site->xyoff += n;
             ntotal2 += n;
-            nparts2++;
+            tr->offsets[iseg+1] = ntotal2;
         }
         else
         {
-            PyErr_SetString(PyExc_RuntimeError,
-                "Negative n from curve_tracer in pass 2");
+            retn = TRACE_NEGATIVE;
             goto error;
         }
     }
 
+    if (iseg != nparts)
+    {
+        retn = TRACE_NPARTS;
+        goto error;
+    }
+
+    /* the output holds only the points written by the second pass */
+    tr->xy = site->xy;
+    site->xy = NULL;
+    if (ntotal2 < ntotal)
+    {
+        double *xy = (double *) realloc(tr->xy,
+                                        (2*ntotal2+1) * sizeof(double));
+        if (xy != NULL)
+            tr->xy = xy;
+    }
+
+    tr->nparts = nparts;
+    tr->ntotal = ntotal2;
+    return TRACE_OK;
+
+    error:
+    ctrace_free(tr);
+    free(site->xy);
+    site->xy = NULL;
+    return retn;
+}
+
+/* Trace the contour at level z0, or the polygons between z0 and z1
+   if z1 > z0, into tr.  This uses malloc and does not touch any
+   Python objects, so it may be called without holding the GIL.
+   Returns TRACE_OK or one of the error values above.
+*/
+static int
+trace_site(Csite *site, double z0, double z1, long nchunk, Ctrace *tr)
+{
+    tr->xy = NULL;
+    tr->offsets = NULL;
+    tr->nparts = tr->ntotal = 0;
+
+    site->zlevel[0] = z0;
+    site->zlevel[1] = z1 > z0 ? z1 : z0;
+    site->n = site->count = 0;
+    data_init (site, 0, nchunk);
+
+    if (z1 > z0)
+        return trace_site_double(site, tr);
+    else
+        return trace_site_single(site, tr);
+}
+
+/* set the Python exception for an error from trace_site */
+static void
+trace_seterror(int retn)
+{
+    switch (retn)
+    {
+    case TRACE_NOMEM:
+        PyErr_NoMemory();
+        break;
+    case TRACE_EXCEEDED:
+        PyErr_SetString(PyExc_RuntimeError,
+            "curve_tracer: ntotal2, pass 2 exceeds ntotal, pass 1");
+        break;
+    case TRACE_NPARTS:
+        PyErr_SetString(PyExc_RuntimeError,
+            "curve_tracer: number of parts differs between passes");
+        break;
+    case TRACE_UNJOINED:
+        PyErr_SetString(PyExc_RuntimeError,
+            "curve_tracer: pieces of open curves could not be joined");
+        break;
+    default:
+        PyErr_SetString(PyExc_RuntimeError,
+            "Negative n from curve_tracer in pass 2");
+        break;
+    }
+}
+
+/* Free the malloced memory owned by a numpy array. */
+static void
+free_capsule(PyObject *capsule)
+{
+    free(PyCapsule_GetPointer(capsule, NULL));
+}
+
+/* Make an array using memory from malloc, which the array takes
+   ownership of.  *data is set to NULL if the memory has been taken,
+   even if there was an error. */
+static PyObject *
+array_from_malloc(int nd, npy_intp *dims, int type, void **data)
+{
+    PyObject *arr, *cap;
+
+    arr = PyArray_SimpleNewFromData(nd, dims, type, *data);
+    if (arr == NULL)
+        return NULL;
+    cap = PyCapsule_New(*data, NULL, free_capsule);
+    if (cap == NULL)
+    {
+        Py_DECREF(arr);
+        return NULL;
+    }
+    *data = NULL;
+    /* this steals the capsule, even on failure */
+    if (PyArray_SetBaseObject((PyArrayObject *)arr, cap))
+    {
+        Py_DECREF(arr);
+        return NULL;
+    }
+    return arr;
+}
+
+/* Build (xy, offsets) for traced output, where xy is a (N,2) array
+   of points and part i is xy[offsets[i]:offsets[i+1]].
+   xy has exactly offsets[nparts] rows, as trace_site sets ntotal from
+   the points it stored.
+   The arrays take ownership of the traced memory, avoiding a copy. */
+static PyObject *
+build_cntr_flat(Ctrace *tr)
+{
+    PyObject *xyv, *offv;
+    npy_intp dims[2];
+    void *data;
+
+    dims[0] = tr->ntotal;
+    dims[1] = 2;
+    data = tr->xy;
+    xyv = array_from_malloc(2, dims, NPY_DOUBLE, &data);
+    tr->xy = (double *)data;
+    if (xyv == NULL)
+        return NULL;
+
+    dims[0] = tr->nparts + 1;
+    data = tr->offsets;
+    offv = array_from_malloc(1, dims, NPY_INTP, &data);
+    tr->offsets = (npy_intp *)data;
+    if (offv == NULL)
+    {
+        Py_DECREF(xyv);
+        return NULL;
+    }
+
+    return Py_BuildValue("(NN)", xyv, offv);
+}
+
+/* cntr_trace is called once per contour level or level pair.
+   If nlevels is 1, a set of contour lines will be returned; if nlevels
+   is 2, the set of polygons bounded by the levels will be returned.
+   If points is True, the lines will be returned as a list of list
+   of points; if flat is True, as an (xy, offsets) tuple (see
+   build_cntr_flat); otherwise, as a list of (N,2) arrays.
+*/
+
+static PyObject *
+cntr_trace(Csite *site, double levels[], int nlevels, int points, int flat,
+           long nchunk)
+{
+    PyObject *c_list;
+    Ctrace tr;
+    int retn;
+
+    /* long nchunk = 30; was hardwired */
+    retn = trace_site(site, levels[0], nlevels == 2 ? levels[1] : levels[0],
+                      nchunk, &tr);
+    if (retn != TRACE_OK)
+    {
+        trace_seterror(retn);
+        return NULL;
+    }
 
-    if (points)
+    if (flat)
+    {
+        c_list = build_cntr_flat(&tr);
+    }
+    else if (points)
     {
-        c_list = build_cntr_list_p(nseg0, xp0, yp0, nparts, ntotal);
+        c_list = build_cntr_list_p(tr.xy, tr.offsets, tr.nparts);
     }
     else
     {
-        c_list = build_cntr_list_v2(nseg0, xp0, yp0, nparts, ntotal);
+        c_list = build_cntr_list_v2(tr.xy, tr.offsets, tr.nparts);
     }
-    PyMem_Free(xp0); PyMem_Free(yp0); PyMem_Free(nseg0);
-    site->xcp = NULL; site->ycp = NULL;
+    ctrace_free(&tr);
     return c_list;
+}
 
-    error:
-    PyMem_Free(xp0); PyMem_Free(yp0); PyMem_Free(nseg0);
-    site->xcp = NULL; site->ycp = NULL;
+/* ------------------------------------------------------------------------
+   Tracing many levels at once.
+
+   Each worker has its own copy of the site, with private data and
+   triangle arrays, and traces every nworkers'th level.  The triangle
+   array of each level starts as a copy of the one in the master site,
+   so the results do not depend on the number of workers or the order
+   in which they run.  The master triangle array is not updated.
+ ------------------------------------------------------------------------ */
+
+typedef struct
+{
+    Csite site;                 /* private copy of site */
+    const short *triangle0;     /* triangle array of master site */
+    const double *bounds;       /* z0, z1 of each job */
+    long nchunk;
+    long first, step, njobs;    /* jobs first, first+step, ... */
+    Ctrace *results;
+    int *status;
+} TraceWorker;
+
+static void
+run_trace_worker(TraceWorker *w)
+{
+    long ijmax = w->site.imax * w->site.jmax;
+    long job;
+
+    for (job = w->first; job < w->njobs; job += w->step)
+    {
+        double z0 = w->bounds[2*job];
+        double z1 = w->bounds[2*job+1];
+
+        memcpy(w->site.triangle, w->triangle0, sizeof(short) * ijmax);
+        w->status[job] = trace_site(&w->site, z0, z1, w->nchunk,
+                                    &w->results[job]);
+    }
+}
+
+#ifdef _WIN32
+typedef HANDLE cntr_thread;
+
+static DWORD WINAPI
+trace_thread_func(LPVOID arg)
+{
+    run_trace_worker((TraceWorker *)arg);
+    return 0;
+}
+
+static int
+trace_thread_start(cntr_thread *thread, TraceWorker *w)
+{
+    *thread = CreateThread(NULL, 0, trace_thread_func, w, 0, NULL);
+    return *thread != NULL ? 0 : -1;
+}
+
+static void
+trace_thread_join(cntr_thread thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+static int
+num_processors(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+}
+#else
+typedef pthread_t cntr_thread;
+
+static void *
+trace_thread_func(void *arg)
+{
+    run_trace_worker((TraceWorker *)arg);
     return NULL;
 }
 
+static int
+trace_thread_start(cntr_thread *thread, TraceWorker *w)
+{
+    return pthread_create(thread, NULL, trace_thread_func, w) == 0 ? 0 : -1;
+}
+
+static void
+trace_thread_join(cntr_thread thread)
+{
+    pthread_join(thread, NULL);
+}
+
+static int
+num_processors(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+#endif
+
+/* maximum number of workers if not given, limiting memory use */
+#define MAX_DEFAULT_WORKERS 8
+
+/* Trace njobs levels or level pairs, where job i is between
+   bounds[2*i] and bounds[2*i+1] (equal for lines).
+   Returns a list of (xy, offsets) tuples. */
+static PyObject *
+cntr_trace_levels(Csite *site, const double *bounds, long njobs,
+                  long nchunk, int nthreads)
+{
+    long nreg = site->imax * site->jmax + site->imax + 1;
+    long ijmax = site->imax * site->jmax;
+    TraceWorker *workers = NULL;
+    cntr_thread *threads = NULL;
+    char *started = NULL;
+    Ctrace *results = NULL;
+    int *status = NULL;
+    PyObject *out = NULL;
+    long i;
+    int nworkers = 0, w;
+
+    if (njobs <= 0)
+        return PyList_New(0);
+
+    if (nthreads <= 0)
+    {
+        nthreads = num_processors();
+        if (nthreads > MAX_DEFAULT_WORKERS)
+            nthreads = MAX_DEFAULT_WORKERS;
+    }
+    if (nthreads > njobs)
+        nthreads = (int)njobs;
+
+    results = (Ctrace *) calloc(njobs, sizeof(Ctrace));
+    status = (int *) calloc(njobs, sizeof(int));
+    workers = (TraceWorker *) calloc(nthreads, sizeof(TraceWorker));
+    threads = (cntr_thread *) calloc(nthreads, sizeof(cntr_thread));
+    started = (char *) calloc(nthreads, sizeof(char));
+    if (results == NULL || status == NULL || workers == NULL ||
+        threads == NULL || started == NULL)
+    {
+        PyErr_NoMemory();
+        goto cleanup;
+    }
+
+    /* workers share the read-only arrays of the master site */
+    for (nworkers = 0; nworkers < nthreads; nworkers++)
+    {
+        TraceWorker *wk = &workers[nworkers];
+        wk->site = *site;
+        wk->site.data = (Cdata *) malloc(sizeof(Cdata) * nreg);
+        wk->site.triangle = (short *) malloc(sizeof(short) * ijmax);
+        wk->site.xy = NULL;
+        if (wk->site.data == NULL || wk->site.triangle == NULL)
+        {
+            free(wk->site.data);
+            free(wk->site.triangle);
+            if (nworkers == 0)
+            {
+                PyErr_NoMemory();
+                goto cleanup;
+            }
+            /* use fewer workers */
+            break;
+        }
+        wk->triangle0 = site->triangle;
+        wk->bounds = bounds;
+        wk->nchunk = nchunk;
+        wk->first = nworkers;
+        wk->njobs = njobs;
+        wk->results = results;
+        wk->status = status;
+    }
+    for (w = 0; w < nworkers; w++)
+        workers[w].step = nworkers;
+
+    Py_BEGIN_ALLOW_THREADS
+
+    /* the first worker runs in this thread */
+    for (w = 1; w < nworkers; w++)
+        started[w] = trace_thread_start(&threads[w], &workers[w]) == 0;
+    run_trace_worker(&workers[0]);
+    for (w = 1; w < nworkers; w++)
+    {
+        if (started[w])
+            trace_thread_join(threads[w]);
+        else
+            run_trace_worker(&workers[w]);
+    }
+
+    Py_END_ALLOW_THREADS
+
+    for (i = 0; i < njobs; i++)
+    {
+        if (status[i] != TRACE_OK)
+        {
+            trace_seterror(status[i]);
+            goto cleanup;
+        }
+    }
+
+    out = PyList_New(njobs);
+    if (out == NULL)
+        goto cleanup;
+    for (i = 0; i < njobs; i++)
+    {
+        PyObject *item = build_cntr_flat(&results[i]);
+        if (item == NULL)
+        {
+            Py_CLEAR(out);
+            goto cleanup;
+        }
+        PyList_SET_ITEM(out, i, item);
+        ctrace_free(&results[i]);
+    }
+
+    cleanup:
+    for (w = 0; w < nworkers; w++)
+    {
+        free(workers[w].site.data);
+        free(workers[w].site.triangle);
+    }
+    if (results != NULL)
+    {
+        for (i = 0; i < njobs; i++)
+            ctrace_free(&results[i]);
+    }
+    free(results); free(status); free(workers); free(threads); free(started);
+    return out;
+}
+
+/* ------------------------------------------------------------------------
+   Cache of traced levels
+
+   The results of trace_levels are kept in a dict on the Cntr object,
+   keyed by (z0, z1, nchunk) for each level or level pair.  When a
+   single level is added, removed or moved, only that level (or the
+   bands either side of it) is traced again.  The dict is kept in order
+   of use, and the least recently used entries are dropped when it
+   grows past its maximum size.  Cached arrays are made read-only, as
+   they are returned to more than one caller.
+ ------------------------------------------------------------------------ */
+
+#define DEFAULT_CACHE_SIZE 64
+
+/* Look up key in cache, moving the entry to the end if found.
+   Returns a new reference, or NULL if missing or on error. */
+static PyObject *
+cache_get(PyObject *cache, PyObject *key)
+{
+    PyObject *val = PyDict_GetItemWithError(cache, key);
+
+    if (val == NULL)
+        return NULL;
+    Py_INCREF(val);
+    if (PyDict_DelItem(cache, key) < 0 ||
+        PyDict_SetItem(cache, key, val) < 0)
+    {
+        Py_DECREF(val);
+        return NULL;
+    }
+    return val;
+}
+
+/* Drop the oldest entries in cache to keep at most maxsize.
+   Returns 0 on success or -1 on error. */
+static int
+cache_trim(PyObject *cache, long maxsize)
+{
+    while (PyDict_Size(cache) > (maxsize > 0 ? maxsize : 0))
+    {
+        Py_ssize_t pos = 0;
+        PyObject *oldest, *oldval;
+        int retn;
+
+        PyDict_Next(cache, &pos, &oldest, &oldval);
+        Py_INCREF(oldest);
+        retn = PyDict_DelItem(cache, oldest);
+        Py_DECREF(oldest);
+        if (retn < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/* Add (xy, offsets) tuple val to cache, dropping old entries to keep
+   at most maxsize.  Returns 0 on success or -1 on error. */
+static int
+cache_put(PyObject *cache, PyObject *key, PyObject *val, long maxsize)
+{
+    Py_ssize_t i;
+
+    if (maxsize <= 0)
+        return 0;
+    for (i = 0; i < PyTuple_GET_SIZE(val); i++)
+        PyArray_CLEARFLAGS((PyArrayObject *)PyTuple_GET_ITEM(val, i),
+                           NPY_ARRAY_WRITEABLE);
+    if (PyDict_SetItem(cache, key, val) < 0)
+        return -1;
+    return cache_trim(cache, maxsize);
+}
+
 /******* Make an extension type.  Based on the tutorial.************/
 
 /* site points to the data arrays in the arrays pointed to
@@ -1576,6 +2251,8 @@ typedef struct {
     PyObject_HEAD
     PyArrayObject *xpa, *ypa, *zpa, *mpa;
     Csite *site;
+    PyObject *cache;            /* traced levels, see cache_get */
+    long cachesize;             /* maximum number of cached levels */
 } Cntr;
 
 
@@ -1601,6 +2278,8 @@ Cntr_clear(Cntr* self)
     tmp = self->mpa;
     self->mpa = NULL;
     Py_XDECREF(tmp);
+
+    Py_CLEAR(self->cache);
     return 0;
 }
 
@@ -1631,6 +2310,13 @@ Cntr_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
         self->ypa = NULL;
         self->zpa = NULL;
         self->mpa = NULL;
+        self->cachesize = DEFAULT_CACHE_SIZE;
+        self->cache = PyDict_New();
+        if (self->cache == NULL)
+        {
+            Py_DECREF(self);
+            return NULL;
+        }
     }
 
     return (PyObject *)self;
@@ -1639,16 +2325,18 @@ Cntr_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
 static int
 Cntr_init(Cntr *self, PyObject *args, PyObject *kwds)
 {
-    static char *kwlist[] = {"x", "y", "z", "mask", NULL};
+    static char *kwlist[] = {"x", "y", "z", "mask", "cachesize", NULL};
     PyObject *xarg, *yarg, *zarg, *marg;
     PyArrayObject *xpa, *ypa, *zpa, *mpa;
     long iMax, jMax;
+    long cachesize = DEFAULT_CACHE_SIZE;
     char *mask;
 
     marg = NULL;
 
-    if (! PyArg_ParseTupleAndKeywords(args, kwds, "OOO|O", kwlist,
-                                      &xarg, &yarg, &zarg, &marg))
+    if (! PyArg_ParseTupleAndKeywords(args, kwds, "OOO|Ol", kwlist,
+                                      &xarg, &yarg, &zarg, &marg,
+                                      &cachesize))
         return -1;
     if (marg == Py_None)
         marg = NULL;
@@ -1706,6 +2394,8 @@ Cntr_init(Cntr *self, PyObject *args, PyObject *kwds)
     self->ypa = ypa;
     self->zpa = zpa;
     self->mpa = mpa;
+    self->cachesize = cachesize;
+    PyDict_Clear(self->cache);
     return 0;
 
     error:
@@ -1723,16 +2413,145 @@ Cntr_trace(Cntr *self, PyObject *args, PyObject *kwds)
     int nlevels = 2;
     int points = 0;
     long nchunk = 0L;
-    static char *kwlist[] = {"level0", "level1", "points", "nchunk", NULL};
+    int flat = 0;
+    static char *kwlist[] = {"level0", "level1", "points", "nchunk", "flat",
+                             NULL};
 
-    if (! PyArg_ParseTupleAndKeywords(args, kwds, "d|dil", kwlist,
-                                      levels, levels+1, &points, &nchunk))
+    if (! PyArg_ParseTupleAndKeywords(args, kwds, "d|dili", kwlist,
+                                      levels, levels+1, &points, &nchunk,
+                                      &flat))
     {
         return NULL;
     }
     if (levels[1] == -1e100 || levels[1] <= levels[0])
         nlevels = 1;
-    return cntr_trace(self->site, levels, nlevels, points, nchunk);
+    return cntr_trace(self->site, levels, nlevels, points, flat, nchunk);
+}
+
+static PyObject *
+Cntr_trace_levels(Cntr *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *larg;
+    PyArrayObject *lpa;
+    PyObject *keys = NULL, *out = NULL, *traced = NULL;
+    const double *levels;
+    double *bounds = NULL;
+    long *missing = NULL;
+    long i, njobs, nmissing = 0;
+    int filled = 0;
+    long nchunk = 0L;
+    int threads = 0;
+    static char *kwlist[] = {"levels", "filled", "nchunk", "threads", NULL};
+
+    if (! PyArg_ParseTupleAndKeywords(args, kwds, "O|ili", kwlist,
+                                      &larg, &filled, &nchunk, &threads))
+    {
+        return NULL;
+    }
+
+    lpa = (PyArrayObject *) PyArray_ContiguousFromObject(larg, NPY_DOUBLE,
+                                                         1, 1);
+    if (lpa == NULL)
+        return NULL;
+    levels = (const double *)PyArray_DATA(lpa);
+    njobs = (long)PyArray_DIMS(lpa)[0];
+    if (filled)
+        njobs = njobs > 0 ? njobs - 1 : 0;
+
+    keys = PyList_New(njobs);
+    out = PyList_New(njobs);
+    bounds = (double *) malloc(sizeof(double) * 2 * (njobs + 1));
+    missing = (long *) malloc(sizeof(long) * (njobs + 1));
+    if (keys == NULL || out == NULL || bounds == NULL || missing == NULL)
+    {
+        if (bounds == NULL || missing == NULL)
+            PyErr_NoMemory();
+        goto error;
+    }
+
+    /* take what we can from the cache, and list the jobs to trace */
+    for (i = 0; i < njobs; i++)
+    {
+        double z0 = levels[i];
+        double z1 = filled ? levels[i+1] : z0;
+        PyObject *key, *val;
+
+        key = Py_BuildValue("(ddl)", z0, z1, nchunk);
+        if (key == NULL)
+            goto error;
+        PyList_SET_ITEM(keys, i, key);
+
+        val = cache_get(self->cache, key);
+        if (val != NULL)
+            PyList_SET_ITEM(out, i, val);
+        else if (PyErr_Occurred())
+            goto error;
+        else
+        {
+            bounds[2*nmissing] = z0;
+            bounds[2*nmissing+1] = z1;
+            missing[nmissing++] = i;
+        }
+    }
+
+    if (nmissing > 0)
+    {
+        traced = cntr_trace_levels(self->site, bounds, nmissing, nchunk,
+                                   threads);
+        if (traced == NULL)
+            goto error;
+        for (i = 0; i < nmissing; i++)
+        {
+            PyObject *item = PyList_GET_ITEM(traced, i);
+            Py_INCREF(item);
+            PyList_SET_ITEM(out, missing[i], item);
+            if (cache_put(self->cache, PyList_GET_ITEM(keys, missing[i]),
+                          item, self->cachesize) < 0)
+                goto error;
+        }
+        Py_DECREF(traced);
+    }
+
+    Py_DECREF(keys);
+    Py_DECREF(lpa);
+    free(bounds);
+    free(missing);
+    return out;
+
+    error:
+    Py_XDECREF(traced);
+    Py_XDECREF(keys);
+    Py_XDECREF(out);
+    Py_DECREF(lpa);
+    free(bounds);
+    free(missing);
+    return NULL;
+}
+
+static PyObject *
+Cntr_clear_cache(Cntr *self, PyObject *args)
+{
+    PyDict_Clear(self->cache);
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+Cntr_cached_levels(Cntr *self, PyObject *args)
+{
+    return PyLong_FromSsize_t(PyDict_Size(self->cache));
+}
+
+static PyObject *
+Cntr_set_cache_size(Cntr *self, PyObject *args)
+{
+    long cachesize;
+
+    if (!PyArg_ParseTuple(args, "l", &cachesize))
+        return NULL;
+    self->cachesize = cachesize;
+    if (cache_trim(self->cache, cachesize) < 0)
+        return NULL;
+    Py_RETURN_NONE;
 }
 
 static PyMethodDef Cntr_methods[] = {
@@ -1746,6 +2565,34 @@ static PyMethodDef Cntr_methods[] = {
      "        vector pairs; otherwise, return a list of lists of points.\n"
      "    Optional argument: nchunk; approximate number of grid points\n"
      "        per chunk. 0 (default) for no chunking.\n"
+     "    Optional argument: flat; if true, return an (xy, offsets) tuple\n"
+     "        as for trace_levels, instead of a list.\n"
+    },
+    {"trace_levels", (PyCFunction)Cntr_trace_levels,
+     METH_VARARGS | METH_KEYWORDS,
+     "Trace several contour levels at once, using multiple threads.\n\n"
+     "    Required argument: levels, a sequence of contour levels\n"
+     "    Optional argument: filled; if true, return the polygons\n"
+     "        between each pair of consecutive levels instead of lines.\n"
+     "    Optional argument: nchunk; as for trace.\n"
+     "    Optional argument: threads; number of threads to use, or 0\n"
+     "        (default) for the number of processors.\n"
+     "    Returns a list with an (xy, offsets) tuple for each level or\n"
+     "        level pair, where xy is a (N,2) array of points and part i\n"
+     "        is xy[offsets[i]:offsets[i+1]].\n"
+     "    Results are cached for each level or level pair, so only new\n"
+     "        levels are traced in later calls.  The cached arrays are\n"
+     "        read-only.\n"
+    },
+    {"clear_cache", (PyCFunction)Cntr_clear_cache, METH_NOARGS,
+     "Remove all traced levels from the cache.\n"
+    },
+    {"cached_levels", (PyCFunction)Cntr_cached_levels, METH_NOARGS,
+     "Return the number of levels or level pairs in the cache.\n"
+    },
+    {"set_cache_size", (PyCFunction)Cntr_set_cache_size, METH_VARARGS,
+     "Set the maximum number of levels or level pairs in the cache, dropping the\n"
+     "    least recently used if there are more.\n"
     },
     {NULL}  /* Sentinel */
 };
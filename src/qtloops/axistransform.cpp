@@ -0,0 +1,79 @@
+//    Copyright (C) 2026 Jeremy S. Sanders
+//    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+/////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cmath>
+
+#include "axistransform.h"
+
+AxisTransform::AxisTransform(Type type, double datascale,
+                             double minval, double maxval,
+                             double pix1, double pix2)
+  : _type(type), _datascale(datascale),
+    _pix1(pix1), _pixdelta(pix2-pix1)
+{
+  // log ranges are not clipped, as in the Python code
+  if(_type == LOG)
+    {
+      _min = std::log(minval);
+      _delta = std::log(maxval) - _min;
+    }
+  else
+    {
+      _min = minval;
+      _delta = maxval - _min;
+    }
+}
+
+// the same operations, in the same order, as the Python code, so that
+// the results are identical. The output stride is a template
+// parameter, so the loops are still simple enough to vectorise.
+template<int STRIDE>
+void AxisTransform::convertStrided(const double* in, double* out, int n) const
+{
+  // separate simple loops, so that the compiler can vectorise them
+  switch(_type)
+    {
+    case LOG:
+      for(int i = 0; i < n; ++i)
+        out[i*STRIDE] = std::log(std::min(std::max(in[i]*_datascale, 1e-99),
+                                          1e99));
+      break;
+    default:
+      for(int i = 0; i < n; ++i)
+        out[i*STRIDE] = in[i]*_datascale;
+      break;
+    }
+
+  const double min = _min;
+  const double delta = _delta;
+  const double pix1 = _pix1;
+  const double pixdelta = _pixdelta;
+  for(int i = 0; i < n; ++i)
+    out[i*STRIDE] = pix1 + ((out[i*STRIDE] - min) / delta)*pixdelta;
+}
+
+void AxisTransform::convertArray(const double* in, double* out, int n) const
+{
+  convertStrided<1>(in, out, n);
+}
+
+void AxisTransform::convertToPoints(const double* in, double* out, int n) const
+{
+  convertStrided<2>(in, out, n);
+}
@@ -0,0 +1,76 @@
+// -*- mode: C++; -*-
+
+//    Copyright (C) 2026 Jeremy S. Sanders
+//    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef AXISTRANSFORM_H
+#define AXISTRANSFORM_H
+
+#include <algorithm>
+#include <cmath>
+
+// Describes the conversion from data values to plotter coordinates
+// along an axis, as done by Axis.dataToPlotterCoords in Python.
+//
+// The data value is multiplied by datascale, converted to a fraction
+// of the range minval to maxval (linearly or logarithmically), then
+// converted to a position between plotter coordinates pix1 and pix2.
+
+class AxisTransform
+{
+public:
+  enum Type {LINEAR, LOG};
+
+  AxisTransform(Type type=LINEAR, double datascale=1,
+                double minval=0, double maxval=1,
+                double pix1=0, double pix2=1);
+
+  // convert a single value (use convertArray for many values, which
+  // chooses the conversion once)
+  double convert(double v) const
+  {
+    return _pix1 + ((scaled(v*_datascale) - _min) / _delta)*_pixdelta;
+  }
+
+  // convert n values from in to out (which may be the same)
+  void convertArray(const double* in, double* out, int n) const;
+
+  // convert n values from in to every other element of out, for
+  // writing the x or y coordinates of an array of QPointF
+  void convertToPoints(const double* in, double* out, int n) const;
+
+  Type type() const { return _type; }
+
+private:
+  template<int STRIDE>
+  void convertStrided(const double* in, double* out, int n) const;
+
+  // value mapped to a linear scale
+  double scaled(double v) const
+  {
+    return _type == LOG ? std::log(std::min(std::max(v, 1e-99), 1e99)) : v;
+  }
+
+private:
+  Type _type;
+  double _datascale;
+  double _min, _delta;          // start and size of scaled range
+  double _pix1, _pixdelta;
+};
+
+#endif
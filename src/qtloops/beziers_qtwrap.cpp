@@ -16,6 +16,12 @@
 //    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 /////////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <vector>
+
 #include "beziers.h"
 #include "beziers_qtwrap.h"
 
@@ -49,6 +55,193 @@ QPolygonF bezier_fit_cubic_multi( const QPolygonF& data, double error,
     return QPolygonF();
 }
 
+namespace
+{
+  // lines with more points than this are split into spans of about
+  // this many points, which are fitted independently
+  const int span_points = 2048;
+
+  // turns sharper than 60 degrees are treated as corners between spans
+  const double corner_cos = 0.5;
+
+  struct BezierSpan
+  {
+    BezierSpan(int _start, int _end)
+      : start(_start), end(_end), retn(0)
+    {}
+
+    int start, end;             // first and last points of span
+    QPointF tHat1, tHat2;       // end tangents (zero if unconstrained)
+    QPolygonF out;
+    int retn;
+  };
+
+  // cosine of the turning angle at point i (data must be uniqued)
+  double turnCos(const QPointF* d, int i)
+  {
+    const QPointF a = d[i] - d[i-1];
+    const QPointF b = d[i+1] - d[i];
+    return (a.x()*b.x() + a.y()*b.y()) /
+      std::sqrt( (a.x()*a.x() + a.y()*a.y()) * (b.x()*b.x() + b.y()*b.y()) );
+  }
+
+  // remove points closer than mindist to the previous point kept,
+  // keeping the end points. Returns new length.
+  int decimatePoints(QPointF* d, int len, double mindist)
+  {
+    if( len < 3 )
+      return len;
+
+    const double mindist2 = mindist*mindist;
+    int out = 1;
+    for(int i = 1; i < len-1; ++i)
+      {
+        const QPointF delta = d[i] - d[out-1];
+        if( delta.x()*delta.x() + delta.y()*delta.y() >= mindist2 )
+          d[out++] = d[i];
+      }
+    // replace the last kept point with the end if they are too close
+    const QPointF delta = d[len-1] - d[out-1];
+    if( out > 1 && delta.x()*delta.x() + delta.y()*delta.y() < mindist2 )
+      --out;
+    d[out++] = d[len-1];
+    return out;
+  }
+
+  // split data into spans, ending at the sharpest turn near each
+  // span_points interval. Tangents are shared across the joins,
+  // unless the turn is a corner.
+  std::vector<BezierSpan> splitSpans(const QPointF* d, int len)
+  {
+    std::vector<BezierSpan> spans;
+    const QPointF unconstrained(0, 0);
+
+    int start = 0;
+    QPointF tHat1 = unconstrained;
+    while( len-1-start > span_points + span_points/2 )
+      {
+        int split = start + span_points/2;
+        double splitcos = turnCos(d, split);
+        for(int i = split+1; i <= start + span_points; ++i)
+          {
+            const double c = turnCos(d, i);
+            if( c < splitcos )
+              {
+                split = i;
+                splitcos = c;
+              }
+          }
+
+        spans.push_back(BezierSpan(start, split));
+        spans.back().tHat1 = tHat1;
+        if( splitcos < corner_cos )
+          {
+            spans.back().tHat2 = unconstrained;
+            tHat1 = unconstrained;
+          }
+        else
+          {
+            // as when sp_bezier_fit_cubic_full splits at a point
+            spans.back().tHat2 = sp_darray_center_tangent(d, split, len);
+            tHat1 = -spans.back().tHat2;
+          }
+        start = split;
+      }
+
+    spans.push_back(BezierSpan(start, len-1));
+    spans.back().tHat1 = tHat1;
+    spans.back().tHat2 = unconstrained;
+    return spans;
+  }
+
+  void fitSpan(const QPointF* d, BezierSpan& span, double error)
+  {
+    const int len = span.end - span.start + 1;
+    span.out.resize(4*len);
+    span.retn = sp_bezier_fit_cubic_full(span.out.data(), NULL,
+                                         d + span.start, len,
+                                         span.tHat1, span.tHat2,
+                                         error, len);
+    span.out.resize(4*std::max(span.retn, 0));
+  }
+}
+
+QPolygonF bezier_fit_cubic_parallel(const QPolygonF& data, double error,
+                                    unsigned max_beziers, double decimate)
+{
+  if( data.isEmpty() )
+    return QPolygonF();
+
+  QPolygonF uniqued(data.size());
+  int len = copy_without_nans_or_adjacent_duplicates(data.data(),
+                                                     data.size(),
+                                                     uniqued.data());
+  if( decimate > 0 )
+    len = decimatePoints(uniqued.data(), len, decimate);
+  if( len < 2 )
+    return QPolygonF();
+
+  // short lines are fitted as bezier_fit_cubic_multi
+  if( len <= 2*span_points )
+    {
+      QPolygonF out(4*max_beziers);
+      const QPointF unconstrained(0, 0);
+      const int retn = sp_bezier_fit_cubic_full(out.data(), NULL,
+                                                uniqued.data(), len,
+                                                unconstrained, unconstrained,
+                                                error, max_beziers);
+      if( retn < 0 )
+        return QPolygonF();
+      out.resize(retn*4);
+      return out;
+    }
+
+  std::vector<BezierSpan> spans(splitSpans(uniqued.data(), len));
+
+  // fit spans in worker threads, taking the next unfitted span
+  std::atomic<unsigned> nextspan(0);
+  auto worker = [&]()
+    {
+      unsigned i;
+      while( (i = nextspan++) < spans.size() )
+        fitSpan(uniqued.data(), spans[i], error);
+    };
+
+  const unsigned nthreads = std::min<unsigned>(
+    std::max(std::thread::hardware_concurrency(), 1u), spans.size());
+  std::vector<std::thread> threads;
+  for(unsigned i = 1; i < nthreads; ++i)
+    {
+      try
+        {
+          threads.emplace_back(worker);
+        }
+      catch(...)
+        {
+          // carry on with fewer threads
+          break;
+        }
+    }
+  worker();
+  for(auto& thread : threads)
+    thread.join();
+
+  // join the spans in order
+  QPolygonF out;
+  unsigned nbeziers = 0;
+  for(const auto& span : spans)
+    {
+      if( span.retn < 0 )
+        return QPolygonF();
+      nbeziers += span.retn;
+      out += span.out;
+    }
+  if( nbeziers > max_beziers )
+    return QPolygonF();
+
+  return out;
+}
+
 QPolygonF bezier_fit_cubic_tight(const QPolygonF& data, double looseness)
 {
  /**
@@ -27,6 +27,12 @@
 QPolygonF bezier_fit_cubic_single(const QPolygonF& data, double error);
 QPolygonF bezier_fit_cubic_multi(const QPolygonF& data, double error,
 				 unsigned max_beziers);
+// as bezier_fit_cubic_multi, but long lines are split into spans at
+// sharp turns, which are fitted in parallel. If decimate > 0, points
+// closer than this to the previous point are removed first.
+QPolygonF bezier_fit_cubic_parallel(const QPolygonF& data, double error,
+				    unsigned max_beziers,
+				    double decimate = 0);
 QPolygonF bezier_fit_cubic_tight(const QPolygonF& data, double looseness);
 
 #endif
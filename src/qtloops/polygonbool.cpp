@@ -0,0 +1,779 @@
+// Copyright (C) 2026 Jeremy Sanders
+
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+// 02110-1301, USA.
+////////////////////////////////////////////////////////////////////
+
+// Polygon boolean operations with a sweep line, after Martinez,
+// Rueda and Feito (2009):
+//
+//  1. Events for the ends of every edge are put in a priority queue,
+//     ordered by x, then y.
+//  2. The edges crossing the sweep line are kept in a balanced tree,
+//     ordered from bottom to top. Only edges which become neighbours
+//     in the tree, when an edge is inserted or removed, are
+//     intersected. Crossing edges are split at the intersection,
+//     adding new events, so that edges in the tree never cross.
+//     Intersections within rounding error of a vertex or an earlier
+//     intersection are moved onto it, so concurrent edges meet at one
+//     point.
+//     Coincident edges are split to the same ends and merged, counting
+//     how many times each set covers them.
+//  3. When an edge is inserted, whether each set covers the region
+//     below it is taken from the edge below it in the tree. The
+//     region above follows from that and the counts of the edge.
+//  4. Edges where the result differs on either side are the output
+//     boundary. They are directed with the result on their left and
+//     linked into rings.
+//
+// For n edges with k intersections this takes O((n+k) log n) time.
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <deque>
+#include <initializer_list>
+#include <iterator>
+#include <queue>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "polygonbool.h"
+
+namespace
+{
+  // only use threads if there are more edges than this
+  const int parallel_min_edges = 20000;
+
+  inline bool ptLess(const QPointF& a, const QPointF& b)
+  {
+    return a.x() < b.x() || (a.x() == b.x() && a.y() < b.y());
+  }
+
+  struct PtLess
+  {
+    bool operator()(const QPointF& a, const QPointF& b) const
+    {
+      return ptLess(a, b);
+    }
+  };
+
+  // positive if c is to the left of a->b
+  inline double orient(const QPointF& a, const QPointF& b, const QPointF& c)
+  {
+    return (b.x()-a.x())*(c.y()-a.y()) - (b.y()-a.y())*(c.x()-a.x());
+  }
+
+  inline bool resultFor(PolygonBoolOp op, bool ina, bool inb)
+  {
+    switch(op)
+      {
+      case POLYBOOL_INTERSECTION: return ina && inb;
+      case POLYBOOL_UNION: return ina || inb;
+      case POLYBOOL_DIFFERENCE: return ina && !inb;
+      default: return ina != inb;
+      }
+  }
+
+  // directed output edge
+  struct DirEdge
+  {
+    QPointF from, to;
+  };
+
+  struct SweepEvent;
+
+  // order of edges in the sweep line, from bottom to top
+  struct SegmentLess
+  {
+    bool operator()(const SweepEvent* a, const SweepEvent* b) const;
+  };
+
+  typedef std::set<SweepEvent*, SegmentLess> SweepLine;
+
+  // An event at one end of an edge. The left event (the end with the
+  // lower x, or lower y if vertical) holds the state of the edge.
+  struct SweepEvent
+  {
+    QPointF pt;
+    QPointF s0, s1;             // input edge this is part of, left first
+    SweepEvent* other;          // event at the other end
+    SweepLine::iterator pos;    // position in sweep line, or end (left only)
+    unsigned id;                // order of creation, to break ties
+    int count[2];               // times covered by each set (left only)
+    int below;                  // bit per set covering region below
+    bool left;
+
+    // bits of sets changing coverage across the edge
+    int flips() const { return (count[0] & 1) | ((count[1] & 1) << 1); }
+    // bits of sets covering the region above (left of left->right)
+    int above() const { return below ^ flips(); }
+    bool vertical() const { return s0.x() == s1.x(); }
+    // side of the input edge p is on, positive if above, or zero if
+    // within rounding error of split points from it
+    double side(const QPointF& p) const
+    {
+      const double o = orient(s0, s1, p);
+      const double dx = s1.x()-s0.x(), dy = s1.y()-s0.y();
+      return std::abs(o) <= 1e-9*(dx*dx+dy*dy) ? 0 : o;
+    }
+    // is the edge on the same line as e?
+    bool collinear(const SweepEvent* e) const
+    {
+      return side(e->s0) == 0 && side(e->s1) == 0;
+    }
+  };
+
+  // Predicates use the input edges rather than the ends of split
+  // parts, which are rounded, so parts of coincident edges stay
+  // exactly coincident.
+
+  // positive if the direction of b is anticlockwise of a
+  inline double turn(const SweepEvent* a, const SweepEvent* b)
+  {
+    return orient(QPointF(0,0), a->s1-a->s0, b->s1-b->s0);
+  }
+
+  // is a processed after b?
+  bool eventAfter(const SweepEvent* a, const SweepEvent* b)
+  {
+    if( a->pt.x() != b->pt.x() )
+      return a->pt.x() > b->pt.x();
+    if( a->pt.y() != b->pt.y() )
+      return a->pt.y() > b->pt.y();
+    // right ends come before left ends at the same point
+    if( a->left != b->left )
+      return a->left;
+    // then the lower edge
+    const double o = turn(a, b);
+    if( o != 0 )
+      return (o < 0) == a->left;
+    return a->id > b->id;
+  }
+
+  struct EventAfter
+  {
+    bool operator()(const SweepEvent* a, const SweepEvent* b) const
+    {
+      return eventAfter(a, b);
+    }
+  };
+
+  bool SegmentLess::operator()(const SweepEvent* a, const SweepEvent* b) const
+  {
+    if( a == b )
+      return false;
+
+    if( !a->collinear(b) )
+      {
+        // sharing a left end, the directions decide
+        const double t = turn(a, b);
+        if( a->pt == b->pt && t != 0 )
+          return t > 0;
+        // left ends on the same vertical line
+        if( a->pt.x() == b->pt.x() && a->pt.y() != b->pt.y() )
+          return a->pt.y() < b->pt.y();
+        // test the left end of the edge inserted later against the
+        // other edge, or their directions if it touches it
+        const double o = eventAfter(b, a) ? a->side(b->pt) : -b->side(a->pt);
+        if( o != 0 )
+          return o > 0;
+        if( t != 0 )
+          return t > 0;
+        return a->id < b->id;
+      }
+
+    // collinear
+    if( a->pt != b->pt )
+      return eventAfter(b, a);
+    return a->id < b->id;
+  }
+
+  class BoolEngine
+  {
+  public:
+    BoolEngine(PolygonBoolOp op) : _op(op), _nextid(0) {}
+
+    void addPolygon(const QPolygonF& poly, int set);
+    QList<QPolygonF> run();
+
+  private:
+    SweepEvent* newEvent(const QPointF& pt, bool left);
+    void addEdge(const QPointF& p1, const QPointF& p2, int set);
+    void divide(SweepEvent* le, const QPointF& pt);
+    QPointF snapCrossing(const QPointF& pt, double tol,
+                         std::initializer_list<QPointF> ends);
+    bool intersect(SweepEvent* e1, SweepEvent* e2);
+    bool overlap(SweepEvent* e1, SweepEvent* e2);
+    void merge(SweepEvent* keep, SweepEvent* drop);
+    void computeFields(SweepEvent* le);
+    void insertEdge(SweepEvent* le);
+    void removeEdge(SweepEvent* re);
+    QList<QPolygonF> linkRings();
+
+  private:
+    PolygonBoolOp _op;
+    unsigned _nextid;
+    std::deque<SweepEvent> _events;
+    std::priority_queue<SweepEvent*, std::vector<SweepEvent*>,
+                        EventAfter> _queue;
+    SweepLine _sweepline;
+    QPointF _sweeppt;
+    std::vector<DirEdge> _diredges;
+    std::vector<QPointF> _vertices;           // sorted when run
+    std::set<QPointF, PtLess> _crossings;
+    std::set<double> _verticalxs;
+  };
+
+  SweepEvent* BoolEngine::newEvent(const QPointF& pt, bool left)
+  {
+    _events.emplace_back();
+    SweepEvent* e = &_events.back();
+    e->pt = e->s0 = e->s1 = pt;
+    e->other = 0;
+    e->pos = _sweepline.end();
+    e->id = _nextid++;
+    e->count[0] = e->count[1] = 0;
+    e->below = 0;
+    e->left = left;
+    return e;
+  }
+
+  void BoolEngine::addEdge(const QPointF& p1, const QPointF& p2, int set)
+  {
+    const bool fwd = ptLess(p1, p2);
+    SweepEvent* le = newEvent(fwd ? p1 : p2, true);
+    SweepEvent* re = newEvent(fwd ? p2 : p1, false);
+    le->other = re;
+    re->other = le;
+    le->s0 = re->s0 = le->pt;
+    le->s1 = re->s1 = re->pt;
+    le->count[set] = 1;
+    _vertices.push_back(p1);
+    if( le->vertical() )
+      _verticalxs.insert(le->pt.x());
+    _queue.push(le);
+    _queue.push(re);
+  }
+
+  void BoolEngine::addPolygon(const QPolygonF& poly, int set)
+  {
+    // ignore non-finite points
+    QPolygonF pts;
+    for(const auto& pt : poly)
+      if( std::isfinite(pt.x()) && std::isfinite(pt.y()) )
+        pts << pt;
+    if( pts.size() < 3 )
+      return;
+
+    for(int i = 0; i < pts.size(); ++i)
+      {
+        const QPointF& p1 = pts[i];
+        const QPointF& p2 = pts[(i+1) % pts.size()];
+        if( p1 != p2 )
+          addEdge(p1, p2, set);
+      }
+  }
+
+  // split the edge of left event le at pt, which must be inside it
+  void BoolEngine::divide(SweepEvent* le, const QPointF& pt)
+  {
+    SweepEvent* re = le->other;
+    if( !ptLess(le->pt, pt) || !ptLess(pt, re->pt) )
+      return;
+
+    // le keeps the left part, ending at r, and l starts the right part
+    SweepEvent* r = newEvent(pt, false);
+    SweepEvent* l = newEvent(pt, true);
+    r->other = le;
+    l->other = re;
+    r->s0 = l->s0 = le->s0;
+    r->s1 = l->s1 = le->s1;
+    l->count[0] = le->count[0];
+    l->count[1] = le->count[1];
+    le->other = r;
+    re->other = l;
+    _queue.push(r);
+    _queue.push(l);
+  }
+
+  // Use an end or an existing point within tol of the crossing pt if
+  // there is one, otherwise remember pt for later crossings. The
+  // point is not put behind the sweep line.
+  QPointF BoolEngine::snapCrossing(const QPointF& pt, double tol,
+                                   std::initializer_list<QPointF> ends)
+  {
+    auto near = [&pt, tol](const QPointF& p)
+      {
+        return std::abs(pt.x()-p.x()) + std::abs(pt.y()-p.y()) <= tol;
+      };
+
+    const QPointF* match = 0;
+    for(const QPointF& end : ends)
+      if( near(end) )
+        {
+          match = &end;
+          break;
+        }
+    const QPointF lo(pt.x()-tol, -INFINITY);
+    for(auto it = std::lower_bound(_vertices.begin(), _vertices.end(), lo,
+                                   ptLess);
+        match == 0 && it != _vertices.end() && it->x() <= pt.x()+tol; ++it)
+      if( near(*it) )
+        match = &*it;
+    for(auto it = _crossings.lower_bound(lo);
+        match == 0 && it != _crossings.end() && it->x() <= pt.x()+tol; ++it)
+      if( near(*it) )
+        match = &*it;
+
+    QPointF snapped(pt);
+    if( match != 0 )
+      snapped = *match;
+    else
+      {
+        // a crossing on a vertical edge must be at its x to split it
+        auto vx = _verticalxs.lower_bound(pt.x()-tol);
+        if( vx != _verticalxs.end() && *vx <= pt.x()+tol )
+          snapped.setX(*vx);
+      }
+
+    if( ptLess(snapped, _sweeppt) )
+      return _sweeppt;
+    if( match == 0 )
+      _crossings.insert(snapped);
+    return snapped;
+  }
+
+  // Intersect neighbouring edges in the sweep line, with e1 below e2.
+  // Returns whether e2 was merged into e1 and removed.
+  bool BoolEngine::intersect(SweepEvent* e1, SweepEvent* e2)
+  {
+    if( e1->collinear(e2) )
+      return overlap(e1, e2);
+
+    const QPointF a1(e1->pt), b1(e1->other->pt);
+    const QPointF a2(e2->pt), b2(e2->other->pt);
+    const double o1 = e1->side(a2);
+    const double o2 = e1->side(b2);
+    const double o3 = e2->side(a1);
+    const double o4 = e2->side(b1);
+    if( ((o1 > 0 && o2 < 0) || (o1 < 0 && o2 > 0)) &&
+        ((o3 > 0 && o4 < 0) || (o3 < 0 && o4 > 0)) )
+      {
+        // Proper crossing: the same point splits both edges. It is
+        // calculated from the input edges in a fixed order, so
+        // coincident edges are split at identical points.
+        QPointF e1a(e1->s0), e1b(e1->s1), e2a(e2->s0), e2b(e2->s1);
+        if( ptLess(e2a, e1a) || (e2a == e1a && ptLess(e2b, e1b)) )
+          {
+            std::swap(e1a, e2a);
+            std::swap(e1b, e2b);
+          }
+        const double c1 = orient(e2a, e2b, e1a);
+        const double c2 = orient(e2a, e2b, e1b);
+        const double t = c1 / (c1-c2);
+        QPointF pt( e1a.x() + t*(e1b.x()-e1a.x()),
+                    e1a.y() + t*(e1b.y()-e1a.y()) );
+        // keep rounding errors inside both edges' bounds
+        pt.setX( std::min(std::max(pt.x(), std::max(
+                            std::min(a1.x(), b1.x()), std::min(a2.x(), b2.x()))),
+                          std::min(std::max(a1.x(), b1.x()),
+                                   std::max(a2.x(), b2.x()))) );
+        pt.setY( std::min(std::max(pt.y(), std::max(
+                            std::min(a1.y(), b1.y()), std::min(a2.y(), b2.y()))),
+                          std::min(std::max(a1.y(), b1.y()),
+                                   std::max(a2.y(), b2.y()))) );
+        // concurrent edges should meet at one point, so use an end or
+        // an earlier point if it is within rounding error
+        const double tol = 1e-9 * std::max(
+          std::abs(e1b.x()-e1a.x()) + std::abs(e1b.y()-e1a.y()),
+          std::abs(e2b.x()-e2a.x()) + std::abs(e2b.y()-e2a.y()));
+        pt = snapCrossing(pt, tol, {a1, b1, a2, b2});
+        divide(e1, pt);
+        divide(e2, pt);
+        return false;
+      }
+
+    // an end of one edge touching the other
+    if( o1 == 0 )
+      divide(e1, a2);
+    else if( o2 == 0 )
+      divide(e1, b2);
+    if( o3 == 0 )
+      divide(e2, a1);
+    else if( o4 == 0 )
+      divide(e2, b1);
+    return false;
+  }
+
+  // Collinear edges: the overlapping parts are split to the same ends,
+  // then merged into the lower edge when their left ends meet, so the
+  // sweep line never holds two coincident edges.
+  bool BoolEngine::overlap(SweepEvent* e1, SweepEvent* e2)
+  {
+    const QPointF b1(e1->other->pt), b2(e2->other->pt);
+    if( !ptLess(e1->pt, b2) || !ptLess(e2->pt, b1) )
+      return false;
+
+    if( e1->pt != e2->pt )
+      {
+        // split the edge starting first where the other starts
+        if( ptLess(e1->pt, e2->pt) )
+          divide(e1, e2->pt);
+        else
+          divide(e2, e1->pt);
+        return false;
+      }
+
+    // same left end: split the longer edge where the shorter ends
+    if( ptLess(b1, b2) )
+      divide(e2, b1);
+    else if( ptLess(b2, b1) )
+      divide(e1, b2);
+
+    merge(e1, e2);
+    return true;
+  }
+
+  // Replace coincident edges by the lower one, keep, carrying both
+  // counts. The region above keep is then the one above drop, so only
+  // keep's own fields need updating.
+  void BoolEngine::merge(SweepEvent* keep, SweepEvent* drop)
+  {
+    keep->count[0] += drop->count[0];
+    keep->count[1] += drop->count[1];
+    _sweepline.erase(drop->pos);
+    drop->pos = _sweepline.end();
+    computeFields(keep);
+  }
+
+  // coverage below an edge from the edge below it in the sweep line
+  void BoolEngine::computeFields(SweepEvent* le)
+  {
+    if( le->pos == _sweepline.begin() )
+      le->below = 0;
+    else
+      {
+        const SweepEvent* prev = *std::prev(le->pos);
+        // the right side of a vertical edge is its lower side
+        le->below = prev->vertical() ? prev->below : prev->above();
+      }
+  }
+
+  void BoolEngine::insertEdge(SweepEvent* le)
+  {
+    le->pos = _sweepline.insert(le).first;
+    SweepEvent* prev = le->pos == _sweepline.begin() ? 0 :
+      *std::prev(le->pos);
+    SweepEvent* next = std::next(le->pos) == _sweepline.end() ? 0 :
+      *std::next(le->pos);
+
+    computeFields(le);
+    if( next != 0 )
+      intersect(le, next);
+    if( prev != 0 )
+      intersect(prev, le);
+  }
+
+  void BoolEngine::removeEdge(SweepEvent* re)
+  {
+    // edges merged into another have already gone
+    SweepEvent* le = re->other;
+    if( le->pos == _sweepline.end() )
+      return;
+
+    SweepEvent* prev = le->pos == _sweepline.begin() ? 0 :
+      *std::prev(le->pos);
+    SweepEvent* next = std::next(le->pos) == _sweepline.end() ? 0 :
+      *std::next(le->pos);
+    _sweepline.erase(le->pos);
+    le->pos = _sweepline.end();
+
+    if( prev != 0 && next != 0 )
+      intersect(prev, next);
+
+    // output edges where the result differs either side, with the
+    // result on their left
+    const int below = le->below;
+    const int above = le->above();
+    const bool resbelow = resultFor(_op, below & 1, below & 2);
+    const bool resabove = resultFor(_op, above & 1, above & 2);
+    if( resbelow != resabove )
+      {
+        DirEdge d;
+        d.from = resabove ? le->pt : re->pt;
+        d.to = resabove ? re->pt : le->pt;
+        _diredges.push_back(d);
+      }
+  }
+
+  QList<QPolygonF> BoolEngine::linkRings()
+  {
+    QList<QPolygonF> rings;
+
+    const int num = int(_diredges.size());
+    std::sort(_diredges.begin(), _diredges.end(),
+              [](const DirEdge& p, const DirEdge& q)
+              {
+                return ptLess(p.from, q.from);
+              });
+    std::vector<char> used(num, 0);
+
+    // find an unused edge leaving pt, turning most to the left from
+    // incoming direction dx,dy
+    auto nextEdge = [&](const QPointF& pt, double dx, double dy)
+      {
+        auto range = std::equal_range(
+          _diredges.begin(), _diredges.end(), DirEdge{pt, pt},
+          [](const DirEdge& p, const DirEdge& q)
+          {
+            return ptLess(p.from, q.from);
+          });
+        int best = -1;
+        double bestangle = 0;
+        for(auto it = range.first; it != range.second; ++it)
+          {
+            const int idx = int(it - _diredges.begin());
+            if( used[idx] )
+              continue;
+            const double ox = it->to.x()-pt.x();
+            const double oy = it->to.y()-pt.y();
+            const double angle = std::atan2(dx*oy-dy*ox, dx*ox+dy*oy);
+            if( best < 0 || angle > bestangle )
+              {
+                best = idx;
+                bestangle = angle;
+              }
+          }
+        return best;
+      };
+
+    for(int start = 0; start < num; ++start)
+      {
+        if( used[start] )
+          continue;
+
+        QPolygonF ring;
+        int cur = start;
+        for(;;)
+          {
+            used[cur] = 1;
+            ring << _diredges[cur].from;
+            const QPointF& end = _diredges[cur].to;
+            if( end == _diredges[start].from )
+              break;
+            cur = nextEdge(end, end.x()-_diredges[cur].from.x(),
+                           end.y()-_diredges[cur].from.y());
+            if( cur < 0 )
+              {
+                // never output an unclosed ring
+                ring.clear();
+                break;
+              }
+          }
+
+        // remove points in the middle of straight lines
+        QPolygonF simple;
+        const int n = ring.size();
+        for(int i = 0; i < n; ++i)
+          {
+            const QPointF& prev = ring[(i+n-1) % n];
+            const QPointF& next = ring[(i+1) % n];
+            const QPointF& pt = ring[i];
+            if( orient(prev, pt, next) != 0 ||
+                (pt.x()-prev.x())*(next.x()-pt.x()) +
+                (pt.y()-prev.y())*(next.y()-pt.y()) < 0 )
+              simple << pt;
+          }
+        if( simple.size() >= 3 )
+          rings << simple;
+      }
+
+    return rings;
+  }
+
+  QList<QPolygonF> BoolEngine::run()
+  {
+    std::sort(_vertices.begin(), _vertices.end(), ptLess);
+
+    while( !_queue.empty() )
+      {
+        SweepEvent* e = _queue.top();
+        _queue.pop();
+        _sweeppt = e->pt;
+        if( e->left )
+          insertEdge(e);
+        else
+          removeEdge(e);
+      }
+    return linkRings();
+  }
+
+  // bounding box of finite points in polygon
+  struct PolyBox
+  {
+    double minx, maxx, miny, maxy;
+    int set, index;
+    bool valid;
+  };
+
+  PolyBox polyBox(const QPolygonF& poly, int set, int index)
+  {
+    PolyBox box;
+    box.set = set; box.index = index; box.valid = false;
+    box.minx = box.maxx = box.miny = box.maxy = 0;
+    for(const auto& pt : poly)
+      {
+        if( !std::isfinite(pt.x()) || !std::isfinite(pt.y()) )
+          continue;
+        if( !box.valid )
+          {
+            box.minx = box.maxx = pt.x();
+            box.miny = box.maxy = pt.y();
+            box.valid = true;
+          }
+        box.minx = std::min(box.minx, pt.x()); box.maxx = std::max(box.maxx, pt.x());
+        box.miny = std::min(box.miny, pt.y()); box.maxy = std::max(box.maxy, pt.y());
+      }
+    return box;
+  }
+
+  int findRoot(std::vector<int>& parent, int i)
+  {
+    while( parent[i] != i )
+      {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+      }
+    return i;
+  }
+
+  // split polygons into groups which do not overlap other groups,
+  // by joining those with overlapping bounding boxes
+  std::vector<std::vector<PolyBox>> groupPolygons(const QList<QPolygonF>& a,
+                                                  const QList<QPolygonF>& b)
+  {
+    std::vector<PolyBox> boxes;
+    for(int i = 0; i < a.size(); ++i)
+      boxes.push_back(polyBox(a[i], 0, i));
+    for(int i = 0; i < b.size(); ++i)
+      boxes.push_back(polyBox(b[i], 1, i));
+
+    const int num = int(boxes.size());
+    std::vector<int> parent(num);
+    std::vector<int> order;
+    for(int i = 0; i < num; ++i)
+      {
+        parent[i] = i;
+        if( boxes[i].valid )
+          order.push_back(i);
+      }
+    std::sort(order.begin(), order.end(), [&boxes](int p, int q)
+              {
+                return boxes[p].minx < boxes[q].minx;
+              });
+
+    std::vector<int> active;
+    for(int idx : order)
+      {
+        const PolyBox& box = boxes[idx];
+        unsigned out = 0;
+        for(unsigned i = 0; i < active.size(); ++i)
+          {
+            const PolyBox& o = boxes[active[i]];
+            if( o.maxx < box.minx )
+              continue;
+            active[out++] = active[i];
+            if( o.maxy >= box.miny && box.maxy >= o.miny )
+              parent[findRoot(parent, active[i])] = findRoot(parent, idx);
+          }
+        active.resize(out);
+        active.push_back(idx);
+      }
+
+    // groups in order of first polygon, for repeatable output
+    std::vector<std::vector<PolyBox>> groups;
+    std::vector<int> groupof(num, -1);
+    for(int i = 0; i < num; ++i)
+      {
+        if( !boxes[i].valid )
+          continue;
+        const int root = findRoot(parent, i);
+        if( groupof[root] < 0 )
+          {
+            groupof[root] = int(groups.size());
+            groups.push_back(std::vector<PolyBox>());
+          }
+        groups[groupof[root]].push_back(boxes[i]);
+      }
+    return groups;
+  }
+
+} // namespace
+
+QList<QPolygonF> polygonBoolean(const QList<QPolygonF>& a,
+                                const QList<QPolygonF>& b,
+                                PolygonBoolOp op)
+{
+  const std::vector<std::vector<PolyBox>> groups(groupPolygons(a, b));
+  std::vector<QList<QPolygonF>> results(groups.size());
+
+  int totedges = 0;
+  for(const auto& poly : a)
+    totedges += poly.size();
+  for(const auto& poly : b)
+    totedges += poly.size();
+
+  std::atomic<unsigned> nextgroup(0);
+  auto worker = [&]()
+    {
+      unsigned i;
+      while( (i = nextgroup++) < groups.size() )
+        {
+          BoolEngine engine(op);
+          for(const auto& box : groups[i])
+            engine.addPolygon(box.set == 0 ? a[box.index] : b[box.index],
+                              box.set);
+          results[i] = engine.run();
+        }
+    };
+
+  unsigned nthreads = 1;
+  if( totedges > parallel_min_edges )
+    nthreads = std::min<unsigned>(
+      std::max(std::thread::hardware_concurrency(), 1u), groups.size());
+
+  std::vector<std::thread> threads;
+  for(unsigned i = 1; i < nthreads; ++i)
+    {
+      try
+        {
+          threads.emplace_back(worker);
+        }
+      catch(...)
+        {
+          break;
+        }
+    }
+  worker();
+  for(auto& thread : threads)
+    thread.join();
+
+  QList<QPolygonF> out;
+  for(const auto& res : results)
+    out += res;
+  return out;
+}
@@ -0,0 +1,67 @@
+// -*- mode: C++; -*-
+
+// Copyright (C) 2026 Jeremy Sanders
+
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+// 02110-1301, USA.
+////////////////////////////////////////////////////////////////////
+
+#ifndef POLYGONBOOL_HH
+#define POLYGONBOOL_HH
+
+#include <QPolygonF>
+#include <QList>
+
+// Boolean operations between two sets of polygons. Each set is the
+// region covered by its polygons using the odd-even fill rule, so
+// polygons may be concave, self-intersecting or contain holes.
+//
+// The output polygons are closed rings (without a repeated end
+// point), which have the region on their left for y increasing
+// upwards. Holes go the other way, so the output can be drawn with
+// either fill rule.
+//
+// Groups of polygons with overlapping bounding boxes are independent,
+// so are processed in parallel.
+
+enum PolygonBoolOp
+  {
+    POLYBOOL_INTERSECTION,
+    POLYBOOL_UNION,
+    POLYBOOL_DIFFERENCE,        // a minus b
+    POLYBOOL_XOR
+  };
+
+QList<QPolygonF> polygonBoolean(const QList<QPolygonF>& a,
+                                const QList<QPolygonF>& b,
+                                PolygonBoolOp op);
+
+inline QList<QPolygonF> polygonIntersection(const QList<QPolygonF>& a,
+                                            const QList<QPolygonF>& b)
+{
+  return polygonBoolean(a, b, POLYBOOL_INTERSECTION);
+}
+inline QList<QPolygonF> polygonUnion(const QList<QPolygonF>& a,
+                                     const QList<QPolygonF>& b)
+{
+  return polygonBoolean(a, b, POLYBOOL_UNION);
+}
+inline QList<QPolygonF> polygonDifference(const QList<QPolygonF>& a,
+                                          const QList<QPolygonF>& b)
+{
+  return polygonBoolean(a, b, POLYBOOL_DIFFERENCE);
+}
+
+#endif
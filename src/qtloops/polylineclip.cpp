@@ -351,24 +351,41 @@ QList<QPolygonF> clipPolyline(QRectF clip, const QPolygonF& poly)
 //////////////////////////////////////////////////////
 
 typedef QList<QPolygonF> PolyVector;
+typedef QList<QVector<double>> LengthsVector;
 
 // clip polygon, adding clipped parts to output vector of polygons
+// and their cumulative lengths to the output vector of lengths
 class _LineLabClipper : public _PolyClipper
 {
 public:
-  _LineLabClipper(QRectF cliprect, PolyVector& polyvec)
+  _LineLabClipper(QRectF cliprect, PolyVector& polyvec,
+                  LengthsVector& lengthsvec)
     : _PolyClipper(cliprect),
-      _polyvec(polyvec)
+      _polyvec(polyvec),
+      _lengthsvec(lengthsvec)
   {
   }
 
   void emitPolyline(const QPolygonF& poly)
   {
     _polyvec.append(poly);
+
+    // lengths[i] is the distance along the line to point i
+    QVector<double> lengths(poly.size());
+    double length = 0;
+    for(int i = 0; i < poly.size(); ++i)
+      {
+        if(i > 0)
+          length += std::sqrt( sqr(poly[i-1].x()-poly[i].x()) +
+                               sqr(poly[i-1].y()-poly[i].y()) );
+        lengths[i] = length;
+      }
+    _lengthsvec.append(lengths);
   }
 
 private:
   PolyVector& _polyvec;
+  LengthsVector& _lengthsvec;
 };
 
 ///////////////////////////////////////////////////////
@@ -418,6 +435,46 @@ bool doPolygonsIntersect(const QPolygonF& a, const QPolygonF& b)
   return true;
 }
 
+namespace
+{
+  // as doPolygonsIntersect, but for clockwise quadrilaterals held in
+  // fixed arrays, avoiding allocation
+  bool doQuadsIntersect(const QPointF a[4], const QPointF b[4])
+  {
+    const QPointF* polys[2] = {a, b};
+    for(const QPointF* poly : polys)
+      {
+        for(int i = 0; i < 4; ++i)
+          {
+            const QPointF& prevpt = poly[(i+3) & 3];
+            const QPointF& currpt = poly[i];
+
+            // normal to line segment
+            const double normx = currpt.y()-prevpt.y();
+            const double normy = prevpt.x()-currpt.x();
+
+            double minA, maxA, minB, maxB;
+            minA = maxA = normx*a[0].x() + normy*a[0].y();
+            minB = maxB = normx*b[0].x() + normy*b[0].y();
+            for(int j = 1; j < 4; ++j)
+              {
+                const double projA = normx*a[j].x() + normy*a[j].y();
+                minA = std::min(minA, projA);
+                maxA = std::max(maxA, projA);
+                const double projB = normx*b[j].x() + normy*b[j].y();
+                minB = std::min(minB, projB);
+                maxB = std::max(maxB, projB);
+              }
+
+            if(maxA<minB || maxB<minA)
+              return false;
+          }
+      }
+
+    return true;
+  }
+}
+
 ///////////////////////////////////////////////////////
 
 void RotatedRectangle::rotateAboutOrigin(double dtheta)
@@ -437,32 +494,159 @@ void RotatedRectangle::rotateAboutOrigin(double dtheta)
 
 // note: output polygon is clockwise
 QPolygonF RotatedRectangle::makePolygon() const
+{
+  QPointF pts[4];
+  makeCorners(pts);
+
+  QPolygonF poly;
+  poly << pts[0] << pts[1] << pts[2] << pts[3];
+  return poly;
+}
+
+void RotatedRectangle::makeCorners(QPointF pts[4]) const
 {
   const double c = std::cos(angle);
   const double s = std::sin(angle);
   const double xh = 0.5*xw;
   const double yh = 0.5*yw;
 
-  QPolygonF poly;
-  poly << QPointF(-xh*c + yh*s + cx, -xh*s - yh*c + cy);
-  poly << QPointF(-xh*c - yh*s + cx, -xh*s + yh*c + cy);
-  poly << QPointF( xh*c - yh*s + cx,  xh*s + yh*c + cy);
-  poly << QPointF( xh*c + yh*s + cx,  xh*s - yh*c + cy);
-  return poly;
+  pts[0] = QPointF(-xh*c + yh*s + cx, -xh*s - yh*c + cy);
+  pts[1] = QPointF(-xh*c - yh*s + cx, -xh*s + yh*c + cy);
+  pts[2] = QPointF( xh*c - yh*s + cx,  xh*s + yh*c + cy);
+  pts[3] = QPointF( xh*c + yh*s + cx,  xh*s - yh*c + cy);
 }
 
+// rectangles covering more grid cells than this are not put in the grid
+#define MAX_OVERLAP_GRID_CELLS 64
+
 RectangleOverlapTester::RectangleOverlapTester()
+  : _cellsize(0), _query(0)
+{
+}
+
+RectangleOverlapTester::Entry
+RectangleOverlapTester::makeEntry(const RotatedRectangle& rect)
+{
+  Entry e;
+  rect.makeCorners(e.corners);
+  e.minx = e.maxx = e.corners[0].x();
+  e.miny = e.maxy = e.corners[0].y();
+  for(int i = 1; i < 4; ++i)
+    {
+      e.minx = std::min(e.minx, e.corners[i].x());
+      e.maxx = std::max(e.maxx, e.corners[i].x());
+      e.miny = std::min(e.miny, e.corners[i].y());
+      e.maxy = std::max(e.maxy, e.corners[i].y());
+    }
+  return e;
+}
+
+bool RectangleOverlapTester::cellRange(const Entry& e,
+                                       int& x0, int& y0,
+                                       int& x1, int& y1) const
+{
+  if( _cellsize <= 0 )
+    return false;
+
+  const double fx0 = std::floor(e.minx / _cellsize);
+  const double fy0 = std::floor(e.miny / _cellsize);
+  const double fx1 = std::floor(e.maxx / _cellsize);
+  const double fy1 = std::floor(e.maxy / _cellsize);
+
+  // written so that NaN values fail the tests
+  const double lim = std::numeric_limits<int>::max();
+  if( !( fx0 > -lim && fy0 > -lim && fx1 < lim && fy1 < lim &&
+         (fx1-fx0+1)*(fy1-fy0+1) <= MAX_OVERLAP_GRID_CELLS ) )
+    return false;
+
+  x0 = int(fx0); y0 = int(fy0);
+  x1 = int(fx1); y1 = int(fy1);
+  return true;
+}
+
+void RectangleOverlapTester::addRect(const RotatedRectangle& rect)
+{
+  const Entry e(makeEntry(rect));
+  const int idx = _entries.size();
+  _entries.append(e);
+  _visited.append(0);
+
+  // labels are usually of a similar size, so use the first
+  if( _cellsize <= 0 )
+    {
+      const double size = std::max(e.maxx-e.minx, e.maxy-e.miny);
+      if( std::isfinite(size) && size > 0 )
+        _cellsize = size;
+    }
+
+  int x0, y0, x1, y1;
+  if( cellRange(e, x0, y0, x1, y1) )
+    {
+      for(int y = y0; y <= y1; ++y)
+        for(int x = x0; x <= x1; ++x)
+          _grid[cellKey(x, y)].append(idx);
+    }
+  else
+    _ungridded.append(idx);
+}
+
+void RectangleOverlapTester::reset()
 {
+  _entries.clear();
+  _grid.clear();
+  _ungridded.clear();
+  _visited.clear();
+  _cellsize = 0;
+  _query = 0;
 }
 
 bool RectangleOverlapTester::willOverlap(const RotatedRectangle& rect) const
 {
-  const QPolygonF thispoly(rect.makePolygon());
+  const Entry e(makeEntry(rect));
 
-  for(auto const &ir : _rects)
+  // entries may be in several cells, so mark those tested
+  if( ++_query == 0 )
     {
-      if( doPolygonsIntersect(thispoly, ir.makePolygon()) )
-        return true;
+      _visited.fill(0);
+      _query = 1;
+    }
+
+  auto overlaps = [&](int idx)
+    {
+      if( _visited[idx] == _query )
+        return false;
+      _visited[idx] = _query;
+
+      const Entry& o = _entries[idx];
+      if( o.maxx < e.minx || e.maxx < o.minx ||
+          o.maxy < e.miny || e.maxy < o.miny )
+        return false;
+      return doQuadsIntersect(e.corners, o.corners);
+    };
+
+  for(int idx : _ungridded)
+    if( overlaps(idx) )
+      return true;
+
+  int x0, y0, x1, y1;
+  if( cellRange(e, x0, y0, x1, y1) )
+    {
+      for(int y = y0; y <= y1; ++y)
+        for(int x = x0; x <= x1; ++x)
+          {
+            auto it = _grid.constFind(cellKey(x, y));
+            if( it != _grid.constEnd() )
+              for(int idx : *it)
+                if( overlaps(idx) )
+                  return true;
+          }
+    }
+  else
+    {
+      // too large for the grid, so check everything
+      for(int idx = 0; idx < _entries.size(); ++idx)
+        if( overlaps(idx) )
+          return true;
     }
 
   return false;
@@ -470,19 +654,26 @@ bool RectangleOverlapTester::willOverlap(const RotatedRectangle& rect) const
 
 void RectangleOverlapTester::debug(QPainter& painter) const
 {
-  for(auto const &rect : _rects)
-    {
-      QPolygonF poly = rect.makePolygon();
-      painter.drawPolygon(poly);
-    }
+  for(auto const &e : _entries)
+    painter.drawPolygon(e.corners, 4);
 }
 
 ///////////////////////////////////////////////////////
 
+// these are the default positions where labels might be placed
+namespace
+{
+#define NUM_LABEL_POSITIONS 7
+  const double label_positions[NUM_LABEL_POSITIONS] = {
+    0.5, 1/3., 2/3., 0.4, 0.6, 0.25, 0.75};
+}
+
 LineLabeller::LineLabeller(QRectF cliprect, bool rotatelabels)
   : _cliprect(cliprect),
     _rotatelabels(rotatelabels)
 {
+  for(int i = 0; i < NUM_LABEL_POSITIONS; ++i)
+    _positions.append(label_positions[i]);
 }
 
 LineLabeller::~LineLabeller()
@@ -496,60 +687,50 @@ void LineLabeller::drawAt(int idx, RotatedRectangle r)
 void LineLabeller::addLine(const QPolygonF& poly, QSizeF textsize)
 {
   _polys.append( PolyVector() );
+  _lengths.append( LengthsVector() );
   _textsizes.append(textsize);
-  _LineLabClipper clipper(_cliprect, _polys.last());
+  _LineLabClipper clipper(_cliprect, _polys.last(), _lengths.last());
   clipper.clipPolyline(poly);
 }
 
+void LineLabeller::setLabelPositions(const QVector<double>& positions)
+{
+  _positions = positions;
+}
+
 // returns RotatedRectangle with zero size if error
+// lengths are the cumulative lengths along the polyline
 RotatedRectangle LineLabeller::findLinePosition(const QPolygonF& poly,
+                                                const QVector<double>& lengths,
                                                 double frac, QSizeF size)
 {
-  double totlength = 0;
-  for(int i = 1; i < poly.size(); ++i)
-    {
-      totlength += std::sqrt( sqr(poly[i-1].x()-poly[i].x()) +
-                              sqr(poly[i-1].y()-poly[i].y()) );
-    }
+  if( poly.size() < 2 )
+    return RotatedRectangle();
+  const double totlength = lengths.last();
 
   // don't label lines which are too short
   if( totlength/2 < std::max(size.width(), size.height()) )
     return RotatedRectangle();
 
-  // now repeat and stop when we've reached the right length
-  double length = 0;
-  for(int i = 1; i < poly.size(); ++i)
-    {
-      const double seglength = std::sqrt( sqr(poly[i-1].x()-poly[i].x()) +
-                                          sqr(poly[i-1].y()-poly[i].y()) );
-      if(length + seglength >= totlength*frac)
-        {
-          // interpolate along edge
-          const double fseg = (totlength*frac - length) / seglength;
-          const double xp = poly[i-1].x()*(1-fseg) + poly[i].x()*fseg;
-          const double yp = poly[i-1].y()*(1-fseg) + poly[i].y()*fseg;
-
-          const double angle = _rotatelabels ?
-            std::atan2( poly[i].y() - poly[i-1].y(),
-                        poly[i].x() - poly[i-1].x() )
-            : 0.;
-          return RotatedRectangle(xp, yp, size.width(),
-                                  size.height(), angle);
-        }
-
-      length += seglength;
-    }
-
-  // shouldn't get here
-  return RotatedRectangle();
-}
+  // find first point at or beyond the required length
+  const double target = totlength*frac;
+  const int i = std::lower_bound(lengths.begin()+1, lengths.end(), target) -
+    lengths.begin();
+  if( i >= poly.size() )
+    return RotatedRectangle();
 
-// these are the positions where labels might be placed
-namespace
-{
-#define NUM_LABEL_POSITIONS 7
-  const double label_positions[NUM_LABEL_POSITIONS] = {
-    0.5, 1/3., 2/3., 0.4, 0.6, 0.25, 0.75};
+  // interpolate along edge
+  const double seglength = std::sqrt( sqr(poly[i-1].x()-poly[i].x()) +
+                                      sqr(poly[i-1].y()-poly[i].y()) );
+  const double fseg = (target - lengths[i-1]) / seglength;
+  const double xp = poly[i-1].x()*(1-fseg) + poly[i].x()*fseg;
+  const double yp = poly[i-1].y()*(1-fseg) + poly[i].y()*fseg;
+
+  const double angle = _rotatelabels ?
+    std::atan2( poly[i].y() - poly[i-1].y(),
+                poly[i].x() - poly[i-1].x() )
+    : 0.;
+  return RotatedRectangle(xp, yp, size.width(), size.height(), angle);
 }
 
 void LineLabeller::process()
@@ -560,14 +741,16 @@ void LineLabeller::process()
   for(int polyseti = 0; polyseti < _polys.size(); ++polyseti)
     {
       const PolyVector& pv = _polys[polyseti];
+      const LengthsVector& lv = _lengths[polyseti];
       QSizeF size = _textsizes[polyseti];
 
       for(int polyi = 0; polyi < pv.size(); ++polyi)
         {
-          for(int posi = 0; posi < NUM_LABEL_POSITIONS; ++posi)
+          for(int posi = 0; posi < _positions.size(); ++posi)
             {
-              const RotatedRectangle r = 
-                findLinePosition(pv[polyi], label_positions[posi], size);
+              const RotatedRectangle r =
+                findLinePosition(pv[polyi], lv[polyi], _positions[posi],
+                                 size);
               if( ! r.isValid() )
                 break;
 
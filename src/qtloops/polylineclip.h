@@ -26,6 +26,8 @@
 #include <QPolygonF>
 #include <QList>
 #include <QSizeF>
+#include <QVector>
+#include <QHash>
 
 // clip a line made up of the points given, returning true
 // if is in region or false if not
@@ -71,6 +73,8 @@ struct RotatedRectangle
   void translate(double dx, double dy) { cx+=dx; cy+=dy; }
 
   QPolygonF makePolygon() const;
+  // write clockwise corners to pts, as for makePolygon
+  void makeCorners(QPointF pts[4]) const;
 
   double cx, cy, xw, yw, angle;
 };
@@ -87,36 +91,73 @@ public:
 
   void addLine(const QPolygonF& poly, QSizeF textsize);
 
+  // set fractions along each line where labels are tried, in order
+  // (default 0.5, 1/3, 2/3, 0.4, 0.6, 0.25, 0.75)
+  void setLabelPositions(const QVector<double>& positions);
+
   void process();
 
   int getNumPolySets() const { return _polys.size(); };
   QList<QPolygonF> getPolySet(int i) const;
 
 private:
-  RotatedRectangle findLinePosition(const QPolygonF& poly, double frac,
-                                    QSizeF size);
+  RotatedRectangle findLinePosition(const QPolygonF& poly,
+                                    const QVector<double>& lengths,
+                                    double frac, QSizeF size);
 
 private:
   QRectF _cliprect;
   bool _rotatelabels;
 
   QList<QList<QPolygonF>> _polys;
+  // cumulative lengths along each polyline in _polys
+  QList<QList<QVector<double>>> _lengths;
   QList<QSizeF> _textsizes;
+  QVector<double> _positions;
 };
 
+// Tests whether rectangles overlap any of those added previously.
+// The bounding boxes of the added rectangles are binned on a uniform
+// grid, sized by the first rectangle, so each test only looks at
+// nearby rectangles.
 class RectangleOverlapTester
 {
 public:
   RectangleOverlapTester();
   bool willOverlap(const RotatedRectangle& rect) const;
-  void addRect(const RotatedRectangle& rect) { _rects.append(rect); };
-  void reset() { _rects.clear(); };
+  void addRect(const RotatedRectangle& rect);
+  void reset();
 
   // debug by drawing all the rectangles
   void debug(QPainter& painter) const;
 
 private:
-  QList<RotatedRectangle> _rects;
+  struct Entry
+  {
+    QPointF corners[4];
+    double minx, miny, maxx, maxy;
+  };
+
+  static Entry makeEntry(const RotatedRectangle& rect);
+  // find range of grid cells covered by entry, returning false if
+  // too many or the entry is not finite
+  bool cellRange(const Entry& e, int& x0, int& y0, int& x1, int& y1) const;
+  static quint64 cellKey(int x, int y)
+  {
+    return (quint64(quint32(x)) << 32) | quint32(y);
+  }
+
+private:
+  QVector<Entry> _entries;
+  // entries in each grid cell
+  QHash<quint64, QVector<int>> _grid;
+  // entries not placed in the grid
+  QVector<int> _ungridded;
+  double _cellsize;
+
+  // last query each entry was tested against, to avoid repeats
+  mutable QVector<unsigned> _visited;
+  mutable unsigned _query;
 };
 
 #endif
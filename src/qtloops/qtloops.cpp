@@ -17,11 +17,13 @@
 /////////////////////////////////////////////////////////////////////////////
 
 #include <algorithm>
+#include <vector>
 
 #include "qtloops.h"
 #include "isnan.h"
 #include "polylineclip.h"
 #include "polygonclip.h"
+#include "polygonbool.h"
 
 #include <QBrush>
 #include <QColor>
@@ -87,6 +89,141 @@ void addNumpyToPolygonF(QPolygonF& poly, const Tuple2Ptrs& d)
     }
 }
 
+void addTransformedToPolygonF(QPolygonF& poly,
+			      const Numpy1DObj& x, const Numpy1DObj& y,
+			      const AxisTransform& xtrans,
+			      const AxisTransform& ytrans)
+{
+  static_assert(sizeof(QPointF) == 2*sizeof(double),
+		"QPointF must hold two doubles");
+
+  const int n = std::min(x.dim, y.dim);
+  const int start = poly.size();
+  poly.resize(start+n);
+  QPointF* pts = poly.data();
+
+  // convert each column straight into the coordinates of the points
+  double* out = reinterpret_cast<double*>(pts+start);
+  xtrans.convertToPoints(x.data, out, n);
+  ytrans.convertToPoints(y.data, out+1, n);
+
+  // remove close points in place
+  QPointF lastpt(-1e6, -1e6);
+  int end = start;
+  for(int i = start; i < start+n; ++i)
+    if( ! smallDelta(pts[i], lastpt) )
+      {
+	lastpt = pts[i];
+	pts[end++] = lastpt;
+      }
+  poly.resize(end);
+}
+
+namespace
+{
+  // convert line between rows start and end of xy to plotter
+  // coordinates, skipping non-finite points and points too close to
+  // the last one (as addNumpyToPolygonF). The coordinates are
+  // converted a column at a time into buf, so the type of transform
+  // is only looked at once per line.
+  QPolygonF flatLineToPolygon(const Numpy2DObj& xy, int start, int end,
+			      const AxisTransform& xtrans,
+			      const AxisTransform& ytrans,
+			      std::vector<double>& buf)
+  {
+    const int n = end-start;
+    buf.resize(2*n);
+    double* px = buf.data();
+    double* py = buf.data()+n;
+    const double* in = xy.data+2*start;
+    for(int i = 0; i < n; ++i)
+      {
+	px[i] = in[2*i];
+	py[i] = in[2*i+1];
+      }
+    xtrans.convertArray(px, px, n);
+    ytrans.convertArray(py, py, n);
+
+    QPolygonF poly;
+    poly.reserve(n);
+    QPointF lastpt(-1e6, -1e6);
+    for(int i = 0; i < n; ++i)
+      {
+	// finiteness of the data, as log conversion clips infinities
+	if( isFinite(in[2*i]) && isFinite(in[2*i+1]) )
+	  {
+	    const QPointF pt(px[i], py[i]);
+	    if( ! smallDelta(pt, lastpt) )
+	      {
+		poly << pt;
+		lastpt = pt;
+	      }
+	  }
+      }
+    return poly;
+  }
+
+  // check flat contour arrays, throwing an error if invalid
+  void checkFlatContours(const Numpy2DObj& xy, const Numpy1DObj& offsets)
+  {
+    if( xy.dims[1] != 2 )
+      throw "xy must be an (N,2) array";
+    for(int i = 0; i < offsets.dim; ++i)
+      {
+	if( offsets(i) < 0 || offsets(i) > xy.dims[0] ||
+	    (i > 0 && offsets(i) < offsets(i-1)) )
+	  throw "Invalid contour offsets";
+      }
+  }
+}
+
+int addContoursToLabeller(LineLabeller& labeller,
+			  const Numpy2DObj& xy, const Numpy1DObj& offsets,
+			  const AxisTransform& xtrans,
+			  const AxisTransform& ytrans,
+			  QSizeF textsize)
+{
+  checkFlatContours(xy, offsets);
+
+  std::vector<double> buf;
+  int nlines = 0;
+  for(int i = 0; i+1 < offsets.dim; ++i)
+    {
+      labeller.addLine(flatLineToPolygon(xy, int(offsets(i)),
+					 int(offsets(i+1)),
+					 xtrans, ytrans, buf),
+		       textsize);
+      ++nlines;
+    }
+  return nlines;
+}
+
+void addContoursToPath(QPainterPath& path,
+		       const Numpy2DObj& xy, const Numpy1DObj& offsets,
+		       const AxisTransform& xtrans,
+		       const AxisTransform& ytrans,
+		       const QRectF* clip)
+{
+  checkFlatContours(xy, offsets);
+
+  std::vector<double> buf;
+  QList<QPolygonF> polys;
+  for(int i = 0; i+1 < offsets.dim; ++i)
+    polys << flatLineToPolygon(xy, int(offsets(i)), int(offsets(i+1)),
+			       xtrans, ytrans, buf);
+
+  // clip the concave contour polygons together, without the
+  // connecting edges rectangle clipping would add
+  if( clip != 0 )
+    polys = polygonIntersection(polys, QList<QPolygonF>() << QPolygonF(*clip));
+
+  for(const auto& poly : polys)
+    {
+      path.addPolygon(poly);
+      path.closeSubpath();
+    }
+}
+
 void addNumpyPolygonToPath(QPainterPath &path, const Tuple2Ptrs& d,
 			   const QRectF* clip)
 {
@@ -22,6 +22,8 @@
 /////////////////////////////////////////////////////////////////////////////
 
 #include "qtloops_helpers.h"
+#include "axistransform.h"
+#include "polylineclip.h"
 
 #include <QPolygonF>
 #include <QPainter>
@@ -42,6 +44,33 @@ void addNumpyToPolygonF(QPolygonF& poly,
 void addNumpyPolygonToPath(QPainterPath &path, const Tuple2Ptrs& d,
 			   const QRectF* clip = 0);
 
+// convert points x and y to plotter coordinates using xtrans and
+// ytrans, writing them straight into poly. Close points are removed,
+// as addNumpyToPolygonF.
+void addTransformedToPolygonF(QPolygonF& poly,
+			      const Numpy1DObj& x, const Numpy1DObj& y,
+			      const AxisTransform& xtrans,
+			      const AxisTransform& ytrans);
+
+// Contour lines or polygons are given as an (N,2) array of points,
+// xy, where line i is rows offsets[i] to offsets[i+1]. These are
+// converted to plotter coordinates using xtrans and ytrans, skipping
+// non-finite points.
+
+// add contour lines to labeller, returning number of lines added
+int addContoursToLabeller(LineLabeller& labeller,
+			  const Numpy2DObj& xy, const Numpy1DObj& offsets,
+			  const AxisTransform& xtrans,
+			  const AxisTransform& ytrans,
+			  QSizeF textsize);
+
+// add contour polygons to path, clipping if clip is set
+void addContoursToPath(QPainterPath& path,
+		       const Numpy2DObj& xy, const Numpy1DObj& offsets,
+		       const AxisTransform& xtrans,
+		       const AxisTransform& ytrans,
+		       const QRectF* clip = 0);
+
 // Scale path by scale given. Puts output in out.
 QPainterPath scalePath(const QPainterPath& path, qreal scale);
 
@@ -161,3 +161,15 @@ PyObject* doubleArrayToNumpy(const double* d, int len)
 
   return n;
 }
+
+PyObject* newDoubleNumpy(int len, double** data)
+{
+  npy_intp dims[1];
+  dims[0] = len;
+  PyObject* n = PyArray_SimpleNew(1, dims, NPY_DOUBLE);
+  if( n == 0 )
+    throw "Could not allocate array";
+
+  *data = (double*)PyArray_DATA((PyArrayObject*)(n));
+  return n;
+}
@@ -111,4 +111,8 @@ class Numpy2DIntObj
 
 PyObject* doubleArrayToNumpy(const double* d, int len);
 
+// make a new uninitialised 1D double numpy array, setting data to
+// point to its contents
+PyObject* newDoubleNumpy(int len, double** data);
+
 #endif
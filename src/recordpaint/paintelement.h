@@ -19,13 +19,80 @@
 #ifndef PAINTELEMENT_H
 #define PAINTELEMENT_H
 
+#include <QtGlobal>
+#include <QTransform>
+
 class QPainter;
-class QTransform;
+class RecordWriter;
+
+// identifiers for each type of element
+// these are written to saved recordings, so do not renumber
+enum PaintElementType {
+  PE_ELLIPSE, PE_ELLIPSEF, PE_IMAGE, PE_LINES, PE_LINESF, PE_PATH,
+  PE_PIXMAP, PE_POINTS, PE_POINTSF, PE_POLYGON, PE_POLYGONF,
+  PE_RECTS, PE_RECTSF, PE_TEXT, PE_TILEDPIXMAP,
+  PE_BACKGROUNDBRUSH, PE_BACKGROUNDMODE, PE_BRUSH, PE_BRUSHORIGIN,
+  PE_CLIPREGION, PE_CLIPPATH, PE_COMPOSITION, PE_FONT, PE_TRANSFORM,
+  PE_CLIPENABLED, PE_PEN, PE_HINTS,
+  PE_NUMTYPES
+};
+
+// state tracked by RecordPaintDevice::optimise()
+struct OptimiseState
+{
+  OptimiseState() : opaquepen(true), opaquebrush(true), sourceover(true) {}
+
+  // whether the pen and brush are opaque (or not used), so that
+  // overlapping primitives look the same drawn in one call
+  bool opaquepen, opaquebrush;
+  // whether the composition mode is the default
+  bool sourceover;
+};
+
+// state of one playback by RecordPaintDevice::play(), kept apart
+// from the recording so that it can be played more than once at the
+// same time
+struct PaintPlayState
+{
+  PaintPlayState(const QTransform& _origtransform)
+    : origtransform(_origtransform),
+      pen(-1), brush(-1), background(-1), font(-1)
+  {}
+
+  // world transform of the painter when playback started
+  QTransform origtransform;
+  // indices (in PaintStateTable) of the state last set on the
+  // painter, so that setting the same state again can be skipped
+  int pen, brush, background, font;
+};
 
 class PaintElement {
 public:
   virtual ~PaintElement() {};
-  virtual void paint(QPainter& painter, const QTransform& origtransform) = 0;
+  virtual void paint(QPainter& painter, PaintPlayState& play) = 0;
+
+  // type of element (PaintElementType)
+  virtual int type() const = 0;
+
+  // write contents of element (not type) to output
+  virtual void write(RecordWriter& out) const = 0;
+
+  // estimate of memory held by element in bytes
+  // (implicitly shared data such as images are counted in full)
+  virtual qint64 memoryUsage() const = 0;
+
+  // support for RecordPaintDevice::optimise()
+
+  // merge the next element into this one if possible, returning
+  // whether this was done
+  virtual bool merge(const PaintElement*, const OptimiseState&)
+  {
+    return false;
+  }
+  // for state elements, whether other sets the same state
+  virtual bool sameState(const PaintElement*) const { return false; }
+  // update tracked state for this element
+  virtual void trackState(OptimiseState&) const {}
 };
 
 #endif
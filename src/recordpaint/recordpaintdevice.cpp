@@ -17,15 +17,25 @@
 /////////////////////////////////////////////////////////////////////////////
 
 #include <QtAlgorithms>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutexLocker>
 #include <limits>
 #include "recordpaintdevice.h"
 #include "recordpaintengine.h"
+#include "recordstream.h"
 
 #define INCH_MM 25.4
 
+// identify saved recordings ("VZRP") and their format version
+#define RECORD_MAGIC 0x565a5250
+#define RECORD_VERSION 1
+
 RecordPaintDevice::RecordPaintDevice(int width, int height,
 				     int dpix, int dpiy)
   :_width(width), _height(height), _dpix(dpix), _dpiy(dpiy),
+   _simplifytol(0),
    _engine(new RecordPaintEngine)
 {
 }
@@ -72,9 +82,207 @@ int RecordPaintDevice::metric(QPaintDevice::PaintDeviceMetric metric) const
 
 void RecordPaintDevice::play(QPainter& painter)
 {
-  QTransform origtransform(painter.worldTransform());
+  QElapsedTimer timer;
+  timer.start();
+
+  PaintPlayState play(painter.worldTransform());
+  foreach(PaintElement* el, _elements)
+    {
+      el->paint(painter, play);
+    }
+
+  const int target = painter.paintEngine() != 0 ?
+    int(painter.paintEngine()->type()) : -1;
+  QMutexLocker locker(&_playmutex);
+  _playtime[target] += timer.nsecsElapsed();
+  _playcount[target] += 1;
+}
+
+QList<int> RecordPaintDevice::elementTypeCounts() const
+{
+  QList<int> counts;
+  for(int i=0; i<PE_NUMTYPES; ++i)
+    counts << 0;
+  foreach(const PaintElement* el, _elements)
+    counts[el->type()] += 1;
+  return counts;
+}
+
+QStringList RecordPaintDevice::elementTypeNames()
+{
+  // in the order of PaintElementType
+  static const char* names[PE_NUMTYPES] = {
+    "ellipse", "ellipsef", "image", "lines", "linesf", "path",
+    "pixmap", "points", "pointsf", "polygon", "polygonf",
+    "rects", "rectsf", "text", "tiledpixmap",
+    "backgroundbrush", "backgroundmode", "brush", "brushorigin",
+    "clipregion", "clippath", "composition", "font", "transform",
+    "clipenabled", "pen", "hints"
+  };
+
+  QStringList out;
+  for(int i=0; i<PE_NUMTYPES; ++i)
+    out << QString(names[i]);
+  return out;
+}
+
+qint64 RecordPaintDevice::memoryUsage() const
+{
+  qint64 total = sizeof(*this) +
+    qint64(_elements.size()) * sizeof(PaintElement*);
+  foreach(const PaintElement* el, _elements)
+    total += el->memoryUsage();
+
+  // interned states
+  total += qint64(_states.pens.size()) * sizeof(QPen) +
+    qint64(_states.brushes.size()) * sizeof(QBrush) +
+    qint64(_states.fonts.size()) * sizeof(QFont);
+
+  return total;
+}
+
+double RecordPaintDevice::playTime(int target) const
+{
+  QMutexLocker locker(&_playmutex);
+  if( target != -1 )
+    return _playtime.value(target, 0) * 1e-9;
+
+  qint64 total = 0;
+  foreach(qint64 t, _playtime.values())
+    total += t;
+  return total * 1e-9;
+}
+
+int RecordPaintDevice::playCount() const
+{
+  QMutexLocker locker(&_playmutex);
+  int total = 0;
+  foreach(int c, _playcount.values())
+    total += c;
+  return total;
+}
+
+QList<int> RecordPaintDevice::playTargets() const
+{
+  QMutexLocker locker(&_playmutex);
+  return _playtime.keys();
+}
+
+void RecordPaintDevice::optimise()
+{
+  OptimiseState state;
+
+  // latest element of each type in the output
+  const PaintElement* current[PE_NUMTYPES];
+  for(int i=0; i<PE_NUMTYPES; ++i)
+    current[i] = 0;
+
+  QList<PaintElement*> out;
+  out.reserve(_elements.size());
+
   foreach(PaintElement* el, _elements)
     {
-      el->paint(painter, origtransform);
+      const int type = el->type();
+
+      // drop state changes to the current value
+      if( current[type] != 0 && el->sameState(current[type]) )
+	{
+	  delete el;
+	  continue;
+	}
+
+      // merge into the previous element, if it is compatible and
+      // nothing comes in between
+      if( ! out.isEmpty() && out.last()->merge(el, state) )
+	{
+	  delete el;
+	  el = out.last();
+	}
+      else
+	out.append(el);
+
+      el->trackState(state);
+      current[type] = el;
+    }
+
+  _elements = out;
+}
+
+// File format (QDataStream, Qt 5.6 encoding):
+//  magic, version, width, height, dpix, dpiy, draw item count,
+//  number of elements, then for each element its type followed by
+//  the data written by PaintElement::write
+// Pens, brushes, images and pixmaps are stored once and referred to
+// by index afterwards (see recordstream.h)
+
+bool RecordPaintDevice::save(const QString& filename) const
+{
+  QFile file(filename);
+  if( ! file.open(QIODevice::WriteOnly) )
+    return false;
+
+  QDataStream stream(&file);
+  stream.setVersion(QDataStream::Qt_5_6);
+
+  stream << quint32(RECORD_MAGIC) << quint32(RECORD_VERSION)
+	 << qint32(_width) << qint32(_height)
+	 << qint32(_dpix) << qint32(_dpiy)
+	 << qint32(drawItemCount()) << qint32(_elements.size());
+
+  RecordWriter writer(stream);
+  foreach(const PaintElement* el, _elements)
+    {
+      stream << quint8(el->type());
+      el->write(writer);
     }
+
+  return stream.status() == QDataStream::Ok;
+}
+
+RecordPaintDevice* RecordPaintDevice::load(const QString& filename)
+{
+  QFile file(filename);
+  if( ! file.open(QIODevice::ReadOnly) )
+    return 0;
+
+  QDataStream stream(&file);
+  stream.setVersion(QDataStream::Qt_5_6);
+
+  quint32 magic, version;
+  stream >> magic >> version;
+  if( stream.status() != QDataStream::Ok ||
+      magic != RECORD_MAGIC || version != RECORD_VERSION )
+    return 0;
+
+  qint32 width, height, dpix, dpiy, itemcount, numelements;
+  stream >> width >> height >> dpix >> dpiy >> itemcount >> numelements;
+  if( stream.status() != QDataStream::Ok || numelements < 0 )
+    return 0;
+
+  RecordPaintDevice* dev = new RecordPaintDevice(width, height, dpix, dpiy);
+  dev->_engine->setDrawItemCount(itemcount);
+
+  RecordReader reader(stream, &dev->_states);
+  for(qint32 i = 0; i < numelements; ++i)
+    {
+      quint8 type;
+      stream >> type;
+      PaintElement* el = readPaintElement(reader, type);
+      if( el == 0 )
+	{
+	  stream.setStatus(QDataStream::ReadCorruptData);
+	  break;
+	}
+      dev->addElement(el);
+      if( stream.status() != QDataStream::Ok )
+	break;
+    }
+
+  if( stream.status() != QDataStream::Ok )
+    {
+      delete dev;
+      return 0;
+    }
+
+  return dev;
 }
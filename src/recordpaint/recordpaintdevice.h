@@ -21,8 +21,13 @@
 
 #include <QPaintDevice>
 #include <QList>
+#include <QMap>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
 #include "paintelement.h"
 #include "recordpaintengine.h"
+#include "statetable.h"
 
 class RecordPaintDevice : public QPaintDevice
 {
@@ -31,13 +36,49 @@ public:
   ~RecordPaintDevice();
   QPaintEngine* paintEngine() const;
 
-  // play back all 
+  // play back all (this may be called by several threads at once)
   void play(QPainter& painter);
 
+  // compact the recording, merging adjacent primitives of the same
+  // type and removing state changes which have no effect
+  void optimise();
+
   int metric(QPaintDevice::PaintDeviceMetric metric) const;
 
   int drawItemCount() const { return _engine->drawItemCount(); }
 
+  // save recording to a file, returning whether successful
+  bool save(const QString& filename) const;
+
+  // load a recording saved with save(), returning a new device
+  // or 0 if the file could not be read
+  static RecordPaintDevice* load(const QString& filename);
+
+  // if tolerance (device pixels) is greater than zero, simplify
+  // paths and polygons while recording, and drop those which lie
+  // outside the device
+  void setSimplifyTolerance(double tol) { _simplifytol = tol; }
+  double simplifyTolerance() const { return _simplifytol; }
+
+  // statistics
+
+  // number of recorded elements of each type, indexed by type
+  QList<int> elementTypeCounts() const;
+  // names of each type of element
+  static QStringList elementTypeNames();
+  // estimate of bytes held by the recording
+  qint64 memoryUsage() const;
+  // number of painter state changes while recording
+  int stateChangeCount() const { return _engine->stateChangeCount(); }
+
+  // total time in seconds spent in play() for the paint engine type
+  // given, or all targets if -1
+  double playTime(int target=-1) const;
+  // number of calls to play()
+  int playCount() const;
+  // paint engine types played to
+  QList<int> playTargets() const;
+
 public:
   friend class RecordPaintEngine;
 
@@ -50,8 +91,16 @@ private:
 
 private:
   int _width, _height, _dpix, _dpiy;
+  double _simplifytol;
   RecordPaintEngine* _engine;
   QList<PaintElement*> _elements;
+  PaintStateTable _states;
+
+  // nanoseconds spent playing and number of plays, for each type
+  // of paint engine (guarded by _playmutex)
+  QMap<int, qint64> _playtime;
+  QMap<int, int> _playcount;
+  mutable QMutex _playmutex;
 };
 
 #endif
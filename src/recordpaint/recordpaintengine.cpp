@@ -16,6 +16,7 @@
 //    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 /////////////////////////////////////////////////////////////////////////////
 
+#include <cmath>
 #include <QPainter>
 #include <QImage>
 #include <QRectF>
@@ -26,30 +27,70 @@
 #include "paintelement.h"
 #include "recordpaintengine.h"
 #include "recordpaintdevice.h"
+#include "recordstream.h"
+#include "statetable.h"
 
 namespace {
 
+  //////////////////////////////////////////////////////////////
+  // Hashes for interning state
+  // equal values must give equal hashes
+
+  uint penHash(const QPen& pen)
+  {
+    return qHash(pen.color().rgba()) ^ (qHash(pen.widthF()) * 31) ^
+      (uint(pen.style()) << 4) ^ (uint(pen.capStyle()) << 8) ^
+      (uint(pen.joinStyle()) << 12) ^ (uint(pen.brush().style()) << 20);
+  }
+
+  uint brushHash(const QBrush& brush)
+  {
+    return qHash(brush.color().rgba()) ^ (uint(brush.style()) << 24);
+  }
+
+  uint fontHash(const QFont& font)
+  {
+    return qHash(font.key());
+  }
+
+  // approximate size of pixmap data
+  qint64 pixmapBytes(const QPixmap& pm)
+  {
+    return qint64(pm.width()) * pm.height() * pm.depth() / 8;
+  }
+
   //////////////////////////////////////////////////////////////
   // Drawing Elements
   // these are defined for each type of painting 
   // the QPaintEngine does
 
   // draw an ellipse (QRect and QRectF)
-  template <class T>
+  template <class T, int TYPE>
   class ellipseElement : public PaintElement {
   public:
     ellipseElement(const T &rect) : _ellipse(rect) {}
+    ellipseElement(RecordReader& in)
+    {
+      in.stream() >> _ellipse;
+    }
 
-    void paint(QPainter& painter, const QTransform&)
+    void paint(QPainter& painter, PaintPlayState&)
     {
       painter.drawEllipse(_ellipse);
     }
 
+    int type() const { return TYPE; }
+    qint64 memoryUsage() const { return sizeof(*this); }
+    void write(RecordWriter& out) const
+    {
+      out.stream() << _ellipse;
+    }
+
   private:
     T _ellipse;
   };
-  typedef ellipseElement<QRect> EllipseElement;
-  typedef ellipseElement<QRectF> EllipseFElement;
+  typedef ellipseElement<QRect, PE_ELLIPSE> EllipseElement;
+  typedef ellipseElement<QRectF, PE_ELLIPSEF> EllipseFElement;
 
   // draw QImage
   class ImageElement : public PaintElement {
@@ -58,12 +99,30 @@ namespace {
 		 const QRectF& sr, Qt::ImageConversionFlags flags)
       : _image(image), _rect(rect), _sr(sr), _flags(flags)
     {}
+    ImageElement(RecordReader& in)
+    {
+      qint32 flags;
+      _image = in.readImage();
+      in.stream() >> _rect >> _sr >> flags;
+      _flags = Qt::ImageConversionFlags(QFlag(flags));
+    }
 
-    void paint(QPainter& painter, const QTransform&)
+    void paint(QPainter& painter, PaintPlayState&)
     {
       painter.drawImage(_rect, _image, _sr, _flags);
     }
 
+    int type() const { return PE_IMAGE; }
+    qint64 memoryUsage() const
+    {
+      return sizeof(*this) + _image.sizeInBytes();
+    }
+    void write(RecordWriter& out) const
+    {
+      out.writeImage(_image);
+      out.stream() << _rect << _sr << qint32(_flags);
+    }
+
   private:
     QImage _image;
     QRectF _rect, _sr;
@@ -72,7 +131,7 @@ namespace {
 
   // draw lines
   // this is for painting QLine and QLineF
-  template <class T>
+  template <class T, int TYPE>
   class lineElement : public PaintElement {
   public:
     lineElement(const T *lines, int linecount)
@@ -80,30 +139,67 @@ namespace {
       for(int i = 0; i < linecount; i++)
 	_lines << lines[i];
     }
+    lineElement(RecordReader& in)
+    {
+      in.stream() >> _lines;
+    }
 
-    void paint(QPainter& painter, const QTransform&)
+    void paint(QPainter& painter, PaintPlayState&)
     {
       painter.drawLines(_lines);
     }
 
+    int type() const { return TYPE; }
+    qint64 memoryUsage() const
+    {
+      return sizeof(*this) + qint64(_lines.size()) * sizeof(T);
+    }
+    void write(RecordWriter& out) const
+    {
+      out.stream() << _lines;
+    }
+
+    bool merge(const PaintElement* next, const OptimiseState& state)
+    {
+      if( next->type() != TYPE || !state.opaquepen || !state.sourceover )
+	return false;
+      _lines += static_cast<const lineElement*>(next)->_lines;
+      return true;
+    }
+
   private:
     QList<T> _lines;
   };
   // specific Line and LineF variants
-  typedef lineElement<QLine> LineElement;
-  typedef lineElement<QLineF> LineFElement;
+  typedef lineElement<QLine, PE_LINES> LineElement;
+  typedef lineElement<QLineF, PE_LINESF> LineFElement;
 
   // draw QPainterPath
   class PathElement : public PaintElement {
   public:
     PathElement(const QPainterPath& path)
       : _path(path) {}
+    PathElement(RecordReader& in)
+    {
+      in.stream() >> _path;
+    }
 
-    void paint(QPainter& painter, const QTransform&)
+    void paint(QPainter& painter, PaintPlayState&)
     {
       painter.drawPath(_path);
     }
 
+    int type() const { return PE_PATH; }
+    qint64 memoryUsage() const
+    {
+      return sizeof(*this) +
+	qint64(_path.elementCount()) * sizeof(QPainterPath::Element);
+    }
+    void write(RecordWriter& out) const
+    {
+      out.stream() << _path;
+    }
+
   private:
     QPainterPath _path;
   };
@@ -114,12 +210,30 @@ namespace {
     PixmapElement(const QRectF& r, const QPixmap& pm,
 		  const QRectF& sr) :
       _r(r), _pm(pm), _sr(sr) {}
+    PixmapElement(RecordReader& in)
+    {
+      in.stream() >> _r;
+      _pm = in.readPixmap();
+      in.stream() >> _sr;
+    }
 
-    void paint(QPainter& painter, const QTransform&)
+    void paint(QPainter& painter, PaintPlayState&)
     {
       painter.drawPixmap(_r, _pm, _sr);
     }
 
+    int type() const { return PE_PIXMAP; }
+    qint64 memoryUsage() const
+    {
+      return sizeof(*this) + pixmapBytes(_pm);
+    }
+    void write(RecordWriter& out) const
+    {
+      out.stream() << _r;
+      out.writePixmap(_pm);
+      out.stream() << _sr;
+    }
+
   private:
     QRectF _r;
     QPixmap _pm;
@@ -127,39 +241,73 @@ namespace {
   };
 
   // draw points (QPoint and QPointF)
-  template <class T, class V>
+  template <class T, class V, int TYPE>
   class pointElement : public PaintElement {
   public:
     pointElement(const T* points, int pointcount)
     {
+      _pts.reserve(pointcount);
       for(int i=0; i<pointcount; ++i)
 	_pts << points[i];
     }
+    pointElement(RecordReader& in)
+    {
+      in.stream() >> _pts;
+    }
 
-    void paint(QPainter& painter, const QTransform&)
+    void paint(QPainter& painter, PaintPlayState&)
     {
       painter.drawPoints(_pts);
     }
 
+    int type() const { return TYPE; }
+    qint64 memoryUsage() const
+    {
+      return sizeof(*this) + qint64(_pts.size()) * sizeof(T);
+    }
+    void write(RecordWriter& out) const
+    {
+      out.stream() << _pts;
+    }
+
+    bool merge(const PaintElement* next, const OptimiseState& state)
+    {
+      if( next->type() != TYPE || !state.opaquepen || !state.sourceover )
+	return false;
+      _pts += static_cast<const pointElement*>(next)->_pts;
+      return true;
+    }
+
   private:
     V _pts;
   };
-  typedef pointElement<QPoint, QPolygon> PointElement;
-  typedef pointElement<QPointF, QPolygonF> PointFElement;
+  typedef pointElement<QPoint, QPolygon, PE_POINTS> PointElement;
+  typedef pointElement<QPointF, QPolygonF, PE_POINTSF> PointFElement;
 
   // for QPolygon and QPolygonF
-  template <class T, class V>
+  template <class T, class V, int TYPE>
   class polyElement: public PaintElement {
   public:
     polyElement(const T* points, int pointcount,
 		QPaintEngine::PolygonDrawMode mode)
       : _mode(mode)
     {
+      _pts.reserve(pointcount);
       for(int i=0; i<pointcount; ++i)
 	_pts << points[i];
     }
+    polyElement(const V& pts, QPaintEngine::PolygonDrawMode mode)
+      : _mode(mode), _pts(pts)
+    {
+    }
+    polyElement(RecordReader& in)
+    {
+      qint32 mode;
+      in.stream() >> mode >> _pts;
+      _mode = QPaintEngine::PolygonDrawMode(mode);
+    }
 
-    void paint(QPainter& painter, const QTransform&)
+    void paint(QPainter& painter, PaintPlayState&)
     {
       switch(_mode)
 	{
@@ -178,15 +326,25 @@ namespace {
 	}
     }
 
+    int type() const { return TYPE; }
+    qint64 memoryUsage() const
+    {
+      return sizeof(*this) + qint64(_pts.size()) * sizeof(T);
+    }
+    void write(RecordWriter& out) const
+    {
+      out.stream() << qint32(_mode) << _pts;
+    }
+
   private:
     QPaintEngine::PolygonDrawMode _mode;
     V _pts;
   };
-  typedef polyElement<QPoint,QPolygon> PolygonElement;
-  typedef polyElement<QPointF,QPolygonF> PolygonFElement;
+  typedef polyElement<QPoint,QPolygon,PE_POLYGON> PolygonElement;
+  typedef polyElement<QPointF,QPolygonF,PE_POLYGONF> PolygonFElement;
 
   // for QRect and QRectF
-  template <class T>
+  template <class T, int TYPE>
   class rectElement : public PaintElement {
   public:
     rectElement(const T* rects, int rectcount)
@@ -194,17 +352,40 @@ namespace {
       for(int i=0; i<rectcount; i++)
 	_rects << rects[i];
     }
+    rectElement(RecordReader& in)
+    {
+      in.stream() >> _rects;
+    }
 
-    void paint(QPainter& painter, const QTransform&)
+    void paint(QPainter& painter, PaintPlayState&)
     {
       painter.drawRects(_rects);
     }
 
+    int type() const { return TYPE; }
+    qint64 memoryUsage() const
+    {
+      return sizeof(*this) + qint64(_rects.size()) * sizeof(T);
+    }
+    void write(RecordWriter& out) const
+    {
+      out.stream() << _rects;
+    }
+
+    bool merge(const PaintElement* next, const OptimiseState& state)
+    {
+      if( next->type() != TYPE || !state.opaquepen || !state.opaquebrush ||
+	  !state.sourceover )
+	return false;
+      _rects += static_cast<const rectElement*>(next)->_rects;
+      return true;
+    }
+
   private:
     QList<T> _rects;
   };
-  typedef rectElement<QRect> RectElement;
-  typedef rectElement<QRectF> RectFElement;
+  typedef rectElement<QRect, PE_RECTS> RectElement;
+  typedef rectElement<QRectF, PE_RECTSF> RectFElement;
 
   // draw Text
   class TextElement : public PaintElement {
@@ -212,12 +393,26 @@ namespace {
     TextElement(const QPointF& pt, const QTextItem& txt)
       : _pt(pt), _text(txt.text())
     {}
+    TextElement(RecordReader& in)
+    {
+      in.stream() >> _pt >> _text;
+    }
 
-    void paint(QPainter& painter, const QTransform&)
+    void paint(QPainter& painter, PaintPlayState&)
     {
       painter.drawText(_pt, _text);
     }
 
+    int type() const { return PE_TEXT; }
+    qint64 memoryUsage() const
+    {
+      return sizeof(*this) + qint64(_text.size()) * sizeof(QChar);
+    }
+    void write(RecordWriter& out) const
+    {
+      out.stream() << _pt << _text;
+    }
+
   private:
     QPointF _pt;
     QString _text;
@@ -229,12 +424,30 @@ namespace {
 		       const QPointF& pt)
       : _rect(rect), _pixmap(pixmap), _pt(pt)
     {}
+    TiledPixmapElement(RecordReader& in)
+    {
+      in.stream() >> _rect;
+      _pixmap = in.readPixmap();
+      in.stream() >> _pt;
+    }
 
-    void paint(QPainter& painter, const QTransform&)
+    void paint(QPainter& painter, PaintPlayState&)
     {
       painter.drawTiledPixmap(_rect, _pixmap, _pt);
     }
 
+    int type() const { return PE_TILEDPIXMAP; }
+    qint64 memoryUsage() const
+    {
+      return sizeof(*this) + pixmapBytes(_pixmap);
+    }
+    void write(RecordWriter& out) const
+    {
+      out.stream() << _rect;
+      out.writePixmap(_pixmap);
+      out.stream() << _pt;
+    }
+
   private:
     QRectF _rect;
     QPixmap _pixmap;
@@ -246,19 +459,52 @@ namespace {
 
   // these define and change the state of the painter
 
+  // pens, brushes and fonts are stored in the state table of the
+  // device, and the elements hold their index in the table
+
   class BackgroundBrushElement : public PaintElement {
   public:
-    BackgroundBrushElement(const QBrush& brush)
-      : _brush(brush)
+    BackgroundBrushElement(PaintStateTable* states, int idx)
+      : _states(states), _idx(idx)
     {}
+    BackgroundBrushElement(RecordReader& in)
+      : _states(in.states())
+    {
+      const QBrush brush(in.readBrush());
+      _idx = _states->brushes.intern(brush, brushHash(brush));
+    }
+
+    void paint(QPainter& painter, PaintPlayState& play)
+    {
+      if( play.background != _idx )
+	{
+	  painter.setBackground(_states->brushes[_idx]);
+	  play.background = _idx;
+	}
+    }
 
-    void paint(QPainter& painter, const QTransform&)
+    int type() const { return PE_BACKGROUNDBRUSH; }
+    qint64 memoryUsage() const { return sizeof(*this); }
+    void write(RecordWriter& out) const
+    {
+      out.writeBrush(_states->brushes[_idx]);
+    }
+
+    bool merge(const PaintElement* next, const OptimiseState&)
+    {
+      if( next->type() != PE_BACKGROUNDBRUSH )
+	return false;
+      _idx = static_cast<const BackgroundBrushElement*>(next)->_idx;
+      return true;
+    }
+    bool sameState(const PaintElement* other) const
     {
-      painter.setBackground(_brush);
+      return static_cast<const BackgroundBrushElement*>(other)->_idx == _idx;
     }
 
   private:
-    QBrush _brush;
+    PaintStateTable* _states;
+    int _idx;
   };
 
   class BackgroundModeElement : public PaintElement {
@@ -266,29 +512,78 @@ namespace {
     BackgroundModeElement(Qt::BGMode mode)
       : _mode(mode)
     {}
+    BackgroundModeElement(RecordReader& in)
+    {
+      qint32 mode;
+      in.stream() >> mode;
+      _mode = Qt::BGMode(mode);
+    }
 
-    void paint(QPainter& painter, const QTransform&)
+    void paint(QPainter& painter, PaintPlayState&)
     {
       painter.setBackgroundMode(_mode);
     }
 
+    int type() const { return PE_BACKGROUNDMODE; }
+    qint64 memoryUsage() const { return sizeof(*this); }
+    void write(RecordWriter& out) const
+    {
+      out.stream() << qint32(_mode);
+    }
+
   private:
     Qt::BGMode _mode;
   };
 
   class BrushElement : public PaintElement {
   public:
-    BrushElement(const QBrush& brush)
-      : _brush(brush)
+    BrushElement(PaintStateTable* states, int idx)
+      : _states(states), _idx(idx)
     {}
+    BrushElement(RecordReader& in)
+      : _states(in.states())
+    {
+      const QBrush brush(in.readBrush());
+      _idx = _states->brushes.intern(brush, brushHash(brush));
+    }
 
-    void paint(QPainter& painter, const QTransform&)
+    void paint(QPainter& painter, PaintPlayState& play)
     {
-      painter.setBrush(_brush);
+      if( play.brush != _idx )
+	{
+	  painter.setBrush(_states->brushes[_idx]);
+	  play.brush = _idx;
+	}
+    }
+
+    int type() const { return PE_BRUSH; }
+    qint64 memoryUsage() const { return sizeof(*this); }
+    void write(RecordWriter& out) const
+    {
+      out.writeBrush(_states->brushes[_idx]);
+    }
+
+    bool merge(const PaintElement* next, const OptimiseState&)
+    {
+      if( next->type() != PE_BRUSH )
+	return false;
+      _idx = static_cast<const BrushElement*>(next)->_idx;
+      return true;
+    }
+    bool sameState(const PaintElement* other) const
+    {
+      return static_cast<const BrushElement*>(other)->_idx == _idx;
+    }
+
+    void trackState(OptimiseState& state) const
+    {
+      const QBrush& brush = _states->brushes[_idx];
+      state.opaquebrush = brush.style() == Qt::NoBrush || brush.isOpaque();
     }
 
   private:
-    QBrush _brush;
+    PaintStateTable* _states;
+    int _idx;
   };
 
   class BrushOriginElement : public PaintElement {
@@ -296,12 +591,35 @@ namespace {
     BrushOriginElement(const QPointF& origin)
       : _origin(origin)
     {}
+    BrushOriginElement(RecordReader& in)
+    {
+      in.stream() >> _origin;
+    }
 
-    void paint(QPainter& painter, const QTransform&)
+    void paint(QPainter& painter, PaintPlayState&)
     {
       painter.setBrushOrigin(_origin);
     }
 
+    int type() const { return PE_BRUSHORIGIN; }
+    qint64 memoryUsage() const { return sizeof(*this); }
+    void write(RecordWriter& out) const
+    {
+      out.stream() << _origin;
+    }
+
+    bool merge(const PaintElement* next, const OptimiseState&)
+    {
+      if( next->type() != PE_BRUSHORIGIN )
+	return false;
+      _origin = static_cast<const BrushOriginElement*>(next)->_origin;
+      return true;
+    }
+    bool sameState(const PaintElement* other) const
+    {
+      return static_cast<const BrushOriginElement*>(other)->_origin == _origin;
+    }
+
   private:
     QPointF _origin;
   };
@@ -312,12 +630,28 @@ namespace {
 		      const QRegion& region)
       : _op(op), _region(region)
     {}
+    ClipRegionElement(RecordReader& in)
+    {
+      qint32 op;
+      in.stream() >> op >> _region;
+      _op = Qt::ClipOperation(op);
+    }
 
-    void paint(QPainter& painter, const QTransform&)
+    void paint(QPainter& painter, PaintPlayState&)
     {
       painter.setClipRegion(_region, _op);
     }
 
+    int type() const { return PE_CLIPREGION; }
+    qint64 memoryUsage() const
+    {
+      return sizeof(*this) + qint64(_region.rectCount()) * sizeof(QRect);
+    }
+    void write(RecordWriter& out) const
+    {
+      out.stream() << qint32(_op) << _region;
+    }
+
   private:
     Qt::ClipOperation _op;
     QRegion _region;
@@ -329,12 +663,29 @@ namespace {
 		    const QPainterPath& region)
       : _op(op), _region(region)
     {}
+    ClipPathElement(RecordReader& in)
+    {
+      qint32 op;
+      in.stream() >> op >> _region;
+      _op = Qt::ClipOperation(op);
+    }
 
-    void paint(QPainter& painter, const QTransform&)
+    void paint(QPainter& painter, PaintPlayState&)
     {
       painter.setClipPath(_region, _op);
     }
 
+    int type() const { return PE_CLIPPATH; }
+    qint64 memoryUsage() const
+    {
+      return sizeof(*this) +
+	qint64(_region.elementCount()) * sizeof(QPainterPath::Element);
+    }
+    void write(RecordWriter& out) const
+    {
+      out.stream() << qint32(_op) << _region;
+    }
+
   private:
     Qt::ClipOperation _op;
     QPainterPath _region;
@@ -345,25 +696,56 @@ namespace {
     CompositionElement(QPainter::CompositionMode mode)
       : _mode(mode)
     {}
+    CompositionElement(RecordReader& in)
+    {
+      qint32 mode;
+      in.stream() >> mode;
+      _mode = QPainter::CompositionMode(mode);
+    }
 
-    void paint(QPainter& painter, const QTransform&)
+    void paint(QPainter& painter, PaintPlayState&)
     {
       painter.setCompositionMode(_mode);
     }
 
+    int type() const { return PE_COMPOSITION; }
+    qint64 memoryUsage() const { return sizeof(*this); }
+    void write(RecordWriter& out) const
+    {
+      out.stream() << qint32(_mode);
+    }
+
+    void trackState(OptimiseState& state) const
+    {
+      state.sourceover = _mode == QPainter::CompositionMode_SourceOver;
+    }
+
   private:
     QPainter::CompositionMode _mode;
   };
 
   class FontElement : public PaintElement {
   public:
-    FontElement(const QFont& font, int dpi)
-      : _dpi(dpi), _font(font)
+    FontElement(PaintStateTable* states, int idx, int dpi)
+      : _states(states), _idx(idx), _dpi(dpi)
     {}
+    FontElement(RecordReader& in)
+      : _states(in.states())
+    {
+      qint32 dpi;
+      QFont font;
+      in.stream() >> dpi >> font;
+      _dpi = dpi;
+      _idx = _states->fonts.intern(font, fontHash(font));
+    }
 
-    void paint(QPainter& painter, const QTransform&)
+    void paint(QPainter& painter, PaintPlayState& play)
     {
-      QFont tempfont(_font);
+      if( play.font == _idx )
+	return;
+      play.font = _idx;
+
+      QFont tempfont(_states->fonts[_idx]);
       if( tempfont.pointSizeF() > 0. )
 	{
 	  // scale font sizes in points using dpi ratio
@@ -375,9 +757,29 @@ namespace {
       painter.setFont(tempfont);
     }
 
+    int type() const { return PE_FONT; }
+    qint64 memoryUsage() const { return sizeof(*this); }
+    void write(RecordWriter& out) const
+    {
+      out.stream() << qint32(_dpi) << _states->fonts[_idx];
+    }
+
+    bool merge(const PaintElement* next, const OptimiseState&)
+    {
+      if( next->type() != PE_FONT )
+	return false;
+      _idx = static_cast<const FontElement*>(next)->_idx;
+      return true;
+    }
+    bool sameState(const PaintElement* other) const
+    {
+      return static_cast<const FontElement*>(other)->_idx == _idx;
+    }
+
   private:
+    PaintStateTable* _states;
+    int _idx;
     int _dpi;
-    QFont _font;
   };
 
   class TransformElement : public PaintElement {
@@ -385,13 +787,38 @@ namespace {
     TransformElement(const QTransform& t)
       : _t(t)
     {}
+    TransformElement(RecordReader& in)
+    {
+      in.stream() >> _t;
+    }
 
-    void paint(QPainter& painter, const QTransform& origtransform)
+    void paint(QPainter& painter, PaintPlayState& play)
     {
-      painter.setWorldTransform(origtransform);
+      painter.setWorldTransform(play.origtransform);
       painter.setWorldTransform(_t, true);
     }
 
+    int type() const { return PE_TRANSFORM; }
+    qint64 memoryUsage() const { return sizeof(*this); }
+    void write(RecordWriter& out) const
+    {
+      out.stream() << _t;
+    }
+
+    // transforms are set relative to the original transform, so a
+    // following transform replaces this one
+    bool merge(const PaintElement* next, const OptimiseState&)
+    {
+      if( next->type() != PE_TRANSFORM )
+	return false;
+      _t = static_cast<const TransformElement*>(next)->_t;
+      return true;
+    }
+    bool sameState(const PaintElement* other) const
+    {
+      return static_cast<const TransformElement*>(other)->_t == _t;
+    }
+
   private:
     QTransform _t;
   };
@@ -401,29 +828,76 @@ namespace {
     ClipEnabledElement(bool enabled)
       : _enabled(enabled)
     {}
+    ClipEnabledElement(RecordReader& in)
+    {
+      in.stream() >> _enabled;
+    }
 
-    void paint(QPainter& painter, const QTransform&)
+    void paint(QPainter& painter, PaintPlayState&)
     {
       painter.setClipping(_enabled);
     }
 
+    int type() const { return PE_CLIPENABLED; }
+    qint64 memoryUsage() const { return sizeof(*this); }
+    void write(RecordWriter& out) const
+    {
+      out.stream() << _enabled;
+    }
+
   private:
     bool _enabled;
   };
 
   class PenElement : public PaintElement {
   public:
-    PenElement(const QPen& pen)
-      : _pen(pen)
+    PenElement(PaintStateTable* states, int idx)
+      : _states(states), _idx(idx)
     {}
+    PenElement(RecordReader& in)
+      : _states(in.states())
+    {
+      const QPen pen(in.readPen());
+      _idx = _states->pens.intern(pen, penHash(pen));
+    }
+
+    void paint(QPainter& painter, PaintPlayState& play)
+    {
+      if( play.pen != _idx )
+	{
+	  painter.setPen(_states->pens[_idx]);
+	  play.pen = _idx;
+	}
+    }
+
+    int type() const { return PE_PEN; }
+    qint64 memoryUsage() const { return sizeof(*this); }
+    void write(RecordWriter& out) const
+    {
+      out.writePen(_states->pens[_idx]);
+    }
+
+    bool merge(const PaintElement* next, const OptimiseState&)
+    {
+      if( next->type() != PE_PEN )
+	return false;
+      _idx = static_cast<const PenElement*>(next)->_idx;
+      return true;
+    }
+    bool sameState(const PaintElement* other) const
+    {
+      return static_cast<const PenElement*>(other)->_idx == _idx;
+    }
 
-    void paint(QPainter& painter, const QTransform&)
+    void trackState(OptimiseState& state) const
     {
-      painter.setPen(_pen);
+      const QPen& pen = _states->pens[_idx];
+      state.opaquepen = pen.style() == Qt::NoPen || pen.brush().isOpaque();
     }
 
   private:
-    QPen _pen;
+    PaintStateTable* _states;
+    int _idx;
   };
 
   class HintsElement : public PaintElement {
@@ -431,27 +905,264 @@ namespace {
     HintsElement(QPainter::RenderHints hints)
       : _hints(hints)
     {}
+    HintsElement(RecordReader& in)
+    {
+      qint32 hints;
+      in.stream() >> hints;
+      _hints = QPainter::RenderHints(QFlag(hints));
+    }
 
-    void paint(QPainter& painter, const QTransform&)
+    void paint(QPainter& painter, PaintPlayState&)
     {
       painter.setRenderHints(_hints);
     }
 
+    int type() const { return PE_HINTS; }
+    qint64 memoryUsage() const { return sizeof(*this); }
+    void write(RecordWriter& out) const
+    {
+      out.stream() << qint32(_hints);
+    }
+
+    bool merge(const PaintElement* next, const OptimiseState&)
+    {
+      if( next->type() != PE_HINTS )
+	return false;
+      _hints = static_cast<const HintsElement*>(next)->_hints;
+      return true;
+    }
+    bool sameState(const PaintElement* other) const
+    {
+      return static_cast<const HintsElement*>(other)->_hints == _hints;
+    }
+
   private:
     QPainter::RenderHints _hints;
   };
 
-
   // end anonymous block
 }
 
+///////////////////////////////////////////////////////////////////
+// Reading elements from saved recordings
+
+PaintElement* readPaintElement(RecordReader& in, int type)
+{
+  switch(type)
+    {
+    case PE_ELLIPSE: return new EllipseElement(in);
+    case PE_ELLIPSEF: return new EllipseFElement(in);
+    case PE_IMAGE: return new ImageElement(in);
+    case PE_LINES: return new LineElement(in);
+    case PE_LINESF: return new LineFElement(in);
+    case PE_PATH: return new PathElement(in);
+    case PE_PIXMAP: return new PixmapElement(in);
+    case PE_POINTS: return new PointElement(in);
+    case PE_POINTSF: return new PointFElement(in);
+    case PE_POLYGON: return new PolygonElement(in);
+    case PE_POLYGONF: return new PolygonFElement(in);
+    case PE_RECTS: return new RectElement(in);
+    case PE_RECTSF: return new RectFElement(in);
+    case PE_TEXT: return new TextElement(in);
+    case PE_TILEDPIXMAP: return new TiledPixmapElement(in);
+    case PE_BACKGROUNDBRUSH: return new BackgroundBrushElement(in);
+    case PE_BACKGROUNDMODE: return new BackgroundModeElement(in);
+    case PE_BRUSH: return new BrushElement(in);
+    case PE_BRUSHORIGIN: return new BrushOriginElement(in);
+    case PE_CLIPREGION: return new ClipRegionElement(in);
+    case PE_CLIPPATH: return new ClipPathElement(in);
+    case PE_COMPOSITION: return new CompositionElement(in);
+    case PE_FONT: return new FontElement(in);
+    case PE_TRANSFORM: return new TransformElement(in);
+    case PE_CLIPENABLED: return new ClipEnabledElement(in);
+    case PE_PEN: return new PenElement(in);
+    case PE_HINTS: return new HintsElement(in);
+    default: return 0;
+    }
+}
+
+///////////////////////////////////////////////////////////////////
+// Simplification of geometry while recording
+
+namespace {
+
+  const double PI = 3.14159265358979323846;
+
+  // Simplify a polyline, only keeping the points needed to keep the
+  // line within tol of the original.
+  //
+  // Starting at the last point kept, the range of directions which
+  // stays within tol of each following point is narrowed down. When a
+  // point falls outside this range, or the line turns back on itself,
+  // the previous point is kept and the process restarts from there.
+  void simplifyPolyline(const QPointF* pts, int num, double tol,
+			QPolygonF& out)
+  {
+    QPointF anchor(pts[0]);
+    QPointF last(anchor);
+    out << anchor;
+
+    bool insector = false;
+    double refangle = 0, lo = 0, hi = 0, maxdist = 0;
+
+    for(int i=1; i<num; ++i)
+      {
+	const QPointF pt(pts[i]);
+	double dx = pt.x()-anchor.x();
+	double dy = pt.y()-anchor.y();
+	double dist = std::sqrt(dx*dx+dy*dy);
+
+	if( insector )
+	  {
+	    double rel = std::atan2(dy, dx) - refangle;
+	    if( rel > PI )
+	      rel -= 2*PI;
+	    else if( rel < -PI )
+	      rel += 2*PI;
+
+	    if( rel >= lo && rel <= hi && dist >= maxdist-tol )
+	      {
+		// point can be dropped, so narrow sector
+		if( dist > tol )
+		  {
+		    const double delta = std::asin(tol/dist);
+		    lo = std::max(lo, rel-delta);
+		    hi = std::min(hi, rel+delta);
+		  }
+		maxdist = std::max(maxdist, dist);
+		last = pt;
+		continue;
+	      }
+
+	    // keep previous point and restart from it
+	    out << last;
+	    anchor = last;
+	    insector = false;
+	    dx = pt.x()-anchor.x();
+	    dy = pt.y()-anchor.y();
+	    dist = std::sqrt(dx*dx+dy*dy);
+	  }
+
+	// points closer than tol to the anchor are skipped
+	if( dist > tol )
+	  {
+	    const double delta = std::asin(tol/dist);
+	    refangle = std::atan2(dy, dx);
+	    lo = -delta;
+	    hi = delta;
+	    maxdist = dist;
+	    insector = true;
+	  }
+	last = pt;
+      }
+
+    // always keep the final point
+    if( last != out.last() )
+      out << last;
+  }
+
+  // bounds of points, returning false if any are not finite
+  bool pointsBounds(const QPointF* pts, int num, QRectF& bounds)
+  {
+    double minx = pts[0].x(), maxx = minx;
+    double miny = pts[0].y(), maxy = miny;
+    for(int i=0; i<num; ++i)
+      {
+	const double x = pts[i].x();
+	const double y = pts[i].y();
+	if( ! std::isfinite(x) || ! std::isfinite(y) )
+	  return false;
+	minx = std::min(minx, x); maxx = std::max(maxx, x);
+	miny = std::min(miny, y); maxy = std::max(maxy, y);
+      }
+    bounds = QRectF(QPointF(minx, miny), QPointF(maxx, maxy));
+    return true;
+  }
+
+}
+
+bool RecordPaintEngine::outsideDevice(const QRectF& bounds) const
+{
+  // allow for width of pen, including mitred joins
+  double margin = 1;
+  if( _pen.style() != Qt::NoPen )
+    {
+      double width = _pen.widthF();
+      if( ! _pen.isCosmetic() )
+	width *= _scale;
+      margin += std::max(width, 1.) * std::max(_pen.miterLimit(), 1.);
+    }
+
+  const QRectF r(_transform.mapRect(bounds));
+  return r.right() < -margin || r.left() > _pdev->_width + margin ||
+    r.bottom() < -margin || r.top() > _pdev->_height + margin;
+}
+
+bool RecordPaintEngine::simplifyPoints(const QPointF* points, int pointcount,
+				       QPolygonF& out) const
+{
+  if( pointcount < 3 || _scale <= 0 )
+    return false;
+
+  // tolerance is given in device pixels
+  simplifyPolyline(points, pointcount, _pdev->_simplifytol / _scale, out);
+  return out.size() < pointcount;
+}
+
+bool RecordPaintEngine::simplifyPath(const QPainterPath& path,
+				     QPainterPath& out) const
+{
+  const int num = path.elementCount();
+  if( num < 3 || _scale <= 0 )
+    return false;
+
+  const double tol = _pdev->_simplifytol / _scale;
+  QPolygonF subpath, simple;
+  out.setFillRule(path.fillRule());
+
+  for(int i=0; i<=num; ++i)
+    {
+      if( i == num || path.elementAt(i).isMoveTo() )
+	{
+	  // output previous subpath
+	  if( ! subpath.isEmpty() )
+	    {
+	      simple.clear();
+	      simplifyPolyline(subpath.constData(), subpath.size(), tol,
+			       simple);
+	      out.moveTo(simple[0]);
+	      for(int j=1; j<simple.size(); ++j)
+		out.lineTo(simple[j]);
+	      subpath.clear();
+	    }
+	  if( i == num )
+	    break;
+	}
+      else if( ! path.elementAt(i).isLineTo() )
+	{
+	  // curves are left alone
+	  return false;
+	}
+
+      const QPainterPath::Element& el = path.elementAt(i);
+      if( ! std::isfinite(el.x) || ! std::isfinite(el.y) )
+	return false;
+      subpath << QPointF(el.x, el.y);
+    }
+
+  return out.elementCount() < num;
+}
+
 ///////////////////////////////////////////////////////////////////
 // Paint engine follows
 
 RecordPaintEngine::RecordPaintEngine()
   : QPaintEngine(QPaintEngine::AllFeatures),
     _drawitemcount(0),
-    _pdev(0)
+    _statechangecount(0),
+    _pdev(0),
+    _scale(1),
+    _curpen(-1), _curbrush(-1), _curbackground(-1), _curfont(-1)
 {
 }
 
@@ -460,6 +1171,11 @@ bool RecordPaintEngine::begin(QPaintDevice* pdev)
   // old style C cast - probably should use dynamic_cast
   _pdev = (RecordPaintDevice*)(pdev);
 
+  _transform = QTransform();
+  _scale = 1;
+  _pen = QPen();
+  _curpen = _curbrush = _curbackground = _curfont = -1;
+
   // signal started ok
   return 1;
 }
@@ -502,6 +1218,20 @@ void RecordPaintEngine::drawLines(const QLine* lines, int lineCount)
 
 void RecordPaintEngine::drawPath(const QPainterPath& path)
 {
+  if( _pdev->_simplifytol > 0 )
+    {
+      if( outsideDevice(path.controlPointRect()) )
+	return;
+
+      QPainterPath simple;
+      if( simplifyPath(path, simple) )
+	{
+	  _pdev->addElement( new PathElement(simple) );
+	  _drawitemcount++;
+	  return;
+	}
+    }
+
   _pdev->addElement( new PathElement(path) );
   _drawitemcount++;
 }
@@ -528,6 +1258,22 @@ void RecordPaintEngine::drawPoints(const QPoint* points, int pointCount)
 void RecordPaintEngine::drawPolygon(const QPointF* points, int pointCount,
 				    QPaintEngine::PolygonDrawMode mode)
 {
+  QRectF bounds;
+  if( _pdev->_simplifytol > 0 && pointCount > 0 &&
+      pointsBounds(points, pointCount, bounds) )
+    {
+      if( outsideDevice(bounds) )
+	return;
+
+      QPolygonF simple;
+      if( simplifyPoints(points, pointCount, simple) )
+	{
+	  _pdev->addElement( new PolygonFElement(simple, mode) );
+	  _drawitemcount += simple.size();
+	  return;
+	}
+    }
+
   _pdev->addElement( new PolygonFElement(points, pointCount, mode) );
   _drawitemcount += pointCount;
 }
@@ -582,21 +1328,67 @@ void RecordPaintEngine::updateState(const QPaintEngineState& state)
 {
   // we add a new element for each change of state
   // these are replayed later
+
+  // pens, brushes and fonts are interned in the device state table,
+  // and only recorded if they differ from the current value
+  PaintStateTable* states = &_pdev->_states;
+
   const int flags = state.state();
+
+  // count each type of state changed
+  for(int f = flags & QPaintEngine::AllDirty; f != 0; f &= f-1)
+    _statechangecount++;
+
   if( flags & QPaintEngine::DirtyPen )
-    _pdev->addElement( new PenElement( state.pen() ) );
+    {
+      _pen = state.pen();
+      const int idx = states->pens.intern(_pen, penHash(_pen));
+      if( idx != _curpen )
+	{
+	  _pdev->addElement( new PenElement(states, idx) );
+	  _curpen = idx;
+	}
+    }
   if( flags & QPaintEngine::DirtyBrush )
-    _pdev->addElement( new BrushElement( state.brush() ) );
+    {
+      const QBrush brush(state.brush());
+      const int idx = states->brushes.intern(brush, brushHash(brush));
+      if( idx != _curbrush )
+	{
+	  _pdev->addElement( new BrushElement(states, idx) );
+	  _curbrush = idx;
+	}
+    }
   if( flags & QPaintEngine::DirtyBrushOrigin )
     _pdev->addElement( new BrushOriginElement( state.brushOrigin() ) );
   if( flags & QPaintEngine::DirtyFont )
-    _pdev->addElement( new FontElement( state.font(), _pdev->_dpiy ) );
+    {
+      const QFont font(state.font());
+      const int idx = states->fonts.intern(font, fontHash(font));
+      if( idx != _curfont )
+	{
+	  _pdev->addElement( new FontElement(states, idx, _pdev->_dpiy) );
+	  _curfont = idx;
+	}
+    }
   if( flags & QPaintEngine::DirtyBackground )
-    _pdev->addElement( new BackgroundBrushElement( state.backgroundBrush() ) );
+    {
+      const QBrush brush(state.backgroundBrush());
+      const int idx = states->brushes.intern(brush, brushHash(brush));
+      if( idx != _curbackground )
+	{
+	  _pdev->addElement( new BackgroundBrushElement(states, idx) );
+	  _curbackground = idx;
+	}
+    }
   if( flags & QPaintEngine::DirtyBackgroundMode )
     _pdev->addElement( new BackgroundModeElement( state.backgroundMode() ) );
   if( flags & QPaintEngine::DirtyTransform )
-    _pdev->addElement( new TransformElement( state.transform() ) );
+    {
+      _transform = state.transform();
+      _scale = std::sqrt(std::abs(_transform.determinant()));
+      _pdev->addElement( new TransformElement( _transform ) );
+    }
   if( flags & QPaintEngine::DirtyClipRegion )
     _pdev->addElement( new ClipRegionElement( state.clipOperation(),
 					      state.clipRegion() ) );
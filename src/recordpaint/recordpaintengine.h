@@ -29,6 +29,9 @@
 #include <QRectF>
 #include <QRect>
 #include <QPixmap>
+#include <QPolygonF>
+#include <QTransform>
+#include <QPen>
 
 class RecordPaintDevice;
 
@@ -66,10 +69,33 @@ public:
   
   // return an estimate of number of items drawn
   int drawItemCount() const { return _drawitemcount; }
+  void setDrawItemCount(int count) { _drawitemcount = count; }
+
+  // number of state changes requested by painters (including those
+  // which did not need to be recorded)
+  int stateChangeCount() const { return _statechangecount; }
+
+private:
+  // is the rectangle (in painter coordinates) outside the device?
+  bool outsideDevice(const QRectF& bounds) const;
+
+  // simplify points, returning false if no simplification was done
+  bool simplifyPoints(const QPointF* points, int pointcount,
+		      QPolygonF& out) const;
+  bool simplifyPath(const QPainterPath& path, QPainterPath& out) const;
 
 private:
   int _drawitemcount;
+  int _statechangecount;
   RecordPaintDevice* _pdev;
+
+  // current state, used when simplifying
+  QTransform _transform;
+  double _scale;
+  QPen _pen;
+
+  // indices of current interned states
+  int _curpen, _curbrush, _curbackground, _curfont;
 };
 
 #endif
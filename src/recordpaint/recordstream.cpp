@@ -0,0 +1,112 @@
+//    Copyright (C) 2026 Jeremy S. Sanders
+//    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+/////////////////////////////////////////////////////////////////////////////
+
+#include <QIODevice>
+#include "recordstream.h"
+
+namespace {
+
+  // serialize object to a byte array, using same version as stream
+  template <class T>
+  QByteArray toBytes(const T& obj, int version)
+  {
+    QByteArray bytes;
+    QDataStream stream(&bytes, QIODevice::WriteOnly);
+    stream.setVersion(version);
+    stream << obj;
+    return bytes;
+  }
+
+  // write index of object in table, followed by the object itself
+  // if this is the first time it has been seen
+  template <class K, class T>
+  void writeShared(QDataStream& stream, QHash<K, qint32>& table,
+		   const K& key, const T& obj)
+  {
+    qint32 idx = table.value(key, -1);
+    if( idx >= 0 )
+      stream << idx;
+    else
+      {
+	idx = table.size();
+	table.insert(key, idx);
+	stream << idx << obj;
+      }
+  }
+
+  // read back object written with writeShared
+  template <class T>
+  T readShared(QDataStream& stream, QList<T>& table)
+  {
+    qint32 idx;
+    stream >> idx;
+    if( idx == table.size() )
+      {
+	T obj;
+	stream >> obj;
+	table.append(obj);
+      }
+    else if( idx < 0 || idx > table.size() )
+      {
+	stream.setStatus(QDataStream::ReadCorruptData);
+	return T();
+      }
+    return table[idx];
+  }
+
+}
+
+void RecordWriter::writePen(const QPen& pen)
+{
+  writeShared(_stream, _pens, toBytes(pen, _stream.version()), pen);
+}
+
+void RecordWriter::writeBrush(const QBrush& brush)
+{
+  writeShared(_stream, _brushes, toBytes(brush, _stream.version()), brush);
+}
+
+void RecordWriter::writeImage(const QImage& image)
+{
+  writeShared(_stream, _images, image.cacheKey(), image);
+}
+
+void RecordWriter::writePixmap(const QPixmap& pixmap)
+{
+  writeShared(_stream, _pixmaps, pixmap.cacheKey(), pixmap);
+}
+
+QPen RecordReader::readPen()
+{
+  return readShared(_stream, _pens);
+}
+
+QBrush RecordReader::readBrush()
+{
+  return readShared(_stream, _brushes);
+}
+
+QImage RecordReader::readImage()
+{
+  return readShared(_stream, _images);
+}
+
+QPixmap RecordReader::readPixmap()
+{
+  return readShared(_stream, _pixmaps);
+}
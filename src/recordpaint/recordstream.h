@@ -0,0 +1,93 @@
+//    Copyright (C) 2026 Jeremy S. Sanders
+//    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef RECORDSTREAM_H
+#define RECORDSTREAM_H
+
+#include <QDataStream>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QPen>
+#include <QBrush>
+#include <QImage>
+#include <QPixmap>
+
+class PaintElement;
+struct PaintStateTable;
+
+// Helpers for saving and loading recordings
+//
+// Pens, brushes, images and pixmaps are usually shared between many
+// elements, so are only written the first time they are seen. Later
+// uses refer back to them by index.
+
+class RecordWriter
+{
+public:
+  RecordWriter(QDataStream& stream) : _stream(stream) {}
+
+  QDataStream& stream() { return _stream; }
+
+  void writePen(const QPen& pen);
+  void writeBrush(const QBrush& brush);
+  void writeImage(const QImage& image);
+  void writePixmap(const QPixmap& pixmap);
+
+private:
+  QDataStream& _stream;
+
+  // pens and brushes are keyed by their serialized form
+  QHash<QByteArray, qint32> _pens, _brushes;
+  // images and pixmaps by their cache keys
+  QHash<qint64, qint32> _images, _pixmaps;
+};
+
+class RecordReader
+{
+public:
+  RecordReader(QDataStream& stream, PaintStateTable* states)
+    : _stream(stream), _states(states)
+  {}
+
+  QDataStream& stream() { return _stream; }
+
+  // state table of the device being read into
+  PaintStateTable* states() { return _states; }
+
+  QPen readPen();
+  QBrush readBrush();
+  QImage readImage();
+  QPixmap readPixmap();
+
+private:
+  QDataStream& _stream;
+  PaintStateTable* _states;
+
+  QList<QPen> _pens;
+  QList<QBrush> _brushes;
+  QList<QImage> _images;
+  QList<QPixmap> _pixmaps;
+};
+
+// create a new element of the type given from the stream
+// (defined in recordpaintengine.cpp)
+// returns 0 if the type is unknown
+PaintElement* readPaintElement(RecordReader& in, int type);
+
+#endif
@@ -0,0 +1,71 @@
+//    Copyright (C) 2026 Jeremy S. Sanders
+//    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef STATETABLE_H
+#define STATETABLE_H
+
+#include <QList>
+#include <QHash>
+#include <QPen>
+#include <QBrush>
+#include <QFont>
+
+// A list of unique values, found using a hash of the value
+template <class T>
+class InternTable
+{
+public:
+  // return index of value in table, adding it if not already there
+  int intern(const T& val, uint hash)
+  {
+    int idx = _first.value(hash, -1);
+    while( idx >= 0 )
+      {
+	if( _values[idx] == val )
+	  return idx;
+	idx = _next[idx];
+      }
+
+    idx = _values.size();
+    _values.append(val);
+    _next.append(_first.value(hash, -1));
+    _first.insert(hash, idx);
+    return idx;
+  }
+
+  const T& operator[](int idx) const { return _values[idx]; }
+  int size() const { return _values.size(); }
+
+private:
+  QList<T> _values;
+  // index of latest value with each hash, and index of the
+  // previous value with the same hash for each value (or -1)
+  QHash<uint, int> _first;
+  QList<int> _next;
+};
+
+// The unique pens, brushes and fonts in a recording, which state
+// elements refer to by index.
+struct PaintStateTable
+{
+  InternTable<QPen> pens;
+  InternTable<QBrush> brushes;
+  InternTable<QFont> fonts;
+};
+
+#endif
@@ -0,0 +1,208 @@
+// -*-c++-*-
+
+//    Copyright (C) 2026 Jeremy S. Sanders
+//    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include "mmaths.h"
+
+// axis-aligned bounding box
+// This is empty until points are added. An unbounded box is used if
+// the extent of an object is not known.
+struct Bounds3
+{
+  Bounds3()
+    : minpt(inf(), inf(), inf()), maxpt(-inf(), -inf(), -inf())
+  {
+  }
+
+  Bounds3(const Vec3& _minpt, const Vec3& _maxpt)
+    : minpt(_minpt), maxpt(_maxpt)
+  {
+  }
+
+  static Bounds3 unbounded()
+  {
+    return Bounds3(Vec3(-inf(), -inf(), -inf()), Vec3(inf(), inf(), inf()));
+  }
+
+  bool isEmpty() const
+  {
+    return !(minpt(0)<=maxpt(0) && minpt(1)<=maxpt(1) && minpt(2)<=maxpt(2));
+  }
+  bool isUnbounded() const
+  {
+    return !isEmpty() && !(minpt.isfinite() && maxpt.isfinite());
+  }
+
+  // extend box to include point (non-finite points are ignored)
+  void extend(const Vec3& pt)
+  {
+    if(pt.isfinite())
+      for(unsigned i=0; i<3; ++i)
+        {
+          minpt(i) = std::min(minpt(i), pt(i));
+          maxpt(i) = std::max(maxpt(i), pt(i));
+        }
+  }
+
+  // extend box to include another box
+  void extend(const Bounds3& o)
+  {
+    for(unsigned i=0; i<3; ++i)
+      {
+        minpt(i) = std::min(minpt(i), o.minpt(i));
+        maxpt(i) = std::max(maxpt(i), o.maxpt(i));
+      }
+  }
+
+  // extend box along one axis to include the finite values in vals
+  void extendAxis(unsigned axis, const ValVector& vals)
+  {
+    for(double v : vals)
+      if(std::isfinite(v))
+        {
+          minpt(axis) = std::min(minpt(axis), v);
+          maxpt(axis) = std::max(maxpt(axis), v);
+        }
+  }
+
+  // corner i, where bits 0, 1 and 2 select the max along x, y and z
+  Vec3 corner(unsigned i) const
+  {
+    return Vec3(i&1 ? maxpt(0) : minpt(0),
+                i&2 ? maxpt(1) : minpt(1),
+                i&4 ? maxpt(2) : minpt(2));
+  }
+
+  bool contains(const Bounds3& o) const
+  {
+    return o.isEmpty() ||
+      (minpt(0)<=o.minpt(0) && minpt(1)<=o.minpt(1) && minpt(2)<=o.minpt(2) &&
+       maxpt(0)>=o.maxpt(0) && maxpt(1)>=o.maxpt(1) && maxpt(2)>=o.maxpt(2));
+  }
+
+  bool intersects(const Bounds3& o) const
+  {
+    return !isEmpty() && !o.isEmpty() &&
+      minpt(0)<=o.maxpt(0) && minpt(1)<=o.maxpt(1) && minpt(2)<=o.maxpt(2) &&
+      maxpt(0)>=o.minpt(0) && maxpt(1)>=o.minpt(1) && maxpt(2)>=o.minpt(2);
+  }
+
+  Bounds3 intersection(const Bounds3& o) const
+  {
+    Bounds3 r;
+    for(unsigned i=0; i<3; ++i)
+      {
+        r.minpt(i) = std::max(minpt(i), o.minpt(i));
+        r.maxpt(i) = std::min(maxpt(i), o.maxpt(i));
+      }
+    return r;
+  }
+
+  // box containing this box after transformation by M
+  Bounds3 transformed(const Mat4& M) const
+  {
+    if(isEmpty() || isUnbounded())
+      return *this;
+    Bounds3 r;
+    for(unsigned i=0; i<8; ++i)
+      r.extend(vec4to3(M*vec3to4(corner(i))));
+    return r;
+  }
+
+  Vec3 minpt, maxpt;
+
+private:
+  static double inf() { return std::numeric_limits<double>::infinity(); }
+};
+
+// Region of view space in which objects can be seen, defined by a set
+// of planes. A point pt is inside if dot(norm, pt) <= dist for each
+// plane. If there are no planes, everything is inside.
+class Frustum
+{
+public:
+  Frustum()
+  {
+  }
+
+  // Make a frustum for the points which the perspective matrix
+  // projects to within -xlim to xlim and -ylim to ylim, in front of
+  // the camera.
+  Frustum(const Mat4& perspM, double xlim, double ylim)
+  {
+    // for clip coordinates c=perspM*pt, we need |c0| <= xlim*c3 and
+    // |c1| <= ylim*c3
+    for(int sign=-1; sign<=1; sign+=2)
+      {
+        addPlaneRows(perspM, 0, sign, xlim);
+        addPlaneRows(perspM, 1, sign, ylim);
+      }
+  }
+
+  bool isUnbounded() const { return planes.empty(); }
+
+  // can any part of box, after transformation by M, be inside?
+  bool mayContain(const Bounds3& box, const Mat4& M) const
+  {
+    if(box.isEmpty())
+      return false;
+    if(planes.empty() || box.isUnbounded())
+      return true;
+
+    Vec3 corners[8];
+    for(unsigned i=0; i<8; ++i)
+      corners[i] = vec4to3(M*vec3to4(box.corner(i)));
+
+    // outside if all corners are outside the same plane
+    for(const Plane& p : planes)
+      {
+        bool outside = true;
+        for(unsigned i=0; i<8 && outside; ++i)
+          outside = dot(p.norm, corners[i]) > p.dist;
+        if(outside)
+          return false;
+      }
+    return true;
+  }
+
+private:
+  void addPlaneRows(const Mat4& M, unsigned row, int sign, double lim)
+  {
+    Plane p;
+    for(unsigned i=0; i<3; ++i)
+      p.norm(i) = sign*M(row,i) - lim*M(3,i);
+    p.dist = -(sign*M(row,3) - lim*M(3,3));
+    planes.push_back(p);
+  }
+
+  struct Plane
+  {
+    Vec3 norm;
+    double dist;
+  };
+  std::vector<Plane> planes;
+};
+
+#endif
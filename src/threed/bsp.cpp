@@ -18,6 +18,14 @@ namespace
     return a*a;
   }
 
+  // copy the points of a triangle, which may be indexed
+  inline void triPoints(const FragmentVector& frags, const Fragment& f,
+                        Vec3* pts)
+  {
+    for(unsigned i=0; i<3; ++i)
+      pts[i] = f.point(frags.vertices, i);
+  }
+
   // Find set of three points to define a plane (pts).
   // Needs to find points which are not the same return true if ok
   bool findPlane(const IdxVector& idxs, unsigned startidx,
@@ -47,7 +55,9 @@ namespace
         const Fragment& f = frags[idxs[i]];
         if(f.type == Fragment::FR_TRIANGLE)
           {
-            double areasqd = triAreaSqd2D(f.points);
+            Vec3 tri[3];
+            triPoints(frags, f, tri);
+            double areasqd = triAreaSqd2D(tri);
             if(areasqd > maxtriarea2)
               {
                 maxtriarea2 = areasqd;
@@ -80,8 +90,7 @@ namespace
     // return triangle
     if(besttri != EMPTY_BSP_IDX)
       {
-        for(unsigned i=0; i<3; ++i)
-          pts[i] = frags[idxs[besttri]].points[i];
+        triPoints(frags, frags[idxs[besttri]], pts);
         return 1;
       }
     else
@@ -97,6 +106,91 @@ namespace
     return dot > EPS ? 1 : dot < -EPS ? -1 : 0;
   }
 
+  // norm of plane through pts, pointing towards the observer and
+  // approximately normalised
+  inline Vec3 planeNorm(const Vec3* pts, const Vec3& viewdirn)
+  {
+    Vec3 norm = cross(pts[1]-pts[0], pts[2]-pts[0]);
+    if(dot(norm, viewdirn) < 0)
+      norm = -norm;
+    norm *= 1./(std::abs(norm(0))+std::abs(norm(1))+std::abs(norm(2)));
+    return norm;
+  }
+
+  // relative cost of splitting a fragment, compared to one fragment
+  // of imbalance between the front and back
+#define BSP_SPLIT_COST 8
+  // number of fragments tested for each sampled plane
+#define BSP_TESTS_PER_SAMPLE 8
+
+  // Find a plane by trying up to nsamples triangles from the range as
+  // planes. For each, the number of fragments split and the imbalance
+  // between front and back is estimated from a subsample of the
+  // fragments, and the plane with the lowest cost is chosen. Falls
+  // back to findPlane if there are no triangles.
+  bool findPlaneSampled(const IdxVector& idxs, unsigned startidx,
+                        const FragmentVector& frags, const Vec3& viewdirn,
+                        unsigned nsamples, Vec3* pts)
+  {
+    const unsigned endidx = idxs.size();
+    const unsigned n = endidx-startidx;
+
+    // fragments to test the planes against
+    const unsigned ntests = std::min(n, nsamples*BSP_TESTS_PER_SAMPLE);
+    const double teststep = double(n)/ntests;
+
+    long bestcost = std::numeric_limits<long>::max();
+    double bestarea = -1;
+    unsigned besttri = EMPTY_BSP_IDX;
+
+    const unsigned step = std::max(1u, n/nsamples);
+    for(unsigned i=startidx; i<endidx; i+=step)
+      {
+        const Fragment& cand = frags[idxs[i]];
+        if(cand.type != Fragment::FR_TRIANGLE)
+          continue;
+        Vec3 candpts[3];
+        triPoints(frags, cand, candpts);
+        const double area = triAreaSqd2D(candpts);
+        const Vec3 norm = planeNorm(candpts, viewdirn);
+        if(!norm.isfinite())
+          continue;
+
+        long nsplit=0, nfront=0, nback=0;
+        for(unsigned t=0; t<ntests; ++t)
+          {
+            const Fragment& f = frags[idxs[startidx+unsigned(t*teststep)]];
+            bool front=0, back=0;
+            for(unsigned pi=0, np=f.nPointsVisible(); pi<np; ++pi)
+              {
+                const int sign = dotsign(dot(norm, f.point(frags.vertices, pi)-
+                                             candpts[0]));
+                front |= sign > 0;
+                back |= sign < 0;
+              }
+            nsplit += front && back;
+            nfront += front && !back;
+            nback += back && !front;
+          }
+
+        // prefer triangles in the plane of the image for equal costs
+        // (see findPlane)
+        const long cost = nsplit*BSP_SPLIT_COST + std::abs(nfront-nback);
+        if(cost < bestcost || (cost == bestcost && area > bestarea))
+          {
+            bestcost = cost;
+            bestarea = area;
+            besttri = i;
+          }
+      }
+
+    if(besttri == EMPTY_BSP_IDX)
+      return findPlane(idxs, startidx, frags, pts);
+
+    triPoints(frags, frags[idxs[besttri]], pts);
+    return 1;
+  }
+
   // is path in front, on or behind plane?
   void handlePath(const Vec3& norm, const Vec3& plane0,
                   FragmentVector& v, unsigned fidx,
@@ -150,6 +244,33 @@ namespace
       }
   }
 
+  // index of a new point made by splitting the edge of fragment f
+  // between corners c1 and c2 at frac, which is added to the shared
+  // vertices if f is indexed
+  unsigned splitVertexIdx(FragmentVector& fragvec, const Fragment& f,
+                          const Vec3& pt, unsigned c1, unsigned c2,
+                          double frac)
+  {
+    if(!f.indexed)
+      return 0;
+    const unsigned idx = fragvec.vertices.size();
+    fragvec.vertices.push_back(pt);
+    fragvec.splitvertices.push_back(
+      SplitVertex{idx, f.vertidx[c1], f.vertidx[c2], frac});
+    return idx;
+  }
+
+  // set point i of a fragment made by splitting, using its index in
+  // the shared vertices if the fragment is indexed
+  inline void setSplitPoint(Fragment& f, unsigned i, const Vec3& pt,
+                            unsigned vertidx)
+  {
+    if(f.indexed)
+      f.vertidx[i] = vertidx;
+    else
+      f.points[i] = pt;
+  }
+
   // is triangle in front, behind or on plane?
   void handleTriangle(const Vec3& norm, const Vec3& plane0,
                       FragmentVector& fragvec, unsigned fidx,
@@ -157,11 +278,16 @@ namespace
   {
     Fragment& f = fragvec[fidx];
 
+    // copy points, as adding split points to the shared vertices
+    // invalidates references to them
+    Vec3 pts[3];
+    triPoints(fragvec, f, pts);
+
     double dots[3];
     int signs[3];
     for(unsigned i=0; i<3; ++i)
       {
-        dots[i] = dot(norm, f.points[i]-plane0);
+        dots[i] = dot(norm, pts[i]-plane0);
         signs[i] = dotsign(dots[i]);
       }
     int signsum = signs[0]+signs[1]+signs[2];
@@ -183,18 +309,20 @@ namespace
         // index of point on plane
         unsigned idx0 = signs[0]==0 ? 0 : signs[1]==0 ? 1 : 2;
 
-        Vec3 linevec = f.points[(idx0+2)%3]-f.points[(idx0+1)%3];
+        Vec3 linevec = pts[(idx0+2)%3]-pts[(idx0+1)%3];
         double d = -dots[(idx0+1)%3] / dot(linevec, norm);
-        Vec3 newpt = f.points[(idx0+1)%3] + linevec*d;
+        Vec3 newpt = pts[(idx0+1)%3] + linevec*d;
+        const unsigned newidx = splitVertexIdx(
+          fragvec, f, newpt, (idx0+1)%3, (idx0+2)%3, d);
 
         Fragment fcpy(f);
 
         // modify original
-        f.points[(idx0+2)%3] = newpt;
+        setSplitPoint(f, (idx0+2)%3, newpt, newidx);
         (dots[(idx0+1)%3]>0 ? idxfront : idxback).push_back(fidx);
 
         // then make a copy for the other side
-        fcpy.points[(idx0+1)%3] = newpt;
+        setSplitPoint(fcpy, (idx0+1)%3, newpt, newidx);
         (dots[(idx0+2)%3]>0 ? idxfront : idxback).push_back(fragvec.size());
         fragvec.push_back(fcpy);
       }
@@ -207,28 +335,32 @@ namespace
         unsigned diffidx = signs[1]==signs[2] ? 0 : signs[0]==signs[2] ? 1 : 2;
 
         // new points on plane
-        Vec3 linevec_p1 = f.points[(diffidx+1)%3]-f.points[diffidx];
+        Vec3 linevec_p1 = pts[(diffidx+1)%3]-pts[diffidx];
         double d_p1 = -dots[diffidx] / dot(linevec_p1, norm);
-        Vec3 newpt_p1 = f.points[diffidx] + linevec_p1*d_p1;
-        Vec3 linevec_p2 = f.points[(diffidx+2)%3]-f.points[diffidx];
+        Vec3 newpt_p1 = pts[diffidx] + linevec_p1*d_p1;
+        Vec3 linevec_p2 = pts[(diffidx+2)%3]-pts[diffidx];
         double d_p2 = -dots[diffidx] / dot(linevec_p2, norm);
-        Vec3 newpt_p2 = f.points[diffidx] + linevec_p2*d_p2;
+        Vec3 newpt_p2 = pts[diffidx] + linevec_p2*d_p2;
+        const unsigned newidx_p1 = splitVertexIdx(
+          fragvec, f, newpt_p1, diffidx, (diffidx+1)%3, d_p1);
+        const unsigned newidx_p2 = splitVertexIdx(
+          fragvec, f, newpt_p2, diffidx, (diffidx+2)%3, d_p2);
 
         // now make one triangle on one side and two on the other
         Fragment fcpy1(f);
         Fragment fcpy2(f);
 
         // modify original: triangle by itself on one side
-        f.points[(diffidx+1)%3] = newpt_p1;
-        f.points[(diffidx+2)%3] = newpt_p2;
+        setSplitPoint(f, (diffidx+1)%3, newpt_p1, newidx_p1);
+        setSplitPoint(f, (diffidx+2)%3, newpt_p2, newidx_p2);
         (dots[diffidx] > 0 ? idxfront : idxback).push_back(fidx);
 
         // then add the other two on the other side
-        fcpy1.points[diffidx] = newpt_p1;
-        fcpy1.points[(diffidx+2)%3] = newpt_p2;
+        setSplitPoint(fcpy1, diffidx, newpt_p1, newidx_p1);
+        setSplitPoint(fcpy1, (diffidx+2)%3, newpt_p2, newidx_p2);
         (dots[diffidx] < 0 ? idxfront : idxback).push_back(fragvec.size());
         fragvec.push_back(fcpy1);
-        fcpy2.points[diffidx] = newpt_p2;
+        setSplitPoint(fcpy2, diffidx, newpt_p2, newidx_p2);
         (dots[diffidx] < 0 ? idxfront : idxback).push_back(fragvec.size());
         fragvec.push_back(fcpy2);
       }
@@ -236,22 +368,23 @@ namespace
 
   struct BSPStackItem
   {
-    BSPStackItem(unsigned _bspidx, unsigned _nidxs)
-      : bspidx(_bspidx), nidxs(_nidxs)
+    BSPStackItem(unsigned _bspidx, unsigned _nidxs, unsigned _depth)
+      : bspidx(_bspidx), nidxs(_nidxs), depth(_depth)
     {}
     unsigned bspidx; // BSPRecord we are working on here
     unsigned nidxs;  // Number of fragment indices in to_process
+    unsigned depth;  // Depth of record in tree
   };
 
   // get Z component of fragment, nudging points and lines forward
   // Z decreases away from viewer
-  double fragZ(const Fragment& f)
+  double fragZ(const Fragment& f, const Vec3Vector& verts)
   {
     switch(f.type)
       {
       case Fragment::FR_TRIANGLE:
-	return std::min(f.points[0](2), std::min(f.points[1](2),
-                                                 f.points[2](2)));
+	return std::min(f.point(verts, 0)(2),
+                        std::min(f.point(verts, 1)(2), f.point(verts, 2)(2)));
       case Fragment::FR_LINESEG:
 	return std::min(f.points[0](2), f.points[1](2)) + 1e-5;
       case Fragment::FR_PATH:
@@ -268,11 +401,35 @@ namespace
     {}
     bool operator()(unsigned a, unsigned b)
     {
-      return fragZ(v[a])<fragZ(v[b]);
+      return fragZ(v[a], v.vertices)<fragZ(v[b], v.vertices);
     }
     const FragmentVector& v;
   };
 
+  // get squared distance of the furthest point of the fragment from
+  // the eye
+  double fragDist2(const Fragment& f, const Vec3Vector& verts,
+                   const Vec3& eye)
+  {
+    double d2 = 0;
+    for(unsigned i=0, n=f.nPointsVisible(); i<n; ++i)
+      d2 = std::max(d2, (f.point(verts, i)-eye).rad2());
+    return d2;
+  }
+
+  struct FragDistCompare
+  {
+    FragDistCompare(const FragmentVector& _v, const Vec3& _eye)
+      : v(_v), eye(_eye)
+    {}
+    bool operator()(unsigned a, unsigned b)
+    {
+      return fragDist2(v[a], v.vertices, eye)>fragDist2(v[b], v.vertices, eye);
+    }
+    const FragmentVector& v;
+    const Vec3& eye;
+  };
+
 }
 
 // This is a non-recursive BSP building routines. Fragment indices to
@@ -280,12 +437,9 @@ namespace
 // BSPStackItem items is used to keep track which BSP record the
 // fragment indices belong to.
 
-BSPBuilder::BSPBuilder(FragmentVector& fragvec, Vec3 viewdirn)
+BSPBuilder::BSPBuilder(FragmentVector& fragvec, Vec3 viewdirn,
+                       unsigned planesamples)
 {
-  // initial record
-  bsp_recs.reserve(fragvec.size());
-  bsp_recs.push_back(BSPRecord());
-
   // add every non-empty fragment onto a list of fragments to process
   IdxVector to_process;
   to_process.reserve(fragvec.size()*2);
@@ -294,18 +448,43 @@ BSPBuilder::BSPBuilder(FragmentVector& fragvec, Vec3 viewdirn)
       if(fragvec[i].type != Fragment::FR_NONE)
         to_process.push_back(i);
     }
+  build(fragvec, to_process, viewdirn, 0, planesamples);
+}
+
+BSPBuilder::BSPBuilder(FragmentVector& fragvec, const IdxVector& idxs,
+                       const Vec3& eye)
+{
+  IdxVector to_process;
+  to_process.reserve(idxs.size()*2);
+  for(unsigned i : idxs)
+    {
+      if(fragvec[i].type != Fragment::FR_NONE)
+        to_process.push_back(i);
+    }
+  build(fragvec, to_process, Vec3(0,0,1), &eye, 0);
+}
+
+void BSPBuilder::build(FragmentVector& fragvec, IdxVector& to_process,
+                       Vec3 viewdirn, const Vec3* eye, unsigned planesamples)
+{
+  // initial record
+  bsp_recs.reserve(to_process.size());
+  bsp_recs.push_back(BSPRecord());
+
+  stats.fragsin = to_process.size();
+  stats.depth = 0;
 
   // these are where indices for the front and back side of the plane
   IdxVector idxback;
   IdxVector idxfront;
-  idxback.reserve(fragvec.size());
-  idxfront.reserve(fragvec.size());
+  idxback.reserve(to_process.size());
+  idxfront.reserve(to_process.size());
   Vec3 planepts[3];
 
   // stack of items to process
   std::vector<BSPStackItem> stack;
   stack.reserve(128);
-  stack.push_back( BSPStackItem(0, to_process.size()) );
+  stack.push_back( BSPStackItem(0, to_process.size(), 1) );
 
   while( !stack.empty() )
     {
@@ -315,32 +494,38 @@ BSPBuilder::BSPBuilder(FragmentVector& fragvec, Vec3 viewdirn)
       // this is the bsp record with which the items are associated
       BSPRecord& rec = bsp_recs[stackitem.bspidx];
       rec.minfragidxidx = frag_idxs.size(); // where the items get added
+      stats.depth = std::max(stats.depth, stackitem.depth);
 
       // if more than item to process then choose a plane, then split
+      const unsigned startidx = to_process.size()-stackitem.nidxs;
       if( stackitem.nidxs > 1 &&
-          findPlane(to_process, to_process.size()-stackitem.nidxs,
-                    fragvec, planepts) )
+          (planesamples == 0 ?
+           findPlane(to_process, startidx, fragvec, planepts) :
+           findPlaneSampled(to_process, startidx, fragvec, viewdirn,
+                            planesamples, planepts)) )
         {
           // norm of plane (making sure it points to observer)
-          Vec3 norm = cross(planepts[1]-planepts[0], planepts[2]-planepts[0]);
-          if(dot(norm, viewdirn) < 0)
-            norm = -norm;
-          // approximately normalise
-          norm *= 1./(std::abs(norm(0))+std::abs(norm(1))+std::abs(norm(2)));
+          const Vec3 norm = planeNorm(planepts,
+                                      eye ? *eye-planepts[0] : viewdirn);
+          rec.norm = norm;
+          rec.plane0 = planepts[0];
+          rec.hasplane = true;
 
           unsigned to_process_size = to_process.size();
           for(unsigned i=to_process_size-stackitem.nidxs; i<to_process_size; ++i)
             {
+              // lines and paths on the plane are put in front, so
+              // they are drawn over the surfaces they lie on
               unsigned fidx = to_process[i];
               switch(fragvec[fidx].type)
                 {
                   case Fragment::FR_PATH:
                   handlePath(norm, planepts[0], fragvec, fidx,
-                             frag_idxs, idxfront, idxback);
+                             idxfront, idxfront, idxback);
                   break;
                 case Fragment::FR_LINESEG:
                   handleLine(norm, planepts[0], fragvec, fidx,
-                             frag_idxs, idxfront, idxback);
+                             idxfront, idxfront, idxback);
                   break;
                 case Fragment::FR_TRIANGLE:
                   handleTriangle(norm, planepts[0], fragvec, fidx,
@@ -362,12 +547,14 @@ BSPBuilder::BSPBuilder(FragmentVector& fragvec, Vec3 viewdirn)
                 {
                   frag_idxs.insert(frag_idxs.end(), idxback.begin(), idxback.end());
                   rec.nfrags = idxback.size();
+                  rec.listside = -1;
                   idxback.resize(0);
                 }
               else if(idxback.empty() && !idxfront.empty())
                 {
                   frag_idxs.insert(frag_idxs.end(), idxfront.begin(), idxfront.end());
                   rec.nfrags = idxfront.size();
+                  rec.listside = 1;
                   idxfront.resize(0);
                 }
             }
@@ -378,7 +565,8 @@ BSPBuilder::BSPBuilder(FragmentVector& fragvec, Vec3 viewdirn)
               unsigned newbspidx = bsp_recs.size();
               bsp_recs[stackitem.bspidx].frontidx = newbspidx;
               bsp_recs.push_back(BSPRecord());
-              stack.push_back( BSPStackItem(newbspidx, idxfront.size()) );
+              stack.push_back( BSPStackItem(newbspidx, idxfront.size(),
+                                            stackitem.depth+1) );
               to_process.insert(to_process.end(), idxfront.begin(), idxfront.end());
               idxfront.resize(0);
             }
@@ -390,7 +578,8 @@ BSPBuilder::BSPBuilder(FragmentVector& fragvec, Vec3 viewdirn)
               // add the record to be processed
               bsp_recs.push_back(BSPRecord());
               // new set of items to process
-              stack.push_back( BSPStackItem(newbspidx, idxback.size()) );
+              stack.push_back( BSPStackItem(newbspidx, idxback.size(),
+                                            stackitem.depth+1) );
               // and add onto to process list
               to_process.insert(to_process.end(), idxback.begin(), idxback.end());
               idxback.resize(0);
@@ -399,6 +588,18 @@ BSPBuilder::BSPBuilder(FragmentVector& fragvec, Vec3 viewdirn)
       else
         {
           // single item to process or plane couldn't be found
+          // (a single triangle gives a plane for reusing the tree)
+          if(stackitem.nidxs == 1 &&
+             fragvec[to_process.back()].type == Fragment::FR_TRIANGLE)
+            {
+              const Fragment& f = fragvec[to_process.back()];
+              Vec3 pts[3];
+              triPoints(fragvec, f, pts);
+              rec.norm = planeNorm(pts, eye ? *eye-pts[0] : viewdirn);
+              rec.plane0 = pts[0];
+              rec.hasplane = rec.norm.isfinite();
+            }
+
           frag_idxs.insert(frag_idxs.end(),
                            to_process.end()-stackitem.nidxs,
                            to_process.end());
@@ -407,6 +608,9 @@ BSPBuilder::BSPBuilder(FragmentVector& fragvec, Vec3 viewdirn)
         }
 
     } // while !stack.empty()
+
+  stats.fragsout = frag_idxs.size();
+  stats.nodes = bsp_recs.size();
 }
 
 namespace
@@ -477,6 +681,197 @@ IdxVector BSPBuilder::getFragmentIdxs(const FragmentVector& fragvec) const
   return retn;
 }
 
+namespace
+{
+  // Where extra fragments are drawn for a node: with the back subtree
+  // (if there isn't one), with the fragments of the node, or with the
+  // front subtree (if there isn't one).
+  enum { SLOT_BACK=0, SLOT_SAME=1, SLOT_FRONT=2, NUM_SLOTS=3 };
+
+  // (node*NUM_SLOTS+slot, fragment index) for each extra fragment
+  typedef std::vector< std::pair<unsigned,unsigned> > SlotVector;
+}
+
+// Walking the tree for an eye position is like above, but the order
+// of the front and back at each node depends on which side of the
+// plane the eye is on. Extra fragments are first pushed down the tree
+// non-recursively, using the same stack approach as building it.
+
+IdxVector BSPBuilder::getFragmentIdxs(FragmentVector& fragvec, const Vec3& eye,
+                                      unsigned extrastart) const
+{
+  SlotVector extras;
+  if(!bsp_recs.empty())
+    {
+      IdxVector to_process;
+      for(unsigned i=extrastart, s=fragvec.size(); i<s; ++i)
+        if(fragvec[i].type != Fragment::FR_NONE)
+          to_process.push_back(i);
+
+      IdxVector idxsame, idxfront, idxback;
+      std::vector<BSPStackItem> stack;
+      stack.push_back( BSPStackItem(0, to_process.size(), 0) );
+
+      while( !stack.empty() )
+        {
+          BSPStackItem stackitem(stack.back());
+          stack.pop_back();
+
+          const BSPRecord& rec = bsp_recs[stackitem.bspidx];
+          const unsigned key = stackitem.bspidx*NUM_SLOTS;
+          const unsigned startidx = to_process.size()-stackitem.nidxs;
+
+          if(!rec.hasplane)
+            {
+              for(unsigned i=startidx; i<to_process.size(); ++i)
+                extras.push_back(std::make_pair(key+SLOT_SAME, to_process[i]));
+              to_process.resize(startidx);
+              continue;
+            }
+
+          // lines and paths on the plane go on the side of the eye, as
+          // when building the tree
+          IdxVector& idxeye =
+            dotsign(dot(rec.norm, eye-rec.plane0)) >= 0 ? idxfront : idxback;
+          for(unsigned i=startidx, s=to_process.size(); i<s; ++i)
+            {
+              unsigned fidx = to_process[i];
+              switch(fragvec[fidx].type)
+                {
+                case Fragment::FR_PATH:
+                  handlePath(rec.norm, rec.plane0, fragvec, fidx,
+                             idxeye, idxfront, idxback);
+                  break;
+                case Fragment::FR_LINESEG:
+                  handleLine(rec.norm, rec.plane0, fragvec, fidx,
+                             idxeye, idxfront, idxback);
+                  break;
+                case Fragment::FR_TRIANGLE:
+                  handleTriangle(rec.norm, rec.plane0, fragvec, fidx,
+                                 idxsame, idxfront, idxback);
+                  break;
+                default:
+                  break;
+                }
+            }
+          to_process.resize(startidx);
+
+          for(unsigned fidx : idxsame)
+            extras.push_back(std::make_pair(key+SLOT_SAME, fidx));
+          idxsame.resize(0);
+
+          // go down the tree on each side, or keep in this node if
+          // there is nothing there
+          for(int side=-1; side<=1; side+=2)
+            {
+              IdxVector& idxs = side > 0 ? idxfront : idxback;
+              const unsigned child = side > 0 ? rec.frontidx : rec.backidx;
+              if(child != EMPTY_BSP_IDX)
+                {
+                  stack.push_back( BSPStackItem(child, idxs.size(), 0) );
+                  to_process.insert(to_process.end(), idxs.begin(), idxs.end());
+                }
+              else
+                {
+                  const unsigned slot = rec.listside == side ? SLOT_SAME :
+                    side > 0 ? SLOT_FRONT : SLOT_BACK;
+                  for(unsigned fidx : idxs)
+                    extras.push_back(std::make_pair(key+slot, fidx));
+                }
+              idxs.resize(0);
+            }
+        }
+
+      std::sort(extras.begin(), extras.end());
+    }
+
+  IdxVector retn;
+  retn.reserve(frag_idxs.size()+extras.size());
+
+  // stage is 0 to walk a node, or 1+slot to draw a slot
+  std::vector<WalkStackItem> stack;
+  stack.reserve(128);
+  if(!bsp_recs.empty())
+    stack.push_back(WalkStackItem(0, 0));
+
+  IdxVector temp;
+
+  while( !stack.empty() )
+    {
+      WalkStackItem stackitem(stack.back());
+      stack.pop_back();
+
+      const BSPRecord &rec = bsp_recs[stackitem.bsp_idx];
+
+      if(stackitem.stage == 0)
+        {
+          // draw the side away from the eye first
+          const bool eyefront = !rec.hasplane ||
+            dotsign(dot(rec.norm, eye-rec.plane0)) >= 0;
+          const unsigned nearidx = eyefront ? rec.frontidx : rec.backidx;
+          const unsigned faridx = eyefront ? rec.backidx : rec.frontidx;
+          const unsigned nearslot = eyefront ? SLOT_FRONT : SLOT_BACK;
+          const unsigned farslot = eyefront ? SLOT_BACK : SLOT_FRONT;
+
+          if(nearidx != EMPTY_BSP_IDX)
+            stack.push_back( WalkStackItem(nearidx, 0) );
+          else
+            stack.push_back( WalkStackItem(stackitem.bsp_idx, 1+nearslot) );
+          stack.push_back( WalkStackItem(stackitem.bsp_idx, 1+SLOT_SAME) );
+          if(faridx != EMPTY_BSP_IDX)
+            stack.push_back( WalkStackItem(faridx, 0) );
+          else
+            stack.push_back( WalkStackItem(stackitem.bsp_idx, 1+farslot) );
+        }
+      else
+        {
+          const unsigned slot = stackitem.stage-1;
+          temp.resize(0);
+          if(slot == SLOT_SAME)
+            temp.insert(temp.end(),
+                        frag_idxs.begin()+rec.minfragidxidx,
+                        frag_idxs.begin()+(rec.minfragidxidx+rec.nfrags));
+          const unsigned ntree = temp.size();
+
+          if(!extras.empty())
+            {
+              const unsigned key = stackitem.bsp_idx*NUM_SLOTS+slot;
+              for(auto it = std::lower_bound(extras.begin(), extras.end(),
+                                             std::make_pair(key, 0u));
+                  it != extras.end() && it->first == key; ++it)
+                temp.push_back(it->second);
+            }
+          if(temp.empty())
+            continue;
+
+          // The extra fragments have not been split against each
+          // other, so they may intersect or overlap in ways a sort
+          // cannot order. Order the slot with a tree of its own
+          // (which has no extra fragments, so this does not recurse).
+          if(temp.size() > 1 && temp.size() > ntree)
+            {
+              const BSPBuilder slotbsp(fragvec, temp, eye);
+              const IdxVector slotidxs(
+                slotbsp.getFragmentIdxs(fragvec, eye, fragvec.size()));
+              retn.insert(retn.end(), slotidxs.begin(), slotidxs.end());
+              continue;
+            }
+
+          // sort furthest first, then draw by type as above
+          std::sort(temp.begin(), temp.end(), FragDistCompare(fragvec, eye));
+
+          for(int type=Fragment::FR_TRIANGLE; type<=Fragment::FR_PATH; ++type)
+            {
+              for(unsigned i : temp)
+                if(fragvec[i].type == type)
+                  retn.push_back(i);
+            }
+        }
+    }
+
+  return retn;
+}
+
 #if 0
 #include <iostream>
 int main()
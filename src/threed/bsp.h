@@ -32,7 +32,8 @@ struct BSPRecord
 {
   BSPRecord()
     : minfragidxidx(0), nfrags(0),
-      frontidx(EMPTY_BSP_IDX), backidx(EMPTY_BSP_IDX)
+      frontidx(EMPTY_BSP_IDX), backidx(EMPTY_BSP_IDX),
+      hasplane(false), listside(0)
   {
   }
 
@@ -41,31 +42,88 @@ struct BSPRecord
   unsigned minfragidxidx, nfrags;
   // indices in bsp_recs to the BSPRecord items in front and behind
   unsigned frontidx, backidx;
+  // plane of node (if hasplane), given by a point and normal to front
+  Vec3 norm, plane0;
+  bool hasplane;
+  // fragments in node are on the plane (0), or all in front (1) or
+  // behind (-1) if they could not be split
+  int listside;
 };
 
+// statistics from building a tree
+struct BSPStats
+{
+  BSPStats()
+    : fragsin(0), fragsout(0), depth(0), nodes(0)
+  {
+  }
+
+  // non-empty fragments before and after splitting
+  unsigned fragsin, fragsout;
+  // maximum depth and number of nodes in tree
+  unsigned depth, nodes;
+};
+
+// number of planes sampled per node by default when rendering scenes
+#define BSP_DEFAULT_PLANE_SAMPLES 8
+
 // This class defines a specialised Binary Space Paritioning (BSP)
 // buliding routine. 3D space is split recursively by planes to
 // separate objects into front and back entries. The idea is to only
 // use the BSP tree _once_, which is unlike normal uses of BSP. It is
 // used to create a robust back->front ordering for a particular
-// viewing direction. To avoid lots of dynamic memory allocation and
-// to reduce overheads, the nodes in the BSP tree are stored in a
-// vector.
+// viewing direction (though see below). To avoid lots of dynamic
+// memory allocation and to reduce overheads, the nodes in the BSP
+// tree are stored in a vector.
 
 class BSPBuilder
 {
 public:
   // construct the BSP tree from the fragments given and a particular
+  // viewing direction. Lines and paths lying in a plane of the tree
+  // are put in front of it, so they are drawn over the surfaces they
+  // lie on.
+
+  // If planesamples is 0, each node is split by the largest triangle
+  // in the plane of the image. Otherwise planesamples triangles are
+  // tried, choosing the one estimated to split the fewest fragments
+  // and best balance the tree. More samples make better trees more
+  // slowly.
+  BSPBuilder(FragmentVector& fragvec, Vec3 viewdirn,
+             unsigned planesamples=0);
+
+  // construct the tree from only the fragments with the indices given,
+  // with the planes facing the eye position given rather than a
   // viewing direction
-  BSPBuilder(FragmentVector& fragvec, Vec3 viewdirn);
+  BSPBuilder(FragmentVector& fragvec, const IdxVector& idxs,
+             const Vec3& eye);
+
+  // empty tree
+  BSPBuilder() {}
 
   // return a vector of fragment indexes in drawing order
   IdxVector getFragmentIdxs(const FragmentVector& fragvec) const;
 
+  // The tree can also be reused for any viewing position, if the
+  // fragments are not modified. This returns the fragment indexes
+  // in drawing order for an eye position in the coordinates of the
+  // fragments. Fragments from extrastart onwards (which are not in
+  // the tree) are split by the planes of the tree and drawn amongst
+  // the others. Where extra fragments end up in the same part of the
+  // tree, they are ordered by a tree of their own.
+  IdxVector getFragmentIdxs(FragmentVector& fragvec, const Vec3& eye,
+                            unsigned extrastart) const;
+
   // the nodes in the tree
   std::vector<BSPRecord> bsp_recs;
   // vector of indices to the fragments vector
   IdxVector frag_idxs;
+
+  BSPStats stats;
+
+private:
+  void build(FragmentVector& fragvec, IdxVector& to_process, Vec3 viewdirn,
+             const Vec3* eye, unsigned planesamples);
 };
 
 
@@ -16,7 +16,11 @@
 //    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 /////////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
+#include <cmath>
+#include <vector>
 #include "clipcontainer.h"
+#include "parallel.h"
 
 #define EPS 1e-8
 
@@ -55,7 +59,7 @@ namespace
     unsigned bad[3];
     for(unsigned i=0; i<3; ++i)
       {
-        dotv[i] = dot(f.points[i]-onplane, normal);
+        dotv[i] = dot(f.point(v.vertices, i)-onplane, normal);
         bad[i] = dotv[i] < -EPS;
       }
     unsigned badsum = bad[0]+bad[1]+bad[2];
@@ -69,6 +73,7 @@ namespace
         // two points are good, one is bad
         {
           unsigned badidx = bad[0] ? 0 : bad[1] ? 1 : 2;
+          f.unindex(v.vertices);
 
           // calculate where vectors from good to bad points
           // intercept plane
@@ -99,6 +104,7 @@ namespace
         // one point is ok, the other two are bad
         {
           unsigned goodidx = !bad[0] ? 0 : !bad[1] ? 1 : 2;
+          f.unindex(v.vertices);
 
           // work out where vectors from ok point intercept with plane
           Vec3 linevec1 = f.points[(goodidx+1)%3] - f.points[goodidx];
@@ -117,12 +123,11 @@ namespace
       }
   }
 
-  // clip all fragments to the plane given
-  void clipFragments(FragmentVector& v, unsigned start,
+  // clip fragments start to end-1 to the plane given
+  void clipFragments(FragmentVector& v, unsigned start, unsigned end,
                      const Vec3& onplane, const Vec3& normal)
   {
-    unsigned nfrags = v.size();
-    for(unsigned i=start; i<nfrags; ++i)
+    for(unsigned i=start; i<end; ++i)
       {
         Fragment& f = v[i];
         switch(f.type)
@@ -147,37 +152,142 @@ namespace
       }
   }
 
+  typedef std::vector< std::pair<unsigned,unsigned> > RangeVector;
+
+  // clip fragments in the ranges given (start and end index), and
+  // those added after them, to the box given, where outerM converts
+  // box coordinates to those of the fragments
+  void clipToBox(FragmentVector& v, const RangeVector& ranges,
+                 const Vec3& minpt, const Vec3& maxpt, const Mat4& outerM)
+  {
+    if(ranges.empty())
+      return;
+
+    // these are the points defining the clipping cube
+    Vec3 pts[8];
+    pts[0] = minpt;
+    pts[1] = Vec3(minpt(0), minpt(1), maxpt(2));
+    pts[2] = Vec3(minpt(0), maxpt(1), minpt(2));
+    pts[3] = Vec3(minpt(0), maxpt(1), maxpt(2));
+    pts[4] = Vec3(maxpt(0), minpt(1), minpt(2));
+    pts[5] = Vec3(maxpt(0), minpt(1), maxpt(2));
+    pts[6] = Vec3(maxpt(0), maxpt(1), minpt(2));
+    pts[7] = maxpt;
+
+    // convert cube coordinates to outer coordinates
+    for(unsigned i=0; i<8; ++i)
+      pts[i] = vec4to3(outerM*vec3to4(pts[i]));
+
+    // clip with plane point and normal
+    // dotting points with plane with these will give all >= 0 if in cube
+    const Vec3 planes[6][2] = {
+      {pts[0], cross(pts[2]-pts[0], pts[1]-pts[0])},
+      {pts[0], cross(pts[1]-pts[0], pts[4]-pts[0])},
+      {pts[0], cross(pts[4]-pts[0], pts[2]-pts[0])},
+      {pts[7], cross(pts[5]-pts[7], pts[3]-pts[7])},
+      {pts[7], cross(pts[3]-pts[7], pts[6]-pts[7])},
+      {pts[7], cross(pts[6]-pts[7], pts[5]-pts[7])}
+    };
+
+    // triangles split by a plane add fragments at the end, which are
+    // clipped by the following planes
+    const unsigned addedstart = v.size();
+    for(unsigned pi=0; pi<6; ++pi)
+      {
+        const unsigned addedend = v.size();
+        for(const auto& range : ranges)
+          clipFragments(v, range.first, range.second,
+                        planes[pi][0], planes[pi][1]);
+        clipFragments(v, addedstart, addedend, planes[pi][0], planes[pi][1]);
+      }
+  }
+
 } // namespace
 
 
-void ClipContainer::getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v)
+void ClipContainer::getVisibleFragments(const Mat4& perspM, const Mat4& outerM,
+                                        const Frustum& frustum,
+                                        FragmentVector& v)
 {
-  // get fragments for children (and range in vector)
-  const unsigned fragstart = v.size();
+  // Note: children use the same coordinates as the clipping box. This
+  // is expanded slightly, as points just outside are not clipped.
+  Bounds3 clipbox(minpt, maxpt);
+  for(unsigned i=0; i<3; ++i)
+    {
+      const double delta = EPS*std::max(1., std::abs(maxpt(i)-minpt(i)));
+      clipbox.minpt(i) -= delta;
+      clipbox.maxpt(i) += delta;
+    }
+  if(!frustum.mayContain(clipbox, outerM))
+    return;
+
+  // skip children entirely outside the box, and note which are
+  // entirely inside it, as they do not need clipping
+  std::vector<Object*> objs;
+  std::vector<char> inside;
   for(unsigned i=0, s=objects.size(); i<s; ++i)
-    objects[i]->getFragments(perspM, outerM, v);
-
-  // these are the points defining the clipping cube
-  Vec3 pts[8];
-  pts[0] = minpt;
-  pts[1] = Vec3(minpt(0), minpt(1), maxpt(2));
-  pts[2] = Vec3(minpt(0), maxpt(1), minpt(2));
-  pts[3] = Vec3(minpt(0), maxpt(1), maxpt(2));
-  pts[4] = Vec3(maxpt(0), minpt(1), minpt(2));
-  pts[5] = Vec3(maxpt(0), minpt(1), maxpt(2));
-  pts[6] = Vec3(maxpt(0), maxpt(1), minpt(2));
-  pts[7] = maxpt;
-
-  // convert cube coordinates to outer coordinates
-  for(unsigned i=0; i<8; ++i)
-    pts[i] = vec4to3(outerM*vec3to4(pts[i]));
-
-  // clip with plane point and normal
-  // dotting points with plane with these will give all >= 0 if in cube
-  clipFragments(v, fragstart, pts[0], cross(pts[2]-pts[0], pts[1]-pts[0]));
-  clipFragments(v, fragstart, pts[0], cross(pts[1]-pts[0], pts[4]-pts[0]));
-  clipFragments(v, fragstart, pts[0], cross(pts[4]-pts[0], pts[2]-pts[0]));
-  clipFragments(v, fragstart, pts[7], cross(pts[5]-pts[7], pts[3]-pts[7]));
-  clipFragments(v, fragstart, pts[7], cross(pts[3]-pts[7], pts[6]-pts[7]));
-  clipFragments(v, fragstart, pts[7], cross(pts[6]-pts[7], pts[5]-pts[7]));
+    {
+      const Bounds3 b = objects[i]->getBounds();
+      if(clipbox.intersects(b))
+        {
+          objs.push_back(objects[i]);
+          inside.push_back(clipbox.contains(b));
+        }
+    }
+
+  // get fragments for children in order, in parallel if possible,
+  // counting the number from each
+  const unsigned fragstart = v.size();
+  const unsigned s = objs.size();
+  std::vector<unsigned> counts(s);
+  const unsigned nchunks = numChunks(s, 1);
+  parallelFragments(v, nchunks, [&](unsigned chunk, FragmentVector& out)
+    {
+      const unsigned end = chunkBegin(s, chunk+1, nchunks);
+      for(unsigned i=chunkBegin(s, chunk, nchunks); i<end; ++i)
+        {
+          const unsigned start = out.size();
+          objs[i]->getVisibleFragments(perspM, outerM, frustum, out);
+          counts[i] = out.size()-start;
+        }
+    });
+
+  // clip the ranges of fragments of children not inside the box
+  RangeVector ranges;
+  unsigned idx = fragstart;
+  for(unsigned i=0; i<s; ++i)
+    {
+      if(!inside[i] && counts[i] > 0)
+        ranges.push_back(std::make_pair(idx, idx+counts[i]));
+      idx += counts[i];
+    }
+
+  clipToBox(v, ranges, minpt, maxpt, outerM);
+}
+
+void ClipContainer::getFragmentsByView(const Mat4& perspM, const Mat4& outerM,
+                                       bool viewdep, const Frustum& frustum,
+                                       FragmentVector& v)
+{
+  // Note: as above, children use the same coordinates as the box
+  const unsigned fragstart = v.size();
+  const unsigned s = objects.size();
+  const unsigned nchunks = numChunks(s, 1);
+  parallelFragments(v, nchunks, [&](unsigned chunk, FragmentVector& out)
+    {
+      const unsigned end = chunkBegin(s, chunk+1, nchunks);
+      for(unsigned i=chunkBegin(s, chunk, nchunks); i<end; ++i)
+        objects[i]->getFragmentsByView(perspM, outerM, viewdep, frustum, out);
+    });
+
+  clipToBox(v, RangeVector(1, std::make_pair(fragstart, unsigned(v.size()))),
+            minpt, maxpt, outerM);
+}
+
+Bounds3 ClipContainer::getBounds()
+{
+  Bounds3 b;
+  for(auto &object : objects)
+    b.extend(object->getBounds());
+  return b.intersection(Bounds3(minpt, maxpt));
 }
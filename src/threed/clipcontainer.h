@@ -33,7 +33,16 @@ public:
   {
   }
 
-  void getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
+  void getVisibleFragments(const Mat4& perspM, const Mat4& outerM,
+                           const Frustum& frustum, FragmentVector& v);
+  void getFragmentsByView(const Mat4& perspM, const Mat4& outerM,
+                          bool viewdep, const Frustum& frustum,
+                          FragmentVector& v);
+
+  // bounds of children within clipping box
+  Bounds3 getBounds();
+
+  bool reusableAsRoot() const { return false; }
 
   bool pointInBounds(Vec3 pt) const
   {
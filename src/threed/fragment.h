@@ -59,8 +59,13 @@ struct Fragment
 {
   enum FragmentType {FR_NONE, FR_TRIANGLE, FR_LINESEG, FR_PATH};
 
-  // 3D points
-  Vec3 points[3];
+  // 3D points, or if indexed is set, indices of the points in the
+  // vertices shared between fragments in the FragmentVector
+  union
+  {
+    Vec3 points[3];
+    unsigned vertidx[3];
+  };
 
   // projected points associated with fragment
   Vec3 proj[3];
@@ -92,9 +97,13 @@ struct Fragment
   // use calculated color
   bool usecalccolor;
 
+  // points are given by vertidx (only used for triangles)
+  bool indexed;
+
   // zero on creation
   Fragment()
-    : object(0),
+    : points(),
+      object(0),
       params(0),
       surfaceprop(0),
       lineprop(0),
@@ -103,8 +112,29 @@ struct Fragment
       splitcount(0),
       index(0),
       type(FR_NONE),
-      usecalccolor(0)
+      usecalccolor(0),
+      indexed(0)
+  {
+  }
+
+  // get a 3D point, looking up indexed points in the shared vertices
+  const Vec3& point(const Vec3Vector& verts, unsigned i) const
   {
+    return indexed ? verts[vertidx[i]] : points[i];
+  }
+
+  // copy indexed points from the shared vertices, so they can be
+  // modified
+  void unindex(const Vec3Vector& verts)
+  {
+    if(indexed)
+      {
+        const unsigned i0=vertidx[0], i1=vertidx[1], i2=vertidx[2];
+        points[0] = verts[i0];
+        points[1] = verts[i1];
+        points[2] = verts[i2];
+        indexed = false;
+      }
   }
 
   // number of (visible) points used by fragment type
@@ -176,11 +206,11 @@ struct Fragment
   }
 
   // recalculate projected coordinates
-  void updateProjCoords(const Mat4& projM)
+  void updateProjCoords(const Mat4& projM, const Vec3Vector& verts)
   {
     unsigned n=nPointsTotal();
     for(unsigned i=0; i<n; ++i)
-      proj[i] = calcProjVec(projM, points[i]);
+      proj[i] = calcProjVec(projM, point(verts, i));
   }
 
   // is fragment visible based on transparency?
@@ -203,7 +233,23 @@ struct Fragment
 
 };
 
-typedef std::vector<Fragment> FragmentVector;
+// shared vertex made by splitting the edge between two others
+struct SplitVertex
+{
+  unsigned idx;                 // index of new vertex
+  unsigned v1, v2;              // vertices at the ends of the edge
+  double frac;                  // fraction of the way from v1 to v2
+};
+
+// Fragments, with vertices which may be shared between them. Sharing
+// vertices avoids storing and projecting the same point several
+// times.
+struct FragmentVector : public std::vector<Fragment>
+{
+  Vec3Vector vertices;
+  // vertices made by splitting, in the order they were added
+  std::vector<SplitVertex> splitvertices;
+};
 
 
 #endif
@@ -21,6 +21,11 @@
 #include <limits>
 #include "mmaths.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MMATHS_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
 Mat4 rotateM4(double angle, Vec3 vec)
 {
   double c = std::cos(angle);
@@ -68,3 +73,119 @@ Mat4 translationM4(Vec3 vec)
 
   return m;
 }
+
+Mat4 invertAffineM4(const Mat4& m)
+{
+  // inverse of 3x3 part from cofactors
+  const double c00 = m(1,1)*m(2,2)-m(1,2)*m(2,1);
+  const double c01 = m(1,2)*m(2,0)-m(1,0)*m(2,2);
+  const double c02 = m(1,0)*m(2,1)-m(1,1)*m(2,0);
+  const double invdet = 1/(m(0,0)*c00 + m(0,1)*c01 + m(0,2)*c02);
+
+  Mat4 r;
+  r(0,0) = c00*invdet;
+  r(0,1) = (m(0,2)*m(2,1)-m(0,1)*m(2,2))*invdet;
+  r(0,2) = (m(0,1)*m(1,2)-m(0,2)*m(1,1))*invdet;
+  r(1,0) = c01*invdet;
+  r(1,1) = (m(0,0)*m(2,2)-m(0,2)*m(2,0))*invdet;
+  r(1,2) = (m(0,2)*m(1,0)-m(0,0)*m(1,2))*invdet;
+  r(2,0) = c02*invdet;
+  r(2,1) = (m(0,1)*m(2,0)-m(0,0)*m(2,1))*invdet;
+  r(2,2) = (m(0,0)*m(1,1)-m(0,1)*m(1,0))*invdet;
+
+  // then the inverse translation
+  for(unsigned i=0; i<3; ++i)
+    r(i,3) = -(r(i,0)*m(0,3) + r(i,1)*m(1,3) + r(i,2)*m(2,3));
+  r(3,3) = 1;
+
+  return r;
+}
+
+namespace
+{
+  void transformPointsScalar(const Mat4& M, unsigned n,
+                             const double* x, const double* y, const double* z,
+                             Vec3* out)
+  {
+    for(unsigned i=0; i<n; ++i)
+      out[i] = vec4to3(M*Vec4(x[i], y[i], z[i], 1));
+  }
+
+#ifdef MMATHS_X86_DISPATCH
+  // Four points at a time. Separate multiplies and adds are used in
+  // the same order as the scalar code, rather than fused
+  // multiply-adds, so the results do not depend on the CPU.
+  __attribute__((target("avx2")))
+  void transformPointsAVX2(const Mat4& M, unsigned n,
+                           const double* x, const double* y, const double* z,
+                           Vec3* out)
+  {
+    __m256d m[4][4];
+    for(unsigned r=0; r<4; ++r)
+      for(unsigned c=0; c<4; ++c)
+        m[r][c] = _mm256_set1_pd(M(r,c));
+    const __m256d one = _mm256_set1_pd(1);
+
+    alignas(32) double res[3][4];
+    unsigned i=0;
+    for(; i+4<=n; i+=4)
+      {
+        const __m256d vx = _mm256_loadu_pd(x+i);
+        const __m256d vy = _mm256_loadu_pd(y+i);
+        const __m256d vz = _mm256_loadu_pd(z+i);
+
+        __m256d row[4];
+        for(unsigned r=0; r<4; ++r)
+          row[r] = _mm256_add_pd(
+            _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(vx, m[r][0]),
+                                        _mm256_mul_pd(vy, m[r][1])),
+                          _mm256_mul_pd(vz, m[r][2])),
+            m[r][3]);
+
+        const __m256d inv = _mm256_div_pd(one, row[3]);
+        for(unsigned r=0; r<3; ++r)
+          _mm256_store_pd(res[r], _mm256_mul_pd(row[r], inv));
+
+        for(unsigned j=0; j<4; ++j)
+          {
+            out[i+j](0) = res[0][j];
+            out[i+j](1) = res[1][j];
+            out[i+j](2) = res[2][j];
+          }
+      }
+
+    transformPointsScalar(M, n-i, x+i, y+i, z+i, out+i);
+  }
+#endif
+
+  bool simdkernels = true;
+}
+
+bool simdKernels()
+{
+#ifdef MMATHS_X86_DISPATCH
+  static const bool hasavx2 = __builtin_cpu_supports("avx2");
+  return hasavx2 && simdkernels;
+#else
+  return false;
+#endif
+}
+
+void setSIMDKernels(bool enable)
+{
+  simdkernels = enable;
+}
+
+void transformPoints(const Mat4& M, unsigned n,
+                     const double* x, const double* y, const double* z,
+                     Vec3* out)
+{
+#ifdef MMATHS_X86_DISPATCH
+  if(simdKernels())
+    {
+      transformPointsAVX2(M, n, x, y, z, out);
+      return;
+    }
+#endif
+  transformPointsScalar(M, n, x, y, z, out);
+}
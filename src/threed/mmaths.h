@@ -208,6 +208,18 @@ struct Mat4
 		v(0)*m[3][0]+v(1)*m[3][1]+v(2)*m[3][2]+v(3)*m[3][3]);
   }
 
+  inline bool operator==(const Mat4& o) const
+  {
+    for(unsigned y=0; y<4; ++y)
+      for(unsigned x=0; x<4; ++x)
+	if(m[y][x] != o.m[y][x])
+	  return false;
+    return true;
+  }
+  inline bool operator!=(const Mat4& o) const
+  {
+    return !(operator==(o));
+  }
 
   inline Mat4 transpose() const
   {
@@ -248,6 +260,9 @@ Mat4 rotateM4(double angle, Vec3 vec);
 // create a translation matrix
 Mat4 translationM4(Vec3 vec);
 
+// inverse of a matrix with a bottom row of (0,0,0,1)
+Mat4 invertAffineM4(const Mat4& m);
+
 // create a scaling matrix
 inline Mat4 scaleM4(Vec3 s)
 {
@@ -486,6 +501,19 @@ inline Vec3 calcProjVec(const Mat4& projM, const Vec3& v)
   return Vec3(nv(0)*inv, nv(1)*inv, nv(2)*inv);
 }
 
+// Transform n points with coordinates in x, y and z by M, dividing
+// by w to give out. This gives the same results as
+// vec4to3(M*Vec4(x[i],y[i],z[i],1)), but is faster for many points.
+void transformPoints(const Mat4& M, unsigned n,
+                     const double* x, const double* y, const double* z,
+                     Vec3* out);
+
+// Whether the batched kernels (transformPoints and the lighting in
+// Scene) use AVX2, which is the case if the CPU supports it unless
+// disabled to compare with the scalar code.
+bool simdKernels();
+void setSIMDKernels(bool enable);
+
 // convert projected coordinates to screen coordinates using screen matrix
 // makes (x,y,depth) -> screen coordinates
 inline Vec2 projVecToScreen(const Mat3& screenM, const Vec3& vec)
@@ -55,10 +55,7 @@ ValVector numpyToValVector(PyObject* obj)
   const double* data = (double*)PyArray_DATA(arrayobj);
   unsigned dim = PyArray_DIMS(arrayobj)[0];
 
-  ValVector out;
-  out.reserve(dim);
-  for(unsigned i=0; i<dim; ++i)
-    out.push_back(data[i]);
+  ValVector out(data, data+dim);
 
   Py_DECREF((PyObject*)arrayobj);
 
@@ -17,20 +17,70 @@
 /////////////////////////////////////////////////////////////////////////////
 
 #include <algorithm>
+#include <atomic>
 #include <cstdio>
 #include <cmath>
 #include <limits>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
 #include "objects.h"
+#include "parallel.h"
 #include "twod.h"
 
+namespace
+{
+  // source of change stamps, so that stamps are unique over all objects
+  std::atomic<unsigned long long> changecounter(0);
+}
+
 Object::~Object()
 {
 }
 
+unsigned long long Object::nextChangeStamp()
+{
+  return ++changecounter;
+}
+
 void Object::getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v)
 {
 }
 
+void Object::getVisibleFragments(const Mat4& perspM, const Mat4& outerM,
+                                 const Frustum& frustum, FragmentVector& v)
+{
+  if(frustum.mayContain(getBounds(), outerM))
+    getFragments(perspM, outerM, v);
+}
+
+void Object::getFragmentsByView(const Mat4& perspM, const Mat4& outerM,
+                                bool viewdep, const Frustum& frustum,
+                                FragmentVector& v)
+{
+  if(isViewDependent() != viewdep)
+    return;
+  if(viewdep)
+    getVisibleFragments(perspM, outerM, frustum, v);
+  else
+    getFragments(perspM, outerM, v);
+}
+
+Bounds3 Object::getBounds()
+{
+  if(!boundscached)
+    {
+      cachedbounds = calcBounds();
+      boundscached = true;
+    }
+  return cachedbounds;
+}
+
+Bounds3 Object::calcBounds()
+{
+  return Bounds3::unbounded();
+}
+
 void Object::assignWidgetId(unsigned long long id)
 {
   widgetid = id;
@@ -52,6 +102,14 @@ void Triangle::getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVect
   v.push_back(f);
 }
 
+Bounds3 Triangle::calcBounds()
+{
+  Bounds3 b;
+  for(unsigned i=0; i<3; ++i)
+    b.extend(points[i]);
+  return b;
+}
+
 // PolyLine
 ///////////
 
@@ -61,6 +119,15 @@ void PolyLine::addPoints(const ValVector& x, const ValVector& y, const ValVector
   points.reserve(points.size()+size);
   for(unsigned i=0; i<size; ++i)
     points.push_back(Vec3(x[i], y[i], z[i]));
+  invalidateBounds();
+}
+
+Bounds3 PolyLine::calcBounds()
+{
+  Bounds3 b;
+  for(const auto& pt : points)
+    b.extend(pt);
+  return b;
 }
 
 void PolyLine::getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v)
@@ -131,6 +198,14 @@ void LineSegments::getFragments(const Mat4& perspM, const Mat4& outerM, Fragment
     }
 }
 
+Bounds3 LineSegments::calcBounds()
+{
+  Bounds3 b;
+  for(const auto& pt : points)
+    b.extend(pt);
+  return b;
+}
+
 // Mesh
 ///////
 
@@ -151,71 +226,99 @@ void Mesh::getVecIdxs(unsigned &vidx_h, unsigned &vidx_1, unsigned &vidx_2) cons
 
 void Mesh::getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v)
 {
-  getLineFragments(perspM, outerM, v);
-  getSurfaceFragments(perspM, outerM, v);
+  if(lineprop.ptr() == 0 && surfaceprop.ptr() == 0)
+    return;
+
+  // points are shared by the lines and neighbouring triangles
+  Vec3Vector verts;
+  getVertices(outerM, verts);
+
+  getLineFragments(verts, v);
+  getSurfaceFragments(verts, v);
 }
 
-void Mesh::getLineFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v)
+Bounds3 Mesh::calcBounds()
 {
-  if(lineprop.ptr() == 0)
-    return;
+  unsigned vidx_h, vidx_1, vidx_2;
+  getVecIdxs(vidx_h, vidx_1, vidx_2);
 
+  Bounds3 b;
+  b.extendAxis(vidx_h, heights);
+  b.extendAxis(vidx_1, pos1);
+  b.extendAxis(vidx_2, pos2);
+  return b;
+}
+
+void Mesh::getVertices(const Mat4& outerM, Vec3Vector& verts) const
+{
   unsigned vidx_h, vidx_1, vidx_2;
   getVecIdxs(vidx_h, vidx_1, vidx_2);
 
+  const unsigned n1 = pos1.size();
+  const unsigned n2 = pos2.size();
+  verts.resize(n1*n2);
+
+  // transform each row, where pos1 is constant
+  ValVector rowpos1(n2);
+  const double* coords[3];
+  coords[vidx_2] = pos2.data();
+  coords[vidx_1] = rowpos1.data();
+  for(unsigned i1=0; i1<n1; ++i1)
+    {
+      std::fill(rowpos1.begin(), rowpos1.end(), pos1[i1]);
+      coords[vidx_h] = heights.data()+i1*n2;
+      transformPoints(outerM, n2, coords[0], coords[1], coords[2],
+                      verts.data()+i1*n2);
+    }
+}
+
+void Mesh::getLineFragments(const Vec3Vector& verts, FragmentVector& v)
+{
+  if(lineprop.ptr() == 0)
+    return;
+
   Fragment fl;
   fl.type = Fragment::FR_LINESEG;
   fl.surfaceprop = 0;
   fl.lineprop = lineprop.ptr();
   fl.object = this;
 
+  const unsigned n1 = pos1.size();
   const unsigned n2 = pos2.size();
-  Vec4 pt(0,0,0,1);
 
   for(unsigned stepindex=0; stepindex<=1; ++stepindex)
     {
       if(hidehorzline && stepindex==0) continue;
       if(hidevertline && stepindex==1) continue;
 
-      const ValVector& vec_step = stepindex==0 ? pos1 : pos2;
-      const ValVector& vec_const = stepindex==0 ? pos2 : pos1;
-      const unsigned vidx_step = stepindex==0 ? vidx_1 : vidx_2;
-      const unsigned vidx_const = stepindex==0 ? vidx_2 : vidx_1;
-
-      for(unsigned consti=0; consti<vec_const.size(); ++consti)
-        {
-          pt(vidx_const) = vec_const[consti];
-          for(unsigned stepi=0; stepi<vec_step.size(); ++stepi)
-            {
-              double heightsval = heights[stepindex==0 ? stepi*n2+consti : consti*n2+stepi];
-              pt(vidx_step) = vec_step[stepi];
-              pt(vidx_h) = heightsval;
+      const unsigned nstep = stepindex==0 ? n1 : n2;
+      const unsigned nconst = stepindex==0 ? n2 : n1;
 
-              // shuffle new to old positions and calculate new new
-              fl.points[1] = fl.points[0];
-              fl.points[0] = vec4to3(outerM*pt);
+      for(unsigned consti=0; consti<nconst; ++consti)
+        for(unsigned stepi=0; stepi<nstep; ++stepi)
+          {
+            // shuffle new to old positions and get new new
+            fl.points[1] = fl.points[0];
+            fl.points[0] = verts[stepindex==0 ? stepi*n2+consti : consti*n2+stepi];
 
-              if(stepi > 0 && (fl.points[0]+fl.points[1]).isfinite())
-                v.push_back(fl);
-              ++fl.index;
-            }
-        }
+            if(stepi > 0 && (fl.points[0]+fl.points[1]).isfinite())
+              v.push_back(fl);
+            ++fl.index;
+          }
     }
 }
 
-void Mesh::getSurfaceFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v)
+void Mesh::getSurfaceFragments(const Vec3Vector& verts, FragmentVector& v)
 {
   if(surfaceprop.ptr() == 0)
     return;
 
-  unsigned vidx_h, vidx_1, vidx_2;
-  getVecIdxs(vidx_h, vidx_1, vidx_2);
-
   Fragment fs;
   fs.type = Fragment::FR_TRIANGLE;
   fs.surfaceprop = surfaceprop.ptr();
   fs.lineprop = 0;
   fs.object = this;
+  fs.indexed = true;
 
   // for each grid point we alternatively draw one of two sets of
   // triangles, to make a symmetric diamond pattern, which looks
@@ -225,37 +328,54 @@ void Mesh::getSurfaceFragments(const Mat4& perspM, const Mat4& outerM, FragmentV
 
   const unsigned n1 = pos1.size();
   const unsigned n2 = pos2.size();
+  if(n1 < 2 || n2 < 2)
+    return;
 
-  Vec4 p[4];
-  Vec3 pproj[4];
-  p[0](3) = p[1](3) = p[2](3) = p[3](3) = 1;
-  for(unsigned i1=0; (i1+1)<n1; ++i1)
-    for(unsigned i2=0; (i2+1)<n2; ++i2)
-      {
-        // update coordinates of corners of square and project
-        for(unsigned i=0; i<4; ++i)
-          {
-            unsigned j1 = i1+i%2, j2 = i2+i/2;
-            p[i](vidx_h) = heights[j1*n2+j2];
-            p[i](vidx_1) = pos1[j1];
-            p[i](vidx_2) = pos2[j2];
-            pproj[i] = vec4to3(outerM*p[i]);
-          }
+  // triangles share the vertices, including those on the rows
+  // between bands
+  const unsigned vbase = v.vertices.size();
+  v.vertices.insert(v.vertices.end(), verts.begin(), verts.end());
+
+  // process bands of rows, possibly in parallel
+  const unsigned nrows = n1-1;
+  const unsigned nchunks = numChunks(nrows, PARALLEL_MIN_ITEMS/n2+1);
+  parallelFragments(v, nchunks, [&](unsigned chunk, FragmentVector& out)
+    {
+      const unsigned row1 = chunkBegin(nrows, chunk, nchunks);
+      const unsigned row2 = chunkBegin(nrows, chunk+1, nchunks);
+
+      Fragment f(fs);
+      f.index = row1*(n2-1);
 
-        // add two triangles, using indices of corners
-        for(unsigned tri=0; tri<2; ++tri)
+      unsigned vidx[4];
+      bool finite[4];
+      for(unsigned i1=row1; i1<row2; ++i1)
+        for(unsigned i2=0; (i2+1)<n2; ++i2)
           {
-            const unsigned *idxs = tidxs[(i1+i2)%2][tri];
-            if( (p[idxs[0]]+p[idxs[1]]+p[idxs[2]]).isfinite() )
+            // corners of square
+            for(unsigned i=0; i<4; ++i)
               {
-                for(unsigned i=0; i<3; ++i)
-                  fs.points[i] = pproj[idxs[i]];
-                v.push_back(fs);
+                unsigned j1 = i1+i%2, j2 = i2+i/2;
+                vidx[i] = j1*n2+j2;
+                finite[i] = std::isfinite(heights[vidx[i]]) &&
+                  std::isfinite(pos1[j1]) && std::isfinite(pos2[j2]);
               }
-          }
 
-        ++fs.index;
-      }
+            // add two triangles, using indices of corners
+            for(unsigned tri=0; tri<2; ++tri)
+              {
+                const unsigned *idxs = tidxs[(i1+i2)%2][tri];
+                if( finite[idxs[0]] && finite[idxs[1]] && finite[idxs[2]] )
+                  {
+                    for(unsigned i=0; i<3; ++i)
+                      f.vertidx[i] = vbase + vidx[idxs[i]];
+                    out.push_back(f);
+                  }
+              }
+
+            ++f.index;
+          }
+    }, true);
 }
 
 // DataMesh
@@ -290,22 +410,23 @@ namespace
 #define MAXLINEIDX 4
   struct LineCellTracker
   {
-    LineCellTracker(unsigned _n1, unsigned _n2)
-      : n1(_n1), n2(_n2), data(n1*n2*MAXLINEIDX, 0)
+    // grid points are tracked for n1 rows starting at row0
+    LineCellTracker(unsigned _row0, unsigned _n1, unsigned _n2)
+      : row0(_row0), n1(_n1), n2(_n2), data(n1*n2*MAXLINEIDX, 0)
     {
     }
 
     void setLine(unsigned i1, unsigned i2, unsigned lineidx)
     {
-      data[(i1*n2+i2)*MAXLINEIDX+lineidx] = 1;
+      data[((i1-row0)*n2+i2)*MAXLINEIDX+lineidx] = 1;
     }
 
     bool isLineSet(unsigned i1, unsigned i2, unsigned lineidx) const
     {
-      return data[(i1*n2+i2)*MAXLINEIDX+lineidx];
+      return data[((i1-row0)*n2+i2)*MAXLINEIDX+lineidx];
     }
 
-    unsigned n1, n2;
+    unsigned row0, n1, n2;
     std::vector<char> data;
   };
 };
@@ -335,19 +456,6 @@ void DataMesh::getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVect
   if( lineprop.ptr()==0 && surfaceprop.ptr()==0 )
     return;
 
-  // used to draw the grid and surface
-  Fragment ft;
-  ft.type = Fragment::FR_TRIANGLE;
-  ft.surfaceprop = surfaceprop.ptr();
-  ft.lineprop = 0;
-  ft.object = this;
-
-  Fragment fl;
-  fl.type = Fragment::FR_LINESEG;
-  fl.surfaceprop = 0;
-  fl.lineprop = lineprop.ptr();
-  fl.object = this;
-
   // these are the corner indices used for drawing low and high resolution surfaces
   static const unsigned trilist_highres[8][3]  = {
     {8,0,1},{8,1,2},{8,2,3},{8,3,4},{8,4,5},{8,5,6},{8,6,7},{8,7,0}};
@@ -382,150 +490,224 @@ void DataMesh::getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVect
   const unsigned ntris = highres ? 8 : 2;
   const unsigned nlines = highres ? 8 : 4;
 
-  // store corners and neighbouring cell values
-  double neigh[9];
-  Vec4 corners[9];   // 4d corners
-  for(unsigned i=0; i<9; ++i)
-    corners[i](3) = 1;
-  Vec3 corners3[9];  // 3d version of above
-
-  // don't draw lines twice by keeping track if which edges of which
-  // cells have been drawn already
-  LineCellTracker linetracker(edges1.size(), edges2.size());
+  // "corners" are the clockwise corners and edge centres from the top
+  // left, followed by the cell centre. These are their positions in
+  // half cells. Low resolution only uses the corners.
+  static const unsigned cornerposn[9][2] = {
+    {0,0}, {1,0}, {2,0}, {2,1}, {2,2}, {1,2}, {0,2}, {0,1}, {1,1}
+  };
+  const unsigned res = highres ? 2 : 1;
 
   const int n1=int(edges1.size())-1;
   const int n2=int(edges2.size())-1;
+  if(n1 <= 0 || n2 <= 0)
+    return;
 
-  // loop over 2d array
-  for(int i1=0; i1<n1; ++i1)
-    for(int i2=0; i2<n2; ++i2)
-      {
-        // skip bad data values
-        if( ! std::isfinite(vals[i1*n2+i2]) )
-          continue;
-
-        // get values of neighbouring cells (clipping at edges)
-        // -1,-1 -1,0 -1,1   0,-1 0,0 0,1   1,-1 1,0 1,1
-        for(int d1=-1; d1<=1; ++d1)
-          for(int d2=-1; d2<=1; ++d2)
-            {
-              int clip1 = std::max(std::min(i1+d1, n1-1), 0);
-              int clip2 = std::max(std::min(i2+d2, n2-1), 0);
-              double val = vals[clip1*n2+clip2];
-              neigh[(d1+1)*3+(d2+1)] = val;
-            }
-
-        // compute "corners" - these are the clockwise corners and
-        // edge centres from the top left (d1==d2==-1), followed by
-        // the cell centre
-        corners[0](idxs[0]) = average4(neigh[0],neigh[3],neigh[4],neigh[1]);
-        corners[0](idxs[1]) = edges1[i1];
-        corners[0](idxs[2]) = edges2[i2];
-
-        corners[1](idxs[0]) = average2(neigh[4],neigh[3]);
-        corners[1](idxs[1]) = 0.5*(edges1[i1]+edges1[i1+1]);
-        corners[1](idxs[2]) = edges2[i2];
-
-        corners[2](idxs[0]) = average4(neigh[3],neigh[6],neigh[7],neigh[4]);
-        corners[2](idxs[1]) = edges1[i1+1];
-        corners[2](idxs[2]) = edges2[i2];
-
-        corners[3](idxs[0]) = average2(neigh[4],neigh[7]);
-        corners[3](idxs[1]) = edges1[i1+1];
-        corners[3](idxs[2]) = 0.5*(edges2[i2]+edges2[i2+1]);
+  // corners are shared with neighbouring cells, so are transformed
+  // once, in bands of rows (possibly in parallel)
+  const unsigned gn2 = res*n2+1;
+  Vec3Vector verts((res*n1+1)*gn2);
+  const unsigned nchunks = numChunks(n1, PARALLEL_MIN_ITEMS/n2+1);
+  parallelChunks(nchunks, [&](unsigned chunk)
+    {
+      const int row1 = chunkBegin(n1, chunk, nchunks);
+      const int row2 = chunkBegin(n1, chunk+1, nchunks);
+      Vec3Vector bandverts;
+      getVertices(outerM, row1, row2, res, bandverts);
+
+      // the last row is the first of the next band
+      const unsigned nrows = res*(row2-row1) + (row2==n1 ? 1 : 0);
+      std::copy(bandverts.begin(), bandverts.begin()+nrows*gn2,
+                verts.begin()+res*row1*gn2);
+    });
+
+  // triangles share the vertices, including those on the rows
+  // between bands
+  const unsigned vbase = v.vertices.size();
+  if(surfaceprop.ptr()!=0)
+    v.vertices.insert(v.vertices.end(), verts.begin(), verts.end());
+
+  // process bands of rows, possibly in parallel
+  parallelFragments(v, nchunks, [&](unsigned chunk, FragmentVector& out)
+    {
+      const int row1 = chunkBegin(n1, chunk, nchunks);
+      const int row2 = chunkBegin(n1, chunk+1, nchunks);
+
+      // used to draw the grid and surface
+      Fragment ft;
+      ft.type = Fragment::FR_TRIANGLE;
+      ft.surfaceprop = surfaceprop.ptr();
+      ft.lineprop = 0;
+      ft.object = this;
+      ft.indexed = true;
+
+      Fragment fl;
+      fl.type = Fragment::FR_LINESEG;
+      fl.surfaceprop = 0;
+      fl.lineprop = lineprop.ptr();
+      fl.object = this;
+
+      unsigned cornerverts[9];
+      Vec3 corners3[9];
+
+      // don't draw lines twice by keeping track if which edges of which
+      // cells have been drawn already
+      LineCellTracker linetracker(row1, row2-row1+1, edges2.size());
+
+      // lines along the top of the band belong to the previous band
+      if(row1 > 0)
+        for(int i2=0; i2<n2; ++i2)
+          if( std::isfinite(vals[(row1-1)*n2+i2]) )
+            for(unsigned i=0; i<nlines; ++i)
+              if( linecells[i][0]==1 &&
+                  !(hidehorzline && linedirn[i]==0) &&
+                  !(hidevertline && linedirn[i]==1) )
+                linetracker.setLine(row1, i2+linecells[i][1], linecells[i][2]);
+
+      // loop over 2d array
+      for(int i1=row1; i1<row2; ++i1)
+        for(int i2=0; i2<n2; ++i2)
+          {
+            // skip bad data values
+            if( ! std::isfinite(vals[i1*n2+i2]) )
+              continue;
+
+            // look up corners
+            const unsigned base = i1*res*gn2 + i2*res;
+            for(unsigned i=0; i<9; ++i)
+              if(res==2 || (cornerposn[i][0]%2==0 && cornerposn[i][1]%2==0))
+                {
+                  cornerverts[i] = base + cornerposn[i][0]*res/2*gn2 +
+                    cornerposn[i][1]*res/2;
+                  corners3[i] = verts[cornerverts[i]];
+                }
 
-        corners[4](idxs[0]) = average4(neigh[4],neigh[7],neigh[8],neigh[5]);
-        corners[4](idxs[1]) = edges1[i1+1];
-        corners[4](idxs[2]) = edges2[i2+1];
+            // draw triangles
+            if(ft.surfaceprop!=0)
+              {
+                // alternate triangle list to make a symmetric pattern for lowres
+                const unsigned (*tris)[3] = highres ? trilist_highres :
+                  (i1+i2)%2==0 ? trilist_lowres1 : trilist_lowres2;
 
-        corners[5](idxs[0]) = average2(neigh[4],neigh[5]);
-        corners[5](idxs[1]) = 0.5*(edges1[i1]+edges1[i1+1]);
-        corners[5](idxs[2]) = edges2[i2+1];
+                ft.index = i1*n2+i2;
+                for(unsigned i=0; i<ntris; ++i)
+                  {
+                    for(unsigned j=0; j<3; ++j)
+                      ft.vertidx[j] = vbase + cornerverts[tris[i][j]];
+                    out.push_back(ft);
+                  }
+              }
 
-        corners[6](idxs[0]) = average4(neigh[1],neigh[4],neigh[5],neigh[2]);
-        corners[6](idxs[1]) = edges1[i1];
-        corners[6](idxs[2]) = edges2[i2+1];
+            // draw lines (if they haven't been drawn before)
+            if(fl.lineprop!=0)
+              {
+                fl.index = i1*n2+i2;
+                for(unsigned i=0; i<nlines; ++i)
+                  {
+                    // skip lines which are in wrong direction
+                    if( (hidehorzline && linedirn[i]==0) ||
+                        (hidevertline && linedirn[i]==1) )
+                      continue;
+
+                    if(! linetracker.isLineSet(i1+linecells[i][0], i2+linecells[i][1],
+                                               linecells[i][2]))
+                      {
+                        fl.points[0] = corners3[lines[i][0]];
+                        fl.points[1] = corners3[lines[i][1]];
+                        if(fl.points[0].isfinite() && fl.points[1].isfinite())
+                          out.push_back(fl);
+                        linetracker.setLine(i1+linecells[i][0], i2+linecells[i][1],
+                                            linecells[i][2]);
+                      }
+                  }
+              }
+          } // loop over points
+    }, true);
 
-        corners[7](idxs[0]) = average2(neigh[4],neigh[1]);
-        corners[7](idxs[1]) = edges1[i1];
-        corners[7](idxs[2]) = 0.5*(edges2[i2]+edges2[i2+1]);
+}
 
-        corners[8](idxs[0]) = neigh[4];
-        corners[8](idxs[1]) = 0.5*(edges1[i1]+edges1[i1+1]);
-        corners[8](idxs[2]) = 0.5*(edges2[i2]+edges2[i2+1]);
+void DataMesh::getVertices(const Mat4& outerM, int row1, int row2,
+                           unsigned res, Vec3Vector& verts) const
+{
+  const int n1=int(edges1.size())-1;
+  const int n2=int(edges2.size())-1;
 
-        // convert to 3d coordinates
-        for(unsigned i=0; i<9; ++i)
-          corners3[i] = vec4to3(outerM*corners[i]);
+  // value of cell, clipping at edges
+  auto val = [&](int i1, int i2)
+    {
+      return vals[std::max(std::min(i1, n1-1), 0)*n2 +
+                  std::max(std::min(i2, n2-1), 0)];
+    };
 
-        // draw triangles
-        if(ft.surfaceprop!=0)
-          {
-            // alternate triangle list to make a symmetric pattern for lowres
-            const unsigned (*tris)[3] = highres ? trilist_highres :
-              (i1+i2)%2==0 ? trilist_lowres1 : trilist_lowres2;
+  const unsigned gn1 = res*(row2-row1)+1;
+  const unsigned gn2 = res*n2+1;
+  ValVector coords[3];
+  for(unsigned i=0; i<3; ++i)
+    coords[i].resize(gn1*gn2);
+  ValVector& cval = coords[idxval];
+  ValVector& cpos1 = coords[idxedge1];
+  ValVector& cpos2 = coords[idxedge2];
+
+  // positions are in half cells. Corner values are averages of the
+  // cells around them, edge centres of the two cells either side.
+  for(unsigned g1=0; g1<gn1; ++g1)
+    {
+      const int h1 = (res*row1+g1)*(2/res);
+      const int i1 = h1/2;
+      const double pos1 = h1%2==0 ? edges1[i1] :
+        0.5*(edges1[i1]+edges1[i1+1]);
 
-            ft.index = i1*n2+i2;
-            for(unsigned i=0; i<ntris; ++i)
-              {
-                ft.points[0] = corners3[tris[i][0]];
-                ft.points[1] = corners3[tris[i][1]];
-                ft.points[2] = corners3[tris[i][2]];
-                v.push_back(ft);
-              }
-          }
+      for(unsigned g2=0; g2<gn2; ++g2)
+        {
+          const int h2 = g2*(2/res);
+          const int i2 = h2/2;
+          const unsigned idx = g1*gn2+g2;
 
-        // draw lines (if they haven't been drawn before)
-        if(fl.lineprop!=0)
-          {
-            fl.index = i1*n2+i2;
-            for(unsigned i=0; i<nlines; ++i)
-              {
-                // skip lines which are in wrong direction
-                if( (hidehorzline && linedirn[i]==0) ||
-                    (hidevertline && linedirn[i]==1) )
-                  continue;
+          cpos1[idx] = pos1;
+          if(h2%2==0)
+            {
+              cpos2[idx] = edges2[i2];
+              cval[idx] = h1%2==0 ?
+                average4(val(i1-1,i2-1), val(i1,i2-1), val(i1,i2), val(i1-1,i2)) :
+                average2(val(i1,i2), val(i1,i2-1));
+            }
+          else
+            {
+              cpos2[idx] = 0.5*(edges2[i2]+edges2[i2+1]);
+              cval[idx] = h1%2==0 ?
+                average2(val(i1,i2), val(i1-1,i2)) :
+                val(i1,i2);
+            }
+        }
+    }
 
-                if(! linetracker.isLineSet(i1+linecells[i][0], i2+linecells[i][1],
-                                           linecells[i][2]))
-                  {
-                    fl.points[0] = corners3[lines[i][0]];
-                    fl.points[1] = corners3[lines[i][1]];
-                    if(fl.points[0].isfinite() && fl.points[1].isfinite())
-                      v.push_back(fl);
-                    linetracker.setLine(i1+linecells[i][0], i2+linecells[i][1],
-                                        linecells[i][2]);
-                  }
-              }
-          }
-      } // loop over points
+  verts.resize(gn1*gn2);
+  transformPoints(outerM, gn1*gn2,
+                  coords[0].data(), coords[1].data(), coords[2].data(),
+                  verts.data());
+}
 
+Bounds3 DataMesh::calcBounds()
+{
+  // the surface heights are averages of the values, so are in the
+  // same range
+  Bounds3 b;
+  if(idxval<=2 && idxedge1<=2 && idxedge2<=2)
+    {
+      b.extendAxis(idxval, vals);
+      b.extendAxis(idxedge1, edges1);
+      b.extendAxis(idxedge2, edges2);
+    }
+  return b;
 }
 
 // MultiCuboid
 //////////////
 
-void MultiCuboid::getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v)
+namespace
 {
-  // nothing to draw
-  if( lineprop.ptr()==0 && surfaceprop.ptr()==0 )
-    return;
-
-  // used to draw the grid and surface
-  Fragment ft;
-  ft.type = Fragment::FR_TRIANGLE;
-  ft.surfaceprop = surfaceprop.ptr();
-  ft.lineprop = 0;
-  ft.object = this;
-
-  Fragment fl;
-  fl.type = Fragment::FR_LINESEG;
-  fl.surfaceprop = 0;
-  fl.lineprop = lineprop.ptr();
-  fl.object = this;
-
-  // triangles for drawing surface of cube
-  static const int triidx[12][3][3] = {
+  // triangles for drawing surface of cube, indexing its corners
+  const int cuboidtriidx[12][3][3] = {
     {{0,0,0}, {0,0,1}, {1,0,0}},
     {{0,0,1}, {0,0,0}, {0,1,0}},
     {{0,1,0}, {0,1,1}, {0,0,1}},
@@ -539,6 +721,16 @@ void MultiCuboid::getFragments(const Mat4& perspM, const Mat4& outerM, FragmentV
     {{1,0,1}, {1,1,1}, {1,1,0}},
     {{1,1,0}, {1,1,1}, {0,1,1}}
   };
+}
+
+void MultiCuboid::getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v)
+{
+  const bool drawsurf = surfaceprop.ptr()!=0 && !surfaceprop->hide;
+  const bool drawline = lineprop.ptr()!=0 && !lineprop->hide;
+
+  // nothing to draw
+  if( !drawsurf && !drawline )
+    return;
 
   // lines for drawing edges of cube
   static const int edgeidx[12][2][3] = {
@@ -562,54 +754,524 @@ void MultiCuboid::getFragments(const Mat4& perspM, const Mat4& outerM, FragmentV
   const int sizez = std::min(zmin.size(), zmax.size());
   const int size = std::min(std::min(sizex, sizey), sizez);
 
-  for(int i=0; i<size; ++i)
+  // chunks of cuboids may be processed in parallel
+  const unsigned nchunks = numChunks(size, PARALLEL_MIN_ITEMS/24);
+  parallelFragments(v, nchunks, [&](unsigned chunk, FragmentVector& out)
     {
-      const double x[2] = {xmin[i], xmax[i]};
-      const double y[2] = {ymin[i], ymax[i]};
-      const double z[2] = {zmin[i], zmax[i]};
-
-      if(ft.surfaceprop != 0 && !ft.surfaceprop->hide)
+      // used to draw the grid and surface
+      Fragment ft;
+      ft.type = Fragment::FR_TRIANGLE;
+      ft.surfaceprop = surfaceprop.ptr();
+      ft.lineprop = 0;
+      ft.object = this;
+
+      Fragment fl;
+      fl.type = Fragment::FR_LINESEG;
+      fl.surfaceprop = 0;
+      fl.lineprop = lineprop.ptr();
+      fl.object = this;
+
+      const int end = chunkBegin(size, chunk+1, nchunks);
+      for(int i=chunkBegin(size, chunk, nchunks); i<end; ++i)
         {
-          ft.index = i;
+          // transform corners, which are shared between the
+          // triangles and edges
+          const double x[2] = {xmin[i], xmax[i]};
+          const double y[2] = {ymin[i], ymax[i]};
+          const double z[2] = {zmin[i], zmax[i]};
+          Vec3 corners[2][2][2];
+          for(int ix=0; ix<2; ++ix)
+            for(int iy=0; iy<2; ++iy)
+              for(int iz=0; iz<2; ++iz)
+                corners[ix][iy][iz] = vec4to3(outerM*Vec4(x[ix], y[iy], z[iz]));
+
+          if(drawsurf)
+            {
+              ft.index = i;
+
+              // iterate over triangles in cube
+              for(int tri=0; tri<12; ++tri)
+                {
+                  // points for triangle
+                  for(int pt=0; pt<3; ++pt)
+                    {
+                      const int* idx = cuboidtriidx[tri][pt];
+                      ft.points[pt] = corners[idx[0]][idx[1]][idx[2]];
+                    }
+                  if(ft.isVisible())
+                    out.push_back(ft);
+                }
+            }
 
-          // iterate over triangles in cube
-          for(int tri=0; tri<12; ++tri)
+          if(drawline)
             {
-              // points for triangle
-              for(int pt=0; pt<3; ++pt)
+              fl.index = i;
+
+              // iterate over edges
+              for(int edge=0; edge<12; ++edge)
                 {
-                  ft.points[pt] = vec4to3(outerM*
-                                          Vec4(x[triidx[tri][pt][0]],
-                                               y[triidx[tri][pt][1]],
-                                               z[triidx[tri][pt][2]]));
+                  // points for line
+                  for(int pt=0; pt<2; ++pt)
+                    {
+                      const int* idx = edgeidx[edge][pt];
+                      fl.points[pt] = corners[idx[0]][idx[1]][idx[2]];
+                    }
+                  if(fl.isVisible())
+                    out.push_back(fl);
                 }
-              if(ft.isVisible())
-                v.push_back(ft);
             }
+
+        } // loop over cuboids
+    });
+
+}
+
+Bounds3 MultiCuboid::calcBounds()
+{
+  Bounds3 b;
+  b.extendAxis(0, xmin); b.extendAxis(0, xmax);
+  b.extendAxis(1, ymin); b.extendAxis(1, ymax);
+  b.extendAxis(2, zmin); b.extendAxis(2, zmax);
+  return b;
+}
+
+// CuboidGrid
+/////////////
+
+namespace
+{
+  // cells are treated as touching if the gap between them is smaller
+  // than this fraction of their combined size (volume3d leaves a tiny
+  // gap between cells with a fill factor of 1)
+  const double CELL_TOUCH_FRAC = 1e-3;
+
+  // cells are inside the clip box if within this fraction of its size
+  // (as points just outside a ClipContainer are not clipped)
+  const double CLIP_INSIDE_FRAC = 1e-8;
+
+  // grids with up to this many cells (or a few times the number of
+  // values) are stored densely
+  const unsigned long long MIN_DENSE_CELLS = 1ULL<<20;
+
+  // value stored in each occupied cell of a 3D grid, kept in a hash
+  // table if the grid is large and sparse
+  class CellGrid
+  {
+  public:
+    CellGrid(const int _n[3], unsigned nvals)
+    {
+      for(unsigned i=0; i<3; ++i)
+        n[i] = _n[i];
+      const unsigned long long ncells =
+        (unsigned long long)(n[0])*n[1]*n[2];
+      dense = ncells <= std::max(MIN_DENSE_CELLS, 8ULL*nvals);
+      if(dense)
+        cells.assign(ncells, -1);
+    }
+
+    void set(const int c[3], int val)
+    {
+      if(dense)
+        cells[key(c)] = val;
+      else
+        sparse[key(c)] = val;
+    }
+
+    // get value in cell, or -1 if empty or outside grid
+    int get(const int c[3]) const
+    {
+      for(unsigned i=0; i<3; ++i)
+        if(c[i]<0 || c[i]>=n[i])
+          return -1;
+      if(dense)
+        return cells[key(c)];
+      auto it = sparse.find(key(c));
+      return it==sparse.end() ? -1 : it->second;
+    }
+
+  private:
+    unsigned long long key(const int c[3]) const
+    {
+      return ((unsigned long long)(c[0])*n[1]+c[1])*n[2]+c[2];
+    }
+
+  private:
+    int n[3];
+    bool dense;
+    std::vector<int> cells;
+    std::unordered_map<unsigned long long, int> sparse;
+  };
+
+  // face of a cell perpendicular to an axis, in cell layer along that
+  // axis, with u and v the cells along the other two axes
+  struct CellFace
+  {
+    int layer, v, u;
+    int val;
+    bool cut;                   // cell is cut open by the clip box
+
+    bool operator<(const CellFace& o) const
+    {
+      return std::tie(layer, v, u) < std::tie(o.layer, o.v, o.u);
+    }
+  };
+
+  // Compute the 3D corners of a rectangle perpendicular to axis, at
+  // plane, covering urange and vrange along the other axes (u is
+  // axis+1 and v axis+2). inner is a position inside the cell behind
+  // the rectangle. If cull is set, returns false if the rectangle
+  // faces away from the camera (at the origin).
+  bool rectCorners(const Mat4& M, unsigned axis, double plane, double inner,
+                   const double urange[2], const double vrange[2],
+                   bool cull, Vec3 pts[4])
+  {
+    const unsigned ua = (axis+1)%3;
+    const unsigned va = (axis+2)%3;
+
+    static const unsigned uvidx[4][2] = {{0,0}, {1,0}, {1,1}, {0,1}};
+    Vec4 p;
+    p(3) = 1;
+    p(axis) = plane;
+    for(unsigned i=0; i<4; ++i)
+      {
+        p(ua) = urange[uvidx[i][0]];
+        p(va) = vrange[uvidx[i][1]];
+        pts[i] = vec4to3(M*p);
+      }
+
+    if(!cull)
+      return true;
+
+    // orient the normal away from the cell, then check the camera is
+    // in front
+    p(axis) = inner;
+    p(ua) = 0.5*(urange[0]+urange[1]);
+    p(va) = 0.5*(vrange[0]+vrange[1]);
+    const Vec3 ref = vec4to3(M*p);
+
+    Vec3 norm = cross(pts[1]-pts[0], pts[3]-pts[0]);
+    if(dot(norm, pts[0]-ref) < 0)
+      norm = -norm;
+    return dot(norm, pts[0]) < 0;
+  }
+
+  // Add the triangles of the face of the cuboid from lo to hi
+  // perpendicular to axis, on side 0 (lo) or 1 (hi). These are the
+  // triangles drawn by MultiCuboid, so are lit the same.
+  void addCuboidFace(const Mat4& M, const double lo[3], const double hi[3],
+                     unsigned axis, int side, Fragment& ft, FragmentVector& v)
+  {
+    for(int tri=0; tri<12; ++tri)
+      {
+        const int (*idx)[3] = cuboidtriidx[tri];
+        if(idx[0][axis]!=side || idx[1][axis]!=side || idx[2][axis]!=side)
+          continue;
+        for(int pt=0; pt<3; ++pt)
+          ft.points[pt] = vec4to3(M*Vec4(idx[pt][0] ? hi[0] : lo[0],
+                                         idx[pt][1] ? hi[1] : lo[1],
+                                         idx[pt][2] ? hi[2] : lo[2]));
+        v.push_back(ft);
+      }
+  }
+}
+
+void CuboidGrid::getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v)
+{
+  const bool drawsurf = surfaceprop.ptr()!=0 && !surfaceprop.ptr()->hide;
+  const bool drawline = lineprop.ptr()!=0 && !lineprop.ptr()->hide;
+
+  // nothing to draw
+  if(!drawsurf && !drawline)
+    return;
+
+  Fragment ft;
+  ft.type = Fragment::FR_TRIANGLE;
+  ft.surfaceprop = surfaceprop.ptr();
+  ft.lineprop = 0;
+  ft.object = this;
+
+  Fragment fl;
+  fl.type = Fragment::FR_LINESEG;
+  fl.surfaceprop = 0;
+  fl.lineprop = lineprop.ptr();
+  fl.object = this;
+
+  const ValVector* mins[3] = {&xmin, &ymin, &zmin};
+  const ValVector* maxs[3] = {&xmax, &ymax, &zmax};
+  const ValVector* idxs[3] = {&xidx, &yidx, &zidx};
+
+  int n[3];
+  for(unsigned a=0; a<3; ++a)
+    n[a] = int(std::min(mins[a]->size(), maxs[a]->size()));
+  const int nvals = int(std::min(std::min(xidx.size(), yidx.size()),
+                                 zidx.size()));
+
+  // put values into grid, ignoring those with invalid cells
+  CellGrid grid(n, nvals);
+  std::vector<int> cellidx(3*nvals, -1);
+  for(int i=0; i<nvals; ++i)
+    {
+      int c[3];
+      bool valid = true;
+      for(unsigned a=0; a<3; ++a)
+        {
+          const double d = (*idxs[a])[i];
+          if(d>=0 && d<n[a])
+            c[a] = int(d);
+          else
+            valid = false;
         }
+      if(valid)
+        {
+          grid.set(c, i);
+          std::copy(c, c+3, &cellidx[3*i]);
+        }
+    }
 
-      if(fl.lineprop !=0 && !fl.lineprop->hide)
+  // colour of each value and whether it is opaque
+  std::vector<QRgb> rgbs(nvals, 0);
+  std::vector<char> opaque(nvals, 0);
+  if(drawsurf)
+    for(int i=0; i<nvals; ++i)
+      {
+        const QColor col = surfaceprop.ptr()->color(i);
+        rgbs[i] = col.rgba();
+        opaque[i] = col.alpha()==255;
+      }
+
+  // whether the cells either side of each boundary touch
+  std::vector<char> touch[3];
+  for(unsigned a=0; a<3; ++a)
+    {
+      touch[a].assign(std::max(n[a]-1, 0), 0);
+      for(int i=0; i+1<n[a]; ++i)
         {
-          fl.index = i;
+          const double gap = (*mins[a])[i+1] - (*maxs[a])[i];
+          const double size = (*maxs[a])[i+1] - (*mins[a])[i];
+          touch[a][i] = std::abs(gap) <= CELL_TOUCH_FRAC*std::abs(size);
+        }
+    }
 
-          // iterate over edges
-          for(int edge=0; edge<12; ++edge)
+  // whether the cell of each value is inside the clip box (0), cut by
+  // it (1) or outside it (2)
+  std::vector<char> clipped(nvals, 0);
+  if(!clipbox.isUnbounded())
+    {
+      Bounds3 box(clipbox);
+      for(unsigned a=0; a<3; ++a)
+        {
+          const double delta = CLIP_INSIDE_FRAC *
+            std::max(1., std::abs(box.maxpt(a)-box.minpt(a)));
+          box.minpt(a) -= delta;
+          box.maxpt(a) += delta;
+        }
+      for(int i=0; i<nvals; ++i)
+        {
+          const int* c = &cellidx[3*i];
+          if(c[0]<0)
+            continue;
+          Bounds3 cell;
+          cell.extend(Vec3((*mins[0])[c[0]], (*mins[1])[c[1]],
+                           (*mins[2])[c[2]]));
+          cell.extend(Vec3((*maxs[0])[c[0]], (*maxs[1])[c[1]],
+                           (*maxs[2])[c[2]]));
+          clipped[i] = box.contains(cell) ? 0 : box.intersects(cell) ? 1 : 2;
+        }
+    }
+
+  // line segments drawn already, indexed by their starting corner
+  // and direction. Corners 2*i and 2*i+1 are the min and max of cell
+  // i, with the max treated as the min of the next cell if they touch.
+  std::unordered_set<unsigned long long> linesdone;
+  auto lineKey = [&n, &touch](const int corner[3], unsigned dirn)
+    {
+      int c[3];
+      for(unsigned a=0; a<3; ++a)
+        {
+          c[a] = corner[a];
+          if(c[a]%2==1 && c[a]/2+1<n[a] && touch[a][c[a]/2])
+            ++c[a];
+        }
+      return (((unsigned long long)(c[0])*(2*n[1]) + c[1])*
+              (2*n[2]) + c[2])*3 + dirn;
+    };
+
+  std::vector<CellFace> faces;
+  std::vector<char> used;
+  Vec3 pts[4];
+
+  for(unsigned a=0; a<3; ++a)
+    {
+      const unsigned ua = (a+1)%3;
+      const unsigned va = (a+2)%3;
+
+      for(int side=0; side<2; ++side)
+        {
+          // collect faces on this side of cells which are not hidden
+          // by a touching opaque neighbour, where neither is cut open
+          faces.clear();
+          for(int i=0; i<nvals; ++i)
+            {
+              const int* c = &cellidx[3*i];
+              if(c[0]<0 || grid.get(c)!=i || clipped[i]==2)
+                continue;
+
+              int nc[3] = {c[0], c[1], c[2]};
+              nc[a] += side ? 1 : -1;
+              const int neigh = grid.get(nc);
+              if(neigh>=0 && opaque[neigh] && !clipped[i] && !clipped[neigh] &&
+                 touch[a][side ? c[a] : c[a]-1])
+                continue;
+
+              CellFace f;
+              f.layer = c[a];
+              f.u = c[ua];
+              f.v = c[va];
+              f.val = i;
+              f.cut = clipped[i] != 0;
+              faces.push_back(f);
+            }
+          std::sort(faces.begin(), faces.end());
+
+          const ValVector& amins = *mins[a];
+          const ValVector& amaxs = *maxs[a];
+          const ValVector& umins = *mins[ua];
+          const ValVector& umaxs = *maxs[ua];
+          const ValVector& vmins = *mins[va];
+          const ValVector& vmaxs = *maxs[va];
+
+          if(drawsurf)
             {
-              // points for line
-              for(int pt=0; pt<2; ++pt)
+              // greedily merge faces with the same colour into
+              // rectangles, first along u then v. A merged rectangle
+              // would be lit differently to the separate faces, as
+              // lighting depends on position, so faces are only
+              // merged if the surface is not lit.
+              const bool merge = surfaceprop.ptr()->refl == 0.;
+              used.assign(faces.size(), 0);
+              for(size_t fi=0; fi<faces.size(); ++fi)
                 {
-                  fl.points[pt] = vec4to3(outerM*
-                                          Vec4(x[edgeidx[edge][pt][0]],
-                                               y[edgeidx[edge][pt][1]],
-                                               z[edgeidx[edge][pt][2]]));
+                  if(used[fi])
+                    continue;
+                  const CellFace& f = faces[fi];
+                  const QRgb col = rgbs[f.val];
+
+                  size_t last = fi;
+                  while(merge && last+1 < faces.size() && !used[last+1] &&
+                        faces[last+1].layer==f.layer &&
+                        faces[last+1].v==f.v &&
+                        faces[last+1].u==faces[last].u+1 &&
+                        touch[ua][faces[last].u] &&
+                        rgbs[faces[last+1].val]==col &&
+                        faces[last+1].cut==f.cut)
+                    ++last;
+                  std::fill(used.begin()+fi, used.begin()+last+1, 1);
+                  const int width = faces[last].u - f.u + 1;
+
+                  int v1 = f.v;
+                  while(merge && v1+1 < n[va] && touch[va][v1])
+                    {
+                      CellFace next(f);
+                      next.v = v1+1;
+                      const size_t si = std::lower_bound
+                        (faces.begin(), faces.end(), next) - faces.begin();
+                      if(si+width > faces.size())
+                        break;
+
+                      bool match = true;
+                      for(int j=0; j<width && match; ++j)
+                        {
+                          const CellFace& o = faces[si+j];
+                          match = !used[si+j] && o.layer==f.layer &&
+                            o.v==v1+1 && o.u==f.u+j && rgbs[o.val]==col &&
+                            o.cut==f.cut;
+                        }
+                      if(!match)
+                        break;
+
+                      std::fill(used.begin()+si, used.begin()+si+width, 1);
+                      ++v1;
+                    }
+
+                  const double urange[2] = {umins[f.u], umaxs[f.u+width-1]};
+                  const double vrange[2] = {vmins[f.v], vmaxs[v1]};
+                  if(!rectCorners(outerM, a,
+                                  side ? amaxs[f.layer] : amins[f.layer],
+                                  0.5*(amins[f.layer]+amaxs[f.layer]),
+                                  urange, vrange, opaque[f.val] && !f.cut,
+                                  pts))
+                    continue;
+
+                  ft.index = f.val;
+                  if(!ft.isVisible())
+                    continue;
+                  if(!merge)
+                    {
+                      const int* c = &cellidx[3*f.val];
+                      double lo[3], hi[3];
+                      for(unsigned ca=0; ca<3; ++ca)
+                        {
+                          lo[ca] = (*mins[ca])[c[ca]];
+                          hi[ca] = (*maxs[ca])[c[ca]];
+                        }
+                      addCuboidFace(outerM, lo, hi, a, side, ft, v);
+                      continue;
+                    }
+                  ft.points[0] = pts[0];
+                  ft.points[1] = pts[1];
+                  ft.points[2] = pts[2];
+                  v.push_back(ft);
+                  ft.points[1] = pts[2];
+                  ft.points[2] = pts[3];
+                  v.push_back(ft);
                 }
-              if(fl.isVisible())
-                v.push_back(fl);
             }
-        }
 
-    } // loop over cuboids
+          if(drawline)
+            {
+              // edges of each visible face, which are not shared
+              // with faces drawn already
+              static const int edgecorners[4][2] = {{0,1}, {3,2}, {0,3}, {1,2}};
+              for(const CellFace& f : faces)
+                {
+                  const double urange[2] = {umins[f.u], umaxs[f.u]};
+                  const double vrange[2] = {vmins[f.v], vmaxs[f.v]};
+                  if(!rectCorners(outerM, a,
+                                  side ? amaxs[f.layer] : amins[f.layer],
+                                  0.5*(amins[f.layer]+amaxs[f.layer]),
+                                  urange, vrange, opaque[f.val] && !f.cut,
+                                  pts))
+                    continue;
+
+                  fl.index = f.val;
+                  for(unsigned e=0; e<4; ++e)
+                    {
+                      // edges 0 and 1 are along u, 2 and 3 along v
+                      int corner[3];
+                      corner[a] = 2*f.layer + side;
+                      corner[ua] = 2*f.u + (e==3 ? 1 : 0);
+                      corner[va] = 2*f.v + (e==1 ? 1 : 0);
+                      if(!linesdone.insert(lineKey(corner, e<2 ? ua : va)).second)
+                        continue;
+
+                      fl.points[0] = pts[edgecorners[e][0]];
+                      fl.points[1] = pts[edgecorners[e][1]];
+                      if(fl.isVisible())
+                        v.push_back(fl);
+                    }
+                }
+            }
+        } // sides
+    } // axes
+}
 
+Bounds3 CuboidGrid::calcBounds()
+{
+  Bounds3 b;
+  b.extendAxis(0, xmin); b.extendAxis(0, xmax);
+  b.extendAxis(1, ymin); b.extendAxis(1, ymax);
+  b.extendAxis(2, zmin); b.extendAxis(2, zmax);
+  return b;
 }
 
 // Points
@@ -635,16 +1297,28 @@ void Points::getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector
   if(hassizes)
     size = std::min(size, unsigned(sizes.size()));
 
-  for(unsigned i=0; i<size; ++i)
+  const unsigned nchunks = numChunks(size, PARALLEL_MIN_ITEMS);
+  parallelFragments(v, nchunks, [&](unsigned chunk, FragmentVector& out)
     {
-      fp.points[0] = vec4to3(outerM*Vec4(x[i], y[i], z[i], 1));
-      if(hassizes)
-        fp.pathsize = sizes[i];
-      fp.index = i;
+      const unsigned start = chunkBegin(size, chunk, nchunks);
+      const unsigned end = chunkBegin(size, chunk+1, nchunks);
+      Vec3Vector pts(end-start);
+      transformPoints(outerM, end-start,
+                      x.data()+start, y.data()+start, z.data()+start,
+                      pts.data());
+
+      Fragment f(fp);
+      for(unsigned i=start; i<end; ++i)
+        {
+          f.points[0] = pts[i-start];
+          if(hassizes)
+            f.pathsize = sizes[i];
+          f.index = i;
 
-      if(fp.points[0].isfinite())
-        v.push_back(fp);
-    }
+          if(f.points[0].isfinite())
+            out.push_back(f);
+        }
+    });
 }
 
 
@@ -723,10 +1397,75 @@ ObjectContainer::~ObjectContainer()
 
 void ObjectContainer::getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v)
 {
+  getVisibleFragments(perspM, outerM, Frustum(), v);
+}
+
+void ObjectContainer::getVisibleFragments(const Mat4& perspM, const Mat4& outerM,
+                                          const Frustum& frustum,
+                                          FragmentVector& v)
+{
+  if(!frustum.isUnbounded() && !frustum.mayContain(getBounds(), outerM))
+    return;
+
+  // children are split into chunks which may be processed in parallel
   const Mat4 totM(outerM*objM);
   const unsigned s=objects.size();
-  for(unsigned i=0; i<s; ++i)
-    objects[i]->getFragments(perspM, totM, v);
+  const unsigned nchunks = numChunks(s, 1);
+  parallelFragments(v, nchunks, [&](unsigned chunk, FragmentVector& out)
+    {
+      const unsigned end = chunkBegin(s, chunk+1, nchunks);
+      for(unsigned i=chunkBegin(s, chunk, nchunks); i<end; ++i)
+        objects[i]->getVisibleFragments(perspM, totM, frustum, out);
+    });
+}
+
+void ObjectContainer::getFragmentsByView(const Mat4& perspM, const Mat4& outerM,
+                                         bool viewdep, const Frustum& frustum,
+                                         FragmentVector& v)
+{
+  if(viewdep && !frustum.isUnbounded() &&
+     !frustum.mayContain(getBounds(), outerM))
+    return;
+
+  const Mat4 totM(outerM*objM);
+  const unsigned s=objects.size();
+  const unsigned nchunks = numChunks(s, 1);
+  parallelFragments(v, nchunks, [&](unsigned chunk, FragmentVector& out)
+    {
+      const unsigned end = chunkBegin(s, chunk+1, nchunks);
+      for(unsigned i=chunkBegin(s, chunk, nchunks); i<end; ++i)
+        objects[i]->getFragmentsByView(perspM, totM, viewdep, frustum, out);
+    });
+}
+
+Bounds3 ObjectContainer::getBounds()
+{
+  Bounds3 b;
+  for(auto &object : objects)
+    b.extend(object->getBounds().transformed(objM));
+  return b;
+}
+
+unsigned long long ObjectContainer::changeStamp()
+{
+  unsigned long long stamp = Object::changeStamp();
+  for(auto &object : objects)
+    stamp = std::max(stamp, object->changeStamp());
+  return stamp;
+}
+
+void ObjectContainer::replaceObject(unsigned idx, Object* obj)
+{
+  delete objects[idx];
+  objects[idx] = obj;
+  invalidateBounds();
+}
+
+void ObjectContainer::removeObject(unsigned idx)
+{
+  delete objects[idx];
+  objects.erase(objects.begin()+idx);
+  invalidateBounds();
 }
 
 void ObjectContainer::assignWidgetId(unsigned long long id)
@@ -737,14 +1476,25 @@ void ObjectContainer::assignWidgetId(unsigned long long id)
 
 // FacingContainer
 
-void FacingContainer::getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v)
+void FacingContainer::getVisibleFragments(const Mat4& perspM, const Mat4& outerM,
+                                          const Frustum& frustum,
+                                          FragmentVector& v)
 {
   const Vec3 origin = vec4to3(outerM*Vec4(0,0,0,1));
   const Vec3 tnorm = vec4to3(outerM*vec3to4(norm));
 
   // norm points towards +z
   if(tnorm(2) > origin(2))
-    ObjectContainer::getFragments(perspM, outerM, v);
+    ObjectContainer::getVisibleFragments(perspM, outerM, frustum, v);
+}
+
+void FacingContainer::getFragmentsByView(const Mat4& perspM, const Mat4& outerM,
+                                         bool viewdep, const Frustum& frustum,
+                                         FragmentVector& v)
+{
+  // whether the children are shown depends on the view
+  if(viewdep)
+    getVisibleFragments(perspM, outerM, frustum, v);
 }
 
 // AxisLabels
@@ -27,23 +27,65 @@
 #include <vector>
 
 #include "mmaths.h"
+#include "bounds.h"
 #include "fragment.h"
 #include "properties.h"
 
 class Object
 {
  public:
-  Object() : widgetid(0) {}
+  Object() : widgetid(0), boundscached(false), stamp(nextChangeStamp()) {}
 
   virtual ~Object();
 
   virtual void getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
 
+  // get fragments, skipping those which cannot be inside the frustum
+  // (given in outer coordinates). The default skips the object if
+  // its bounds are outside the frustum.
+  virtual void getVisibleFragments(const Mat4& perspM, const Mat4& outerM,
+                                   const Frustum& frustum,
+                                   FragmentVector& v);
+
+  // Get only the fragments which depend on the viewing direction (if
+  // viewdep), or only those which do not. The view-independent
+  // fragments can be made once in model coordinates and reused. The
+  // frustum is only used to skip view-dependent objects.
+  virtual void getFragmentsByView(const Mat4& perspM, const Mat4& outerM,
+                                  bool viewdep, const Frustum& frustum,
+                                  FragmentVector& v);
+
+  // bounding box of the object in its own coordinates, cached after
+  // the first call
+  virtual Bounds3 getBounds();
+
+  // call if the object is modified after getBounds() or drawing
+  void invalidateBounds() { boundscached = false; stamp = nextChangeStamp(); }
+
+  // value which changes whenever the object (or its children) is
+  // modified
+  virtual unsigned long long changeStamp() { return stamp; }
+
   // recursive set id of child objects
   virtual void assignWidgetId(unsigned long long id);
 
   // id of widget which generated object
   unsigned long long widgetid;
+
+ protected:
+  // calculate bounding box, which is unbounded if the extent of the
+  // object is not known (it is then never skipped)
+  virtual Bounds3 calcBounds();
+
+  // do the fragments depend on the viewing direction?
+  virtual bool isViewDependent() const { return false; }
+
+  static unsigned long long nextChangeStamp();
+
+ private:
+  bool boundscached;
+  Bounds3 cachedbounds;
+  unsigned long long stamp;
 };
 
 class Triangle : public Object
@@ -62,6 +104,9 @@ class Triangle : public Object
 
   void getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
 
+ protected:
+  Bounds3 calcBounds();
+
  public:
   Vec3 points[3];
   PropSmartPtr<const SurfaceProp> surfaceprop;
@@ -85,12 +130,16 @@ public:
   void addPoint(const Vec3& v)
   {
     points.push_back(v);
+    invalidateBounds();
   }
 
   void addPoints(const ValVector& x, const ValVector& y, const ValVector& z);
 
   void getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
 
+protected:
+  Bounds3 calcBounds();
+
 public:
   Vec3Vector points;
   PropSmartPtr<const LineProp> lineprop;
@@ -107,6 +156,9 @@ public:
 
   void getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
 
+protected:
+  Bounds3 calcBounds();
+
 public:
   Vec3Vector points;
   PropSmartPtr<const LineProp> lineprop;
@@ -137,9 +189,14 @@ public:
 
   void getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
 
+protected:
+  Bounds3 calcBounds();
+
 private:
-  void getSurfaceFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
-  void getLineFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
+  // grid of transformed points, indexed by i1*n2+i2
+  void getVertices(const Mat4& outerM, Vec3Vector& verts) const;
+  void getSurfaceFragments(const Vec3Vector& verts, FragmentVector& v);
+  void getLineFragments(const Vec3Vector& verts, FragmentVector& v);
 
   void getVecIdxs(unsigned &vidx_h, unsigned &vidx_1, unsigned &vidx_2) const;
 
@@ -174,6 +231,15 @@ public:
 
   void getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
 
+protected:
+  Bounds3 calcBounds();
+
+private:
+  // transformed cell corners (and edge and cell centres if res is 2)
+  // for rows row1 to row2, in a grid with res points per cell
+  void getVertices(const Mat4& outerM, int row1, int row2, unsigned res,
+                   Vec3Vector& verts) const;
+
 public:
   ValVector edges1, edges2, vals;
   unsigned idxval, idxedge1, idxedge2;
@@ -201,11 +267,71 @@ public:
 
   void getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
 
+protected:
+  Bounds3 calcBounds();
+
+public:
+  ValVector xmin, xmax, ymin, ymax, zmin, zmax;
+
+  PropSmartPtr<const LineProp> lineprop;
+  PropSmartPtr<const SurfaceProp> surfaceprop;
+};
+
+// cuboids on a 3D grid of cells, such as a voxel volume
+//
+// The cells along each axis run from min to max in the edge vectors
+// (which may leave gaps between cells). Value i is drawn in cell
+// (xidx[i], yidx[i], zidx[i]) using colour index i. If several values
+// are in the same cell, the last is drawn.
+//
+// Only faces which can be seen are drawn. A face is hidden if the
+// neighbouring cell touches it and is opaque, or if it faces away
+// from the camera in an opaque cell. Adjacent faces in the same plane
+// with the same colour are merged into rectangles.
+//
+// If the grid is in a ClipContainer, setClipBox should be called with
+// its box. Clipping opens up cells cut by the box, so all their faces
+// are drawn, and cells outside the box are skipped.
+class CuboidGrid : public Object
+{
+public:
+  CuboidGrid(const ValVector& _xmin, const ValVector& _xmax,
+             const ValVector& _ymin, const ValVector& _ymax,
+             const ValVector& _zmin, const ValVector& _zmax,
+             const ValVector& _xidx, const ValVector& _yidx,
+             const ValVector& _zidx,
+             const LineProp* lprop=0, const SurfaceProp* sprop=0)
+    : xmin(_xmin), xmax(_xmax),
+      ymin(_ymin), ymax(_ymax),
+      zmin(_zmin), zmax(_zmax),
+      xidx(_xidx), yidx(_yidx), zidx(_zidx),
+      lineprop(lprop), surfaceprop(sprop),
+      clipbox(Bounds3::unbounded())
+  {
+  }
+
+  // box the grid will be clipped to, in its own coordinates
+  void setClipBox(const Vec3& minpt, const Vec3& maxpt)
+  {
+    clipbox = Bounds3();
+    clipbox.extend(minpt);
+    clipbox.extend(maxpt);
+    invalidateBounds();
+  }
+
+  void getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
+
+protected:
+  Bounds3 calcBounds();
+  bool isViewDependent() const { return true; }
+
 public:
   ValVector xmin, xmax, ymin, ymax, zmin, zmax;
+  ValVector xidx, yidx, zidx;
 
   PropSmartPtr<const LineProp> lineprop;
   PropSmartPtr<const SurfaceProp> surfaceprop;
+  Bounds3 clipbox;
 };
 
 // a set of points to plot
@@ -277,6 +403,9 @@ public:
   {}
 
   void getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
+
+protected:
+  bool isViewDependent() const { return true; }
 };
 
 // container of objects with transformation matrix of children
@@ -291,16 +420,43 @@ class ObjectContainer : public Object
 
   ~ObjectContainer();
   void getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
+  void getVisibleFragments(const Mat4& perspM, const Mat4& outerM,
+                           const Frustum& frustum, FragmentVector& v);
+
+  void getFragmentsByView(const Mat4& perspM, const Mat4& outerM,
+                          bool viewdep, const Frustum& frustum,
+                          FragmentVector& v);
+
+  // bounds of children, which are not cached as they can change
+  Bounds3 getBounds();
+
+  // latest change of this container or its children
+  unsigned long long changeStamp();
 
   void addObject(Object* obj)
   {
     objects.push_back(obj);
+    invalidateBounds();
   }
 
+  unsigned numObjects() const { return objects.size(); }
+
+  // replace or remove the child at idx, deleting the old object, so
+  // that callers can update a persistent tree in place
+  void replaceObject(unsigned idx, Object* obj);
+  void removeObject(unsigned idx);
+
   // recursive set id of child objects
   void assignWidgetId(unsigned long long id);
 
+  // whether, as the root of a scene, the view-independent fragments
+  // of the children can be made once and reused as objM changes
+  // (not if the container itself changes what is drawn)
+  virtual bool reusableAsRoot() const { return true; }
+
  public:
+  // call invalidateBounds() if changed in a child container, so cached
+  // view-independent fragments are remade
   Mat4 objM;
   std::vector<Object*> objects;
 };
@@ -315,7 +471,13 @@ public:
     : ObjectContainer(), norm(_norm)
   {
   }
-  void getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
+  void getVisibleFragments(const Mat4& perspM, const Mat4& outerM,
+                           const Frustum& frustum, FragmentVector& v);
+  void getFragmentsByView(const Mat4& perspM, const Mat4& outerM,
+                          bool viewdep, const Frustum& frustum,
+                          FragmentVector& v);
+
+  bool reusableAsRoot() const { return false; }
 
 public:
   Vec3 norm;
@@ -344,6 +506,9 @@ public:
 
   void getFragments(const Mat4& perspM, const Mat4& outerM, FragmentVector& v);
 
+protected:
+  bool isViewDependent() const { return true; }
+
 private:
   Vec3 box1, box2;
   ValVector tickfracs;
@@ -0,0 +1,339 @@
+// -*-c++-*-
+
+//    Copyright (C) 2026 Jeremy S. Sanders
+//    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "fragment.h"
+
+// Pool of worker threads for generating fragments in parallel.
+//
+// A pool is the current pool for its workers, and for a thread using
+// it with TaskPoolScope, so parallel code can find it. Without a
+// current pool everything runs in the calling thread. The pool can be
+// kept between uses, its workers sleeping until there are tasks.
+class TaskPool
+{
+public:
+  // nthreads includes the calling thread (0 means one per core)
+  TaskPool(unsigned nthreads=0)
+    : stopping(false)
+  {
+    if(nthreads == 0)
+      nthreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    for(unsigned i=1; i<nthreads; ++i)
+      {
+        try
+          {
+            workers.emplace_back([this]() { workerLoop(); });
+          }
+        catch(...)
+          {
+            // carry on with fewer threads
+            break;
+          }
+      }
+  }
+
+  ~TaskPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wakeup.notify_all();
+    for(auto& worker : workers)
+      worker.join();
+  }
+
+  // the pool for this thread, or 0 if there isn't one
+  static TaskPool* current() { return _current; }
+
+  unsigned numThreads() const { return workers.size()+1; }
+
+  void push(std::function<void()> task)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      tasks.push_back(std::move(task));
+    }
+    wakeup.notify_one();
+  }
+
+  // run waiting tasks until done() is true, sleeping if there are
+  // none (done is called with the pool locked)
+  template<class F> void runUntil(F done)
+  {
+    for(;;)
+      {
+        std::function<void()> task;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          wakeup.wait(lock, [&]() { return done() || !tasks.empty(); });
+          if(done())
+            return;
+          task = std::move(tasks.front());
+          tasks.pop_front();
+        }
+        task();
+      }
+  }
+
+  // call func with the pool locked, then wake threads in runUntil
+  template<class F> void notify(F func)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      func();
+    }
+    wakeup.notify_all();
+  }
+
+private:
+  void workerLoop()
+  {
+    _current = this;
+    for(;;)
+      {
+        std::function<void()> task;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          wakeup.wait(lock, [this]() { return stopping || !tasks.empty(); });
+          if(tasks.empty())
+            return;
+          task = std::move(tasks.front());
+          tasks.pop_front();
+        }
+        task();
+      }
+  }
+
+private:
+  std::mutex mutex;
+  std::condition_variable wakeup;
+  std::deque< std::function<void()> > tasks;
+  std::vector<std::thread> workers;
+  bool stopping;
+
+  static thread_local TaskPool* _current;
+
+  friend class TaskPoolScope;
+};
+
+// Makes a pool current for the calling thread while this exists (a
+// null pool means tasks are run in the calling thread)
+class TaskPoolScope
+{
+public:
+  TaskPoolScope(TaskPool* pool)
+    : prevpool(TaskPool::_current)
+  {
+    TaskPool::_current = pool;
+  }
+
+  ~TaskPoolScope()
+  {
+    TaskPool::_current = prevpool;
+  }
+
+private:
+  TaskPool* prevpool;
+};
+
+// A set of tasks run in the current pool. wait() runs queued tasks
+// until those in the group are finished, so groups can be nested, and
+// rethrows the first exception thrown by a task. The destructor waits
+// too, but drops any exception, so call wait() before it.
+class TaskGroup
+{
+public:
+  TaskGroup()
+    : pool(TaskPool::current()), pending(0)
+  {
+  }
+
+  ~TaskGroup()
+  {
+    try
+      {
+        wait();
+      }
+    catch(...)
+      {
+      }
+  }
+
+  void run(std::function<void()> task)
+  {
+    if(pool == 0)
+      {
+        task();
+        return;
+      }
+    pool->notify([this]() { ++pending; });
+    pool->push([this, task]()
+               {
+                 std::exception_ptr exc;
+                 try
+                   {
+                     task();
+                   }
+                 catch(...)
+                   {
+                     exc = std::current_exception();
+                   }
+                 pool->notify([this, &exc]()
+                              {
+                                if(exc && !error)
+                                  error = exc;
+                                --pending;
+                              });
+               });
+  }
+
+  void wait()
+  {
+    if(pool == 0)
+      return;
+    pool->runUntil([this]() { return pending == 0; });
+
+    std::exception_ptr exc;
+    pool->notify([this, &exc]() { std::swap(exc, error); });
+    if(exc)
+      std::rethrow_exception(exc);
+  }
+
+private:
+  TaskPool* pool;
+  unsigned pending;             // guarded by the pool mutex
+  std::exception_ptr error;     // first exception from a task
+};
+
+// Fewest items (points, cells, etc) worth handing to another thread
+#define PARALLEL_MIN_ITEMS 4096
+
+// Number of chunks to split size items into, so that chunks have at
+// least minchunk items. This is 1 if there is no current pool.
+inline unsigned numChunks(unsigned size, unsigned minchunk)
+{
+  TaskPool* pool = TaskPool::current();
+  if(pool == 0 || pool->numThreads() < 2)
+    return 1;
+  return std::max(1u, std::min(size/std::max(minchunk, 1u),
+                               4*pool->numThreads()));
+}
+
+// First item of chunk when size items are split into nchunks
+inline unsigned chunkBegin(unsigned size, unsigned chunk, unsigned nchunks)
+{
+  return (unsigned long long)(chunk)*size/nchunks;
+}
+
+// Call func(chunk) for chunks 0 to nchunks-1, in parallel if there
+// is a pool
+template<class F> void parallelChunks(unsigned nchunks, F func)
+{
+  if(nchunks <= 1 || TaskPool::current() == 0)
+    {
+      for(unsigned chunk=0; chunk<nchunks; ++chunk)
+        func(chunk);
+      return;
+    }
+
+  TaskGroup group;
+  for(unsigned chunk=0; chunk<nchunks; ++chunk)
+    group.run([&func, chunk]() { func(chunk); });
+  group.wait();
+}
+
+// Call func(chunk, out) for chunks 0 to nchunks-1, which append
+// fragments to out, in parallel if there is a pool. The fragments are
+// appended to v in chunk order, so the result is the same as running
+// the chunks in turn.
+//
+// Indexed fragments normally refer to vertices their chunk added to
+// out, and are renumbered when merged. If sharedverts is set, chunks
+// do not add vertices, and their fragments index vertices added to v
+// before the call, which are shared between the chunks.
+template<class F> void parallelFragments(FragmentVector& v, unsigned nchunks,
+                                         F func, bool sharedverts=false)
+{
+  if(nchunks <= 1 || TaskPool::current() == 0)
+    {
+      for(unsigned chunk=0; chunk<nchunks; ++chunk)
+        func(chunk, v);
+      return;
+    }
+
+  std::vector<FragmentVector> outs(nchunks);
+  {
+    TaskGroup group;
+    for(unsigned chunk=0; chunk<nchunks; ++chunk)
+      group.run([&func, &outs, chunk]() { func(chunk, outs[chunk]); });
+    group.wait();
+  }
+
+  // merge outputs using the cumulative sizes to get their positions
+  std::vector<size_t> offsets(nchunks+1), vertoffsets(nchunks+1);
+  offsets[0] = v.size();
+  vertoffsets[0] = v.vertices.size();
+  for(unsigned chunk=0; chunk<nchunks; ++chunk)
+    {
+      offsets[chunk+1] = offsets[chunk] + outs[chunk].size();
+      vertoffsets[chunk+1] = vertoffsets[chunk] + outs[chunk].vertices.size();
+    }
+  v.resize(offsets[nchunks]);
+  v.vertices.resize(vertoffsets[nchunks]);
+
+  TaskGroup group;
+  for(unsigned chunk=0; chunk<nchunks; ++chunk)
+    group.run([&v, &outs, &offsets, &vertoffsets, sharedverts, chunk]()
+              {
+                const FragmentVector& out = outs[chunk];
+                std::copy(out.vertices.begin(), out.vertices.end(),
+                          v.vertices.begin()+vertoffsets[chunk]);
+
+                // shared vertex indices move with the vertices
+                const unsigned vertshift = sharedverts ? 0 : vertoffsets[chunk];
+                auto dest = v.begin()+offsets[chunk];
+                for(const Fragment& f : out)
+                  {
+                    *dest = f;
+                    if(f.indexed)
+                      for(unsigned i=0; i<3; ++i)
+                        dest->vertidx[i] += vertshift;
+                    ++dest;
+                  }
+              });
+  group.wait();
+}
+
+#endif
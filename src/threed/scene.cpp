@@ -16,9 +16,14 @@
 //    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 /////////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
 #include <cmath>
 #include <limits>
+#include <map>
+#include <memory>
+#include <tuple>
 #include <QtCore/QPointF>
+#include <QtCore/QRectF>
 #include <QtGui/QPolygonF>
 #include <QtGui/QPen>
 #include <QtGui/QBrush>
@@ -26,13 +31,65 @@
 #include <QtGui/QPixmap>
 #include <QtGui/QImage>
 #include <QtGui/QPainter>
+#include <QtGui/QPainterPath>
+#include <QtGui/QTransform>
 
 #include "scene.h"
 #include "fragment.h"
 #include "bsp.h"
+#include "parallel.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCENE_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+thread_local TaskPool* TaskPool::_current = 0;
 
 namespace
 {
+  // This is a hack to force lines to be rendered in front of
+  // triangles and paths to be rendered in front of lines. Suggestions
+  // to fix this are welcome. Lines are moved by delta, which is
+  // LINE_DELTA_DEPTH along z in eye coordinates.
+  void nudgeLines(FragmentVector& frags, unsigned start, unsigned end,
+                  const Vec3& delta=Vec3(0,0,LINE_DELTA_DEPTH))
+  {
+    for(unsigned i=start; i<end; ++i)
+      {
+        Fragment& f = frags[i];
+        switch(f.type)
+          {
+          case Fragment::FR_LINESEG:
+            f.points[0] += delta;
+            f.points[1] += delta;
+            break;
+          case Fragment::FR_PATH:
+            f.points[0] += delta*2;
+            f.points[1] += delta*2;
+            break;
+          default:
+            break;
+          }
+      }
+  }
+
+  bool isLineOrPath(const Fragment& f)
+  {
+    return f.type == Fragment::FR_LINESEG || f.type == Fragment::FR_PATH;
+  }
+
+  // transform fragment points and shared vertices
+  void transformFragments(FragmentVector& frags, const Mat4& M)
+  {
+    for(auto& f : frags)
+      if(!f.indexed)
+        for(unsigned pi=0, np=f.nPointsTotal(); pi<np; ++pi)
+          f.points[pi] = vec4to3(M*vec3to4(f.points[pi]));
+    for(auto& v : frags.vertices)
+      v = vec4to3(M*vec3to4(v));
+  }
+
   // Make scaling matrix to move points to correct output range
   Mat3 makeScreenM(const FragmentVector& frags,
 		   double x1, double y1, double x2, double y2)
@@ -127,6 +184,286 @@ namespace
       }
   }
 
+  // number of points lit together, small enough to stay in the cache
+#define LIGHT_BLOCK 256
+
+  // Block of points to be lit, stored as separate arrays so that the
+  // lights can be added to several points at once. Lighting is
+  // evaluated at position p with unit normal n (pointing away from
+  // the viewer), adding refl times the light to colour r, g, b.
+  struct LightingBlock
+  {
+    LightingBlock() : size(0) {}
+
+    void add(const Vec3& p, const Vec3& n, double _refl,
+             double _r, double _g, double _b)
+    {
+      px[size] = p(0); py[size] = p(1); pz[size] = p(2);
+      nx[size] = n(0); ny[size] = n(1); nz[size] = n(2);
+      refl[size] = _refl;
+      r[size] = _r; g[size] = _g; b[size] = _b;
+      ++size;
+    }
+
+    unsigned size;
+    double px[LIGHT_BLOCK], py[LIGHT_BLOCK], pz[LIGHT_BLOCK];
+    double nx[LIGHT_BLOCK], ny[LIGHT_BLOCK], nz[LIGHT_BLOCK];
+    double refl[LIGHT_BLOCK], r[LIGHT_BLOCK], g[LIGHT_BLOCK], b[LIGHT_BLOCK];
+  };
+
+  // add lights to points from start in block, where lights has the
+  // position then colour of each light
+  void applyLightsScalar(LightingBlock& lb, unsigned start,
+                         const std::vector<double>& lights)
+  {
+    for(unsigned i=start; i<lb.size; ++i)
+      for(unsigned li=0, s=lights.size(); li<s; li+=6)
+        {
+          // dot vector from light source to point with norm
+          Vec3 light2pt = Vec3(lb.px[i], lb.py[i], lb.pz[i]) -
+            Vec3(lights[li], lights[li+1], lights[li+2]);
+          light2pt.normalise();
+          const double dotprod = std::max(0., dot(light2pt,
+                                                  Vec3(lb.nx[i], lb.ny[i],
+                                                       lb.nz[i])));
+          const double delta = lb.refl[i] * dotprod;
+          lb.r[i] += delta*lights[li+3];
+          lb.g[i] += delta*lights[li+4];
+          lb.b[i] += delta*lights[li+5];
+        }
+  }
+
+#ifdef SCENE_X86_DISPATCH
+  // Four points at a time, with operations in the same order as the
+  // scalar code (no fused multiply-adds) for identical results.
+  __attribute__((target("avx2")))
+  void applyLightsAVX2(LightingBlock& lb, const std::vector<double>& lights)
+  {
+    const __m256d one = _mm256_set1_pd(1);
+    const __m256d zero = _mm256_setzero_pd();
+
+    unsigned i=0;
+    for(; i+4<=lb.size; i+=4)
+      {
+        const __m256d px = _mm256_loadu_pd(lb.px+i);
+        const __m256d py = _mm256_loadu_pd(lb.py+i);
+        const __m256d pz = _mm256_loadu_pd(lb.pz+i);
+        const __m256d nx = _mm256_loadu_pd(lb.nx+i);
+        const __m256d ny = _mm256_loadu_pd(lb.ny+i);
+        const __m256d nz = _mm256_loadu_pd(lb.nz+i);
+        const __m256d refl = _mm256_loadu_pd(lb.refl+i);
+        __m256d r = _mm256_loadu_pd(lb.r+i);
+        __m256d g = _mm256_loadu_pd(lb.g+i);
+        __m256d b = _mm256_loadu_pd(lb.b+i);
+
+        for(unsigned li=0, s=lights.size(); li<s; li+=6)
+          {
+            __m256d dx = _mm256_sub_pd(px, _mm256_set1_pd(lights[li]));
+            __m256d dy = _mm256_sub_pd(py, _mm256_set1_pd(lights[li+1]));
+            __m256d dz = _mm256_sub_pd(pz, _mm256_set1_pd(lights[li+2]));
+            const __m256d rad2 =
+              _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx),
+                                          _mm256_mul_pd(dy, dy)),
+                            _mm256_mul_pd(dz, dz));
+            const __m256d invrad = _mm256_div_pd(one, _mm256_sqrt_pd(rad2));
+            dx = _mm256_mul_pd(dx, invrad);
+            dy = _mm256_mul_pd(dy, invrad);
+            dz = _mm256_mul_pd(dz, invrad);
+
+            const __m256d dotprod =
+              _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, nx),
+                                          _mm256_mul_pd(dy, ny)),
+                            _mm256_mul_pd(dz, nz));
+            // max gives the second argument (zero) for NaN, like std::max
+            const __m256d delta = _mm256_mul_pd(refl,
+                                                _mm256_max_pd(dotprod, zero));
+
+            r = _mm256_add_pd(r, _mm256_mul_pd(delta,
+                                               _mm256_set1_pd(lights[li+3])));
+            g = _mm256_add_pd(g, _mm256_mul_pd(delta,
+                                               _mm256_set1_pd(lights[li+4])));
+            b = _mm256_add_pd(b, _mm256_mul_pd(delta,
+                                               _mm256_set1_pd(lights[li+5])));
+          }
+
+        _mm256_storeu_pd(lb.r+i, r);
+        _mm256_storeu_pd(lb.g+i, g);
+        _mm256_storeu_pd(lb.b+i, b);
+      }
+
+    applyLightsScalar(lb, i, lights);
+  }
+#endif
+
+  void applyLights(LightingBlock& lb, const std::vector<double>& lights)
+  {
+#ifdef SCENE_X86_DISPATCH
+    if(simdKernels())
+      {
+        applyLightsAVX2(lb, lights);
+        return;
+      }
+#endif
+    applyLightsScalar(lb, 0, lights);
+  }
+
+  // get base colour of fragment with property prop
+  template<class Prop> void fragColor(const Fragment& frag, const Prop* prop,
+                                      double& r, double& g, double& b,
+                                      double& a)
+  {
+    if(prop->hasRGBs())
+      {
+        QRgb rgb = prop->
+          rgbs[std::min(frag.index, unsigned(prop->rgbs.size())-1)];
+        r=qRed(rgb)*(1./255.); g=qGreen(rgb)*(1./255.);
+        b=qBlue(rgb)*(1./255.); a=qAlpha(rgb)*(1./255.);
+      }
+    else
+      {
+        r=prop->r; g=prop->g; b=prop->b; a=1-prop->trans;
+      }
+  }
+
+  QRgb makeRgba(double r, double g, double b, double a)
+  {
+    return qRgba( clip(int(r*255), 0, 255),
+                  clip(int(g*255), 0, 255),
+                  clip(int(b*255), 0, 255),
+                  clip(int(a*255), 0, 255) );
+  }
+
+  // centre of triangle
+  Vec3 triangleCentre(const Fragment& frag, const Vec3Vector& verts)
+  {
+    return (frag.point(verts, 0) + frag.point(verts, 1) +
+            frag.point(verts, 2)) * (1./3.);
+  }
+
+  // norm of triangle, pointing away from the viewer at (0,0,0)
+  Vec3 triangleNorm(const Fragment& frag, const Vec3Vector& verts,
+                    const Vec3& tripos)
+  {
+    const Vec3& p0 = frag.point(verts, 0);
+    Vec3 norm = cross(frag.point(verts, 1) - p0, frag.point(verts, 2) - p0);
+    if(dot(tripos, norm)<0)
+      norm = -norm;
+    return norm;
+  }
+
+  // size a path fragment is drawn at
+  double pathScale(const Fragment& frag, const FragmentPathParameters& pars,
+                   double linescale, double distscale)
+  {
+    double scale = frag.pathsize*linescale;
+    if(pars.scalepersp)
+      scale *= distscale;
+    return scale;
+  }
+
+  // markers within a factor of 2^(1/PATH_SCALE_STEPS) in size are
+  // drawn at the same size when making images or merging paths
+#define PATH_SCALE_STEPS 32
+  // largest number of marker images made per drawing
+#define MAX_SPRITES 4096
+  // largest width or height of marker image, in device pixels
+#define MAX_SPRITE_SIZE 256
+  // largest number of markers merged into one path
+#define MAX_MERGED 256
+
+  int quantiseScale(double scale)
+  {
+    return int(std::lround(std::log2(scale)*PATH_SCALE_STEPS));
+  }
+
+  double unquantiseScale(int idx)
+  {
+    return std::exp2(idx*(1./PATH_SCALE_STEPS));
+  }
+
+  // what determines the appearance of a path fragment
+  struct PathStyle
+  {
+    const QPainterPath* path;
+    const LineProp* lineprop;
+    const SurfaceProp* surfaceprop;
+    QRgb linecol, surfcol;
+    int scaleidx;
+
+    bool operator==(const PathStyle& o) const
+    {
+      return path==o.path && lineprop==o.lineprop &&
+        surfaceprop==o.surfaceprop && linecol==o.linecol &&
+        surfcol==o.surfcol && scaleidx==o.scaleidx;
+    }
+
+    bool operator<(const PathStyle& o) const
+    {
+      return
+        std::tie(path, lineprop, surfaceprop, linecol, surfcol, scaleidx) <
+        std::tie(o.path, o.lineprop, o.surfaceprop, o.linecol, o.surfcol,
+                 o.scaleidx);
+    }
+  };
+
+  // path drawn to an image, with the device position of the path
+  // origin in the image
+  struct Sprite
+  {
+    QImage image;
+    QPoint origin;
+  };
+
+  // draw path to an image at the scale given, in the same way as
+  // Scene::drawPath, with devscalex/y the scaling to device pixels
+  // (the image is null if it would be too large)
+  Sprite makeSprite(const QPainterPath& path, const QPen& pen,
+                    const QBrush& brush, bool scaleline, double scale,
+                    double devscalex, double devscaley)
+  {
+    const double penw = pen.style()==Qt::NoPen ? 0 :
+      pen.widthF()*(scaleline ? scale : 1);
+    // allow for miter joins, cosmetic pens and antialiasing
+    const double mx = penw*std::abs(devscalex)+2;
+    const double my = penw*std::abs(devscaley)+2;
+    const QRect rect = QTransform::fromScale(scale*devscalex, scale*devscaley).
+      mapRect(path.boundingRect()).adjusted(-mx, -my, mx, my).toAlignedRect();
+
+    Sprite sprite;
+    if(rect.width() > MAX_SPRITE_SIZE || rect.height() > MAX_SPRITE_SIZE)
+      return sprite;
+
+    sprite.image = QImage(rect.size(), QImage::Format_ARGB32_Premultiplied);
+    sprite.image.fill(Qt::transparent);
+    sprite.origin = -rect.topLeft();
+
+    QPainter painter(&sprite.image);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.translate(sprite.origin);
+    painter.scale(devscalex, devscaley);
+    painter.setPen(pen);
+    painter.setBrush(brush);
+    if(scaleline)
+      {
+        painter.scale(scale, scale);
+        painter.drawPath(path);
+      }
+    else
+      painter.drawPath(QTransform::fromScale(scale, scale).map(path));
+    painter.end();
+
+    return sprite;
+  }
+
+  // does rect overlap any of the rectangles?
+  bool overlapsAny(const QRectF& rect, const std::vector<QRectF>& rects)
+  {
+    for(const QRectF& r : rects)
+      if(rect.intersects(r))
+        return true;
+    return false;
+  }
+
 }; // namespace
 
 void Scene::addLight(Vec3 posn, QColor col, double intensity)
@@ -139,19 +476,22 @@ void Scene::addLight(Vec3 posn, QColor col, double intensity)
   lights.push_back(light);
 }
 
+QColor Scene::lineProp2QColor(const Fragment& frag) const
+{
+  if(frag.usecalccolor)
+    return QColor::fromRgba(frag.calccolor);
+
+  return frag.lineprop->color(frag.index);
+}
+
 QPen Scene::lineProp2QPen(const Fragment& frag, double linescale) const
 {
   const LineProp* p = frag.lineprop;
   if(p==0 || p->hide)
     return QPen(Qt::NoPen);
 
-  QColor col;
-  if(frag.usecalccolor)
-    col = QColor::fromRgba(frag.calccolor);
-  else
-    col = p->color(frag.index);
-
-  QPen pen( QPen(QBrush(col), p->width*linescale, p->style) );
+  QPen pen( QPen(QBrush(lineProp2QColor(frag)), p->width*linescale,
+                 p->style) );
 
   if(!p->dashpattern.empty())
     pen.setDashPattern(p->dashpattern);
@@ -190,10 +530,7 @@ void Scene::drawPath(QPainter* painter, const Fragment& frag,
 {
   FragmentPathParameters* pars =
     static_cast<FragmentPathParameters*>(frag.params);
-  double scale = frag.pathsize*linescale;
-
-  if(pars->scalepersp)
-    scale *= distscale;
+  const double scale = pathScale(frag, *pars, linescale, distscale);
 
   // hook into drawing routine
   if(pars->runcallback)
@@ -243,6 +580,26 @@ void Scene::doDrawing(QPainter* painter, const Mat3& screenM, double linescale,
   painter->setPen(no_pen);
   painter->setBrush(no_brush);
 
+  // Markers are batched if each fragment is not reported. For
+  // bitmaps they are drawn as images in device coordinates, made
+  // once for each style and quantised size. Otherwise successive
+  // markers of the same style are merged into one path, if they do
+  // not overlap, so that the merged path looks the same as drawing
+  // them one by one (overlapping fills would composite once, or
+  // cancel with the odd-even rule, and outlines would be drawn over
+  // the fills of nearer markers).
+  const QTransform worldM(painter->worldTransform());
+  const bool usesprites = pointsprites && callback==0 &&
+    worldM.type() <= QTransform::TxScale;
+  const bool mergepaths = !pointsprites && callback==0;
+  std::map<PathStyle, Sprite> sprites;
+  bool devicecoords = false;
+  QPainterPath merged;
+  PathStyle mergedstyle;
+  std::vector<QRectF> mergedrects;
+  double mergedmargin = 0;
+  bool merging = false;
+
   QPointF projpts[3];
 
   for(unsigned i=0, s=draworder.size(); i<s; ++i)
@@ -257,6 +614,80 @@ void Scene::doDrawing(QPainter* painter, const Mat3& screenM, double linescale,
           projpts[pi].setY(p(1));
         }
 
+      // is this a marker which can be drawn as an image or merged?
+      const Sprite* sprite = 0;
+      bool mergeable = false;
+      double pathscale = 0;
+      PathStyle style;
+      QRectF pathrect;
+      if(frag.type == Fragment::FR_PATH && (usesprites || mergepaths))
+        {
+          const FragmentPathParameters* pars =
+            static_cast<FragmentPathParameters*>(frag.params);
+          pathscale = pathScale(frag, *pars, linescale,
+                                dist0 / frag.points[0].rad());
+
+          if(!pars->runcallback && pathscale > 0 && std::isfinite(pathscale))
+            {
+              style.path = pars->path;
+              style.lineprop = frag.lineprop;
+              style.surfaceprop = frag.surfaceprop;
+              style.linecol = frag.lineprop!=0 && !frag.lineprop->hide ?
+                lineProp2QColor(frag).rgba() : 0;
+              style.surfcol = frag.surfaceprop!=0 && !frag.surfaceprop->hide ?
+                surfaceProp2QColor(frag).rgba() : 0;
+              // merged paths only need the same size if the line
+              // width scales with it
+              style.scaleidx = usesprites || pars->scaleline ?
+                quantiseScale(pathscale) : 0;
+
+              if(usesprites)
+                {
+                  auto it = sprites.find(style);
+                  if(it == sprites.end() && sprites.size() < MAX_SPRITES)
+                    it = sprites.emplace(
+                      style,
+                      makeSprite(*(pars->path),
+                                 lineProp2QPen(frag, linescale),
+                                 surfaceProp2QBrush(frag),
+                                 pars->scaleline,
+                                 unquantiseScale(style.scaleidx),
+                                 worldM.m11(), worldM.m22())).first;
+                  if(it != sprites.end() && !it->second.image.isNull())
+                    sprite = &it->second;
+                }
+              else
+                {
+                  mergeable = true;
+                  pathrect = QTransform(pathscale, 0, 0, pathscale,
+                                        projpts[0].x(), projpts[0].y()).
+                    mapRect(pars->path->controlPointRect());
+                }
+            }
+        }
+
+      // return to normal drawing if needed
+      if(devicecoords && sprite==0)
+        {
+          painter->setWorldTransform(worldM);
+          devicecoords = false;
+        }
+      if(merging && !(mergeable && style==mergedstyle &&
+                      mergedrects.size() < MAX_MERGED &&
+                      !overlapsAny(pathrect.adjusted(-mergedmargin,
+                                                     -mergedmargin,
+                                                     mergedmargin,
+                                                     mergedmargin),
+                                   mergedrects)))
+        {
+          painter->drawPath(merged);
+          merged = QPainterPath();
+          mergedrects.clear();
+          merging = false;
+          // the pen width may have been changed for the merged path
+          ltype = Fragment::FR_NONE;
+        }
+
       switch(frag.type)
 	{
 	case Fragment::FR_TRIANGLE:
@@ -303,6 +734,56 @@ void Scene::doDrawing(QPainter* painter, const Mat3& screenM, double linescale,
           break;
 
 	case Fragment::FR_PATH:
+          if(sprite != 0)
+            {
+              // blit image at the nearest device pixel (the pen and
+              // brush are left alone)
+              if(!devicecoords)
+                {
+                  painter->setWorldTransform(QTransform());
+                  devicecoords = true;
+                }
+              const QPointF pt(worldM.map(projpts[0]));
+              painter->drawImage(
+                QPoint(int(std::floor(pt.x()+0.5)) - sprite->origin.x(),
+                       int(std::floor(pt.y()+0.5)) - sprite->origin.y()),
+                sprite->image);
+            }
+          else if(mergeable)
+            {
+              const FragmentPathParameters* pars =
+                static_cast<FragmentPathParameters*>(frag.params);
+              if(!merging)
+                {
+                  // start a new merged path, with the line width of
+                  // the quantised size if the line scales
+                  const QPen pen(
+                    lineProp2QPen(frag, pars->scaleline ?
+                                  linescale*unquantiseScale(style.scaleidx) :
+                                  linescale));
+                  painter->setPen(pen);
+                  painter->setBrush(surfaceProp2QBrush(frag));
+                  lline = frag.lineprop;
+                  lsurf = frag.surfaceprop;
+                  // markers in the path do not overlap, so the fill
+                  // rule only applies within each marker
+                  merged.setFillRule(pars->path->fillRule());
+                  // allow for miter joins and antialiasing
+                  mergedmargin = (pen.style()==Qt::NoPen ? 0 : pen.widthF())
+                    + 1;
+                  mergedstyle = style;
+                  merging = true;
+                }
+              merged.addPath(
+                QTransform(pathscale, 0, 0, pathscale,
+                           projpts[0].x(), projpts[0].y()).
+                map(*(pars->path)));
+              mergedrects.push_back(pathrect.adjusted(-mergedmargin,
+                                                      -mergedmargin,
+                                                      mergedmargin,
+                                                      mergedmargin));
+            }
+          else
             {
               if(ltype != frag.type || lline != frag.lineprop ||
                  ((frag.lineprop!=0 && frag.lineprop->hasRGBs())))
@@ -335,57 +816,11 @@ void Scene::doDrawing(QPainter* painter, const Mat3& screenM, double linescale,
 
       ltype = frag.type;
     }
-}
-
-void Scene::calcLightingTriangle(Fragment& frag)
-{
-  // Calculate triangle norm. Make sure norm points towards
-  // the viewer @ (0,0,0)
-  Vec3 tripos = (frag.points[0] + frag.points[1] +
-                 frag.points[2]) * (1./3.);
-  Vec3 norm = cross(frag.points[1] - frag.points[0],
-                    frag.points[2] - frag.points[0]);
-  if(dot(tripos, norm)<0)
-    norm = -norm;
-  norm.normalise();
-
-  // get color of surface
-  const SurfaceProp* prop = frag.surfaceprop;
-  if(prop->refl==0.)
-    return;
-
-  double r, g, b, a;
-  if(prop->hasRGBs())
-    {
-      QRgb rgb = prop->
-        rgbs[std::min(frag.index, unsigned(prop->rgbs.size())-1)];
-      r=qRed(rgb)*(1./255.); g=qGreen(rgb)*(1./255.);
-      b=qBlue(rgb)*(1./255.); a=qAlpha(rgb)*(1./255.);
-    }
-  else
-    {
-      r=prop->r; g=prop->g; b=prop->b; a=1-prop->trans;
-    }
-
-  // add lighting contributions
-  for(auto const& light : lights)
-    {
-      // Now dot vector from light source to triangle with norm
-      Vec3 light2tri = tripos-light.posn;
-      light2tri.normalise();
-
-      // add new lighting index
-      double dotprod = std::max(0., dot(light2tri, norm));
-
-      double delta = prop->refl * dotprod;
-      r += delta*light.r; g += delta*light.g; b += delta*light.b;
-    }
 
-  frag.calccolor = qRgba( clip(int(r*255), 0, 255),
-                          clip(int(g*255), 0, 255),
-                          clip(int(b*255), 0, 255),
-                          clip(int(a*255), 0, 255) );
-  frag.usecalccolor = 1;
+  if(merging)
+    painter->drawPath(merged);
+  if(devicecoords)
+    painter->setWorldTransform(worldM);
 }
 
 void Scene::calcLightingLine(Fragment& frag)
@@ -395,17 +830,7 @@ void Scene::calcLightingLine(Fragment& frag)
     return;
 
   double r, g, b, a;
-  if(prop->hasRGBs())
-    {
-      QRgb rgb = prop->
-        rgbs[std::min(frag.index, unsigned(prop->rgbs.size())-1)];
-      r=qRed(rgb)*(1./255.); g=qGreen(rgb)*(1./255.);
-      b=qBlue(rgb)*(1./255.); a=qAlpha(rgb)*(1./255.);
-    }
-  else
-    {
-      r=prop->r; g=prop->g; b=prop->b; a=1-prop->trans;
-    }
+  fragColor(frag, prop, r, g, b, a);
 
   Vec3 pmid = (frag.points[0]+frag.points[1])*0.5;
   Vec3 linevec(frag.points[1]-frag.points[0]);
@@ -422,48 +847,155 @@ void Scene::calcLightingLine(Fragment& frag)
       r += delta*light.r; g += delta*light.g; b += delta*light.b;
     }
 
-  frag.calccolor = qRgba( clip(int(r*255), 0, 255),
-                          clip(int(g*255), 0, 255),
-                          clip(int(b*255), 0, 255),
-                          clip(int(a*255), 0, 255) );
+  frag.calccolor = makeRgba(r, g, b, a);
   frag.usecalccolor = 1;
 }
 
-void Scene::calcLighting()
+void Scene::calcLighting(unsigned start, unsigned end)
 {
   // lighting is full on
   if(lights.empty())
     return;
 
-  for(auto &frag : fragments)
+  std::vector<double> lightdata;
+  for(auto const& light : lights)
+    lightdata.insert(lightdata.end(),
+                     {light.posn(0), light.posn(1), light.posn(2),
+                      light.r, light.g, light.b});
+
+  // With smooth shading, triangles using shared vertices are lit at
+  // their vertices, using the normals averaged over the triangles
+  // around each vertex (weighted by area), and take the average of
+  // the lighting of their vertices.
+  std::vector<Vec3> vertnorms;
+  if(smoothshading)
+    for(unsigned i=start; i<end; ++i)
+      {
+        const Fragment& frag = fragments[i];
+        if(frag.type == Fragment::FR_TRIANGLE && frag.surfaceprop != 0 &&
+           frag.surfaceprop->refl != 0. && frag.indexed)
+          {
+            if(vertnorms.empty())
+              vertnorms.assign(fragments.vertices.size(), Vec3(0,0,0));
+            const Vec3 tripos = triangleCentre(frag, fragments.vertices);
+            const Vec3 norm = triangleNorm(frag, fragments.vertices, tripos);
+            for(unsigned vi=0; vi<3; ++vi)
+              vertnorms[frag.vertidx[vi]] += norm;
+          }
+      }
+
+  // Vertices made by splitting triangles (which may happen before
+  // lighting with a cached BSP tree) take the normal interpolated
+  // along the edge they split, so the pieces are shaded without
+  // seams. Splits of splits come later in the list.
+  if(!vertnorms.empty())
+    for(const auto& sv : fragments.splitvertices)
+      {
+        Vec3 n1 = vertnorms[sv.v1];
+        Vec3 n2 = vertnorms[sv.v2];
+        if(n1 != Vec3(0,0,0))
+          n1.normalise();
+        if(n2 != Vec3(0,0,0))
+          n2.normalise();
+        vertnorms[sv.idx] = n1*(1-sv.frac) + n2*sv.frac;
+      }
+
+  // lighting (without reflectivity) at each vertex
+  std::vector<Vec3> vertlight(vertnorms.size());
+  LightingBlock lb;
+  unsigned blockidx[LIGHT_BLOCK];
+  for(unsigned vi=0, s=vertnorms.size(); vi<=s; ++vi)
     {
-      switch(frag.type)
+      if(lb.size == LIGHT_BLOCK || (vi == s && lb.size > 0))
+        {
+          applyLights(lb, lightdata);
+          for(unsigned bi=0; bi<lb.size; ++bi)
+            vertlight[blockidx[bi]] = Vec3(lb.r[bi], lb.g[bi], lb.b[bi]);
+          lb.size = 0;
+        }
+      if(vi < s && vertnorms[vi] != Vec3(0,0,0))
+        {
+          Vec3 norm = vertnorms[vi];
+          norm.normalise();
+          blockidx[lb.size] = vi;
+          lb.add(fragments.vertices[vi], norm, 1, 0, 0, 0);
+        }
+    }
+
+  // other triangles are lit at their centres in blocks
+  double blockalpha[LIGHT_BLOCK];
+  for(unsigned i=start; i<=end; ++i)
+    {
+      if(lb.size == LIGHT_BLOCK || (i == end && lb.size > 0))
+        {
+          applyLights(lb, lightdata);
+          for(unsigned bi=0; bi<lb.size; ++bi)
+            {
+              Fragment& frag = fragments[blockidx[bi]];
+              frag.calccolor = makeRgba(lb.r[bi], lb.g[bi], lb.b[bi],
+                                        blockalpha[bi]);
+              frag.usecalccolor = 1;
+            }
+          lb.size = 0;
+        }
+      if(i == end)
+        break;
+
+      Fragment& frag = fragments[i];
+      if(frag.type == Fragment::FR_LINESEG)
         {
-        case Fragment::FR_TRIANGLE:
-          if(frag.surfaceprop != 0)
-            calcLightingTriangle(frag);
-          break;
-        case Fragment::FR_LINESEG:
           if(frag.lineprop != 0)
             calcLightingLine(frag);
-          break;
-        default:
-          break;
+        }
+      else if(frag.type == Fragment::FR_TRIANGLE && frag.surfaceprop != 0 &&
+              frag.surfaceprop->refl != 0.)
+        {
+          const SurfaceProp* prop = frag.surfaceprop;
+          double r, g, b, a;
+          fragColor(frag, prop, r, g, b, a);
+
+          if(!vertnorms.empty() && frag.indexed)
+            {
+              const double refl = prop->refl * (1./3.);
+              for(unsigned vi=0; vi<3; ++vi)
+                {
+                  const Vec3& vl = vertlight[frag.vertidx[vi]];
+                  r += refl*vl(0); g += refl*vl(1); b += refl*vl(2);
+                }
+              frag.calccolor = makeRgba(r, g, b, a);
+              frag.usecalccolor = 1;
+            }
+          else
+            {
+              const Vec3 tripos = triangleCentre(frag, fragments.vertices);
+              Vec3 norm = triangleNorm(frag, fragments.vertices, tripos);
+              norm.normalise();
+              blockidx[lb.size] = i;
+              blockalpha[lb.size] = a;
+              lb.add(tripos, norm, prop->refl, r, g, b);
+            }
         }
     }
 }
 
 void Scene::projectFragments(const Camera& cam)
 {
-  // convert 3d to 2d coordinates using the Camera
+  // convert 3d to 2d coordinates using the Camera, projecting the
+  // shared vertices only once
+  const Vec3Vector& verts = fragments.vertices;
+  Vec3Vector projverts(verts.size());
+  for(unsigned i=0, s=verts.size(); i<s; ++i)
+    projverts[i] = calcProjVec(cam.perspM, verts[i]);
+
   for(auto& f : fragments)
     for(unsigned pi=0, np=f.nPointsTotal(); pi<np; ++pi)
-      f.proj[pi] = calcProjVec(cam.perspM, f.points[pi]);
+      f.proj[pi] = f.indexed ? projverts[f.vertidx[pi]] :
+        calcProjVec(cam.perspM, f.points[pi]);
 }
 
 void Scene::renderPainters(const Camera& cam)
 {
-  calcLighting();
+  calcLighting(0, fragments.size());
 
   breakLongLines(fragments, 0.25);
   projectFragments(cam);
@@ -483,32 +1015,15 @@ void Scene::renderPainters(const Camera& cam)
 
 void Scene::renderBSP(const Camera& cam)
 {
-  calcLighting();
+  calcLighting(0, fragments.size());
 
   //std::cout << "\nFragment size 1 " << fragments.size() << '\n';
 
-  // This is a hack to force lines to be rendered in front of
-  // triangles and paths to be rendered in front of lines. Suggestions
-  // to fix this are welcome.
-  for(auto& f : fragments)
-    {
-      switch(f.type)
-        {
-        case Fragment::FR_LINESEG:
-          f.points[0](2) += LINE_DELTA_DEPTH;
-          f.points[1](2) += LINE_DELTA_DEPTH;
-          break;
-        case Fragment::FR_PATH:
-          f.points[0](2) += 2*LINE_DELTA_DEPTH;
-          f.points[1](2) += 2*LINE_DELTA_DEPTH;
-          break;
-        default:
-          break;
-        }
-    }
+  nudgeLines(fragments, 0, fragments.size());
 
-  BSPBuilder bsp(fragments, Vec3(0,0,1));
+  BSPBuilder bsp(fragments, Vec3(0,0,1), bspplanesamples);
   draworder = bsp.getFragmentIdxs(fragments);
+  bspstats = bsp.stats;
 
   //std::cout << "BSP recs size " << bsp.bsp_recs.size() << '\n';
   //std::cout << "Fragment size 2 " << fragments.size() << '\n';
@@ -516,6 +1031,118 @@ void Scene::renderBSP(const Camera& cam)
   projectFragments(cam);
 }
 
+void Scene::renderBSPCached(ObjectContainer* root, const Camera& cam,
+                            const Frustum& frustum)
+{
+  // The fragments which do not depend on the view are made in the
+  // coordinates of the children of root, with their BSP tree. As the
+  // view is rotated using root->objM, these are reused until the
+  // objects change. Only the view-dependent fragments are culled by
+  // the frustum; the cached ones are clipped when drawn.
+  //
+  // Lines and paths go on the side of the eye of planes they lie in
+  // (see BSPBuilder), so they are kept out of the cached tree, and
+  // are added to it for each view like the view-dependent fragments.
+  const unsigned long long stamp = root->changeStamp();
+  if(root != cacheroot || stamp != cachestamp ||
+     bspplanesamples != cacheplanesamples)
+    {
+      cachefrags.resize(0);
+      cachefrags.vertices.resize(0);
+      cachefrags.splitvertices.resize(0);
+
+      const Mat4 identM(identityM4());
+      const std::vector<Object*>& objects = root->objects;
+      const unsigned s = objects.size();
+      const unsigned nchunks = numChunks(s, 1);
+      parallelFragments(cachefrags, nchunks,
+                        [&](unsigned chunk, FragmentVector& out)
+        {
+          const unsigned end = chunkBegin(s, chunk+1, nchunks);
+          for(unsigned i=chunkBegin(s, chunk, nchunks); i<end; ++i)
+            objects[i]->getFragmentsByView(cam.perspM, identM, false,
+                                           Frustum(), out);
+        });
+
+      const auto firstline = std::stable_partition(
+        cachefrags.begin(), cachefrags.end(),
+        [](const Fragment& f) { return !isLineOrPath(f); });
+      cachelines.assign(firstline, cachefrags.end());
+      cachefrags.erase(firstline, cachefrags.end());
+
+      cachebsp = BSPBuilder(cachefrags, Vec3(0,0,1), bspplanesamples);
+      litvalid = false;
+      cacheroot = root;
+      cachestamp = stamp;
+      cacheplanesamples = bspplanesamples;
+    }
+  bspstats = cachebsp.stats;
+
+  // add the fragments which depend on the view, converting them to
+  // the cached coordinates
+  fragments = cachefrags;
+  const unsigned extrastart = fragments.size();
+  fragments.insert(fragments.end(), cachelines.begin(), cachelines.end());
+  const unsigned viewstart = fragments.size();
+  const unsigned extravertstart = fragments.vertices.size();
+  root->getFragmentsByView(cam.perspM, cam.viewM, true, frustum, fragments);
+  nudgeLines(fragments, viewstart, fragments.size());
+
+  // the cached lines are nudged by the same amount, converted to the
+  // cached coordinates, so they are drawn as by renderBSP
+  const Mat4 modelM(cam.viewM*root->objM);
+  const Mat4 invM(invertAffineM4(modelM));
+  nudgeLines(fragments, extrastart, viewstart,
+             vec4to3(invM*Vec4(0,0,LINE_DELTA_DEPTH,1)) -
+             vec4to3(invM*Vec4(0,0,0,1)));
+  for(unsigned i=viewstart, s=fragments.size(); i<s; ++i)
+    {
+      Fragment& f = fragments[i];
+      if(!f.indexed)
+        for(unsigned pi=0, np=f.nPointsTotal(); pi<np; ++pi)
+          f.points[pi] = vec4to3(invM*vec3to4(f.points[pi]));
+    }
+  for(unsigned i=extravertstart, s=fragments.vertices.size(); i<s; ++i)
+    fragments.vertices[i] = vec4to3(invM*vec3to4(fragments.vertices[i]));
+
+  // the camera is at the origin of its coordinates
+  const Vec3 eye(vec4to3(invM*Vec4(0,0,0,1)));
+  draworder = cachebsp.getFragmentIdxs(fragments, eye, extrastart);
+
+  transformFragments(fragments, modelM);
+
+  // lighting of the cached fragments only changes if the view or
+  // lights change
+  const unsigned ncached = cachefrags.size();
+  if(litvalid && litM == modelM && litlights == lights &&
+     litsmooth == smoothshading)
+    {
+      for(unsigned i=0; i<ncached; ++i)
+        {
+          fragments[i].calccolor = litcolors[i];
+          fragments[i].usecalccolor = litused[i];
+        }
+    }
+  else
+    {
+      calcLighting(0, ncached);
+      litcolors.resize(ncached);
+      litused.resize(ncached);
+      for(unsigned i=0; i<ncached; ++i)
+        {
+          litcolors[i] = fragments[i].calccolor;
+          litused[i] = fragments[i].usecalccolor;
+        }
+      litvalid = true;
+      litM = modelM;
+      litlights = lights;
+      litsmooth = smoothshading;
+    }
+  calcLighting(ncached, fragments.size());
+
+  projectFragments(cam);
+}
+
 void Scene::render(Object* root,
                    QPainter* painter, const Camera& cam,
                    double x1, double y1, double x2, double y2,
@@ -581,6 +1208,10 @@ unsigned long long Scene::idPixel(Object* root,
   return callback.lastwidgetid;
 }
 
+// fraction of the drawing size added around it when skipping objects
+// outside it, so that wide lines just outside are kept
+#define FRUSTUM_MARGIN 0.1
+
 void Scene::render_internal(Object* root,
                             QPainter* painter, const Camera& cam,
                             double x1, double y1, double x2, double y2,
@@ -589,22 +1220,49 @@ void Scene::render_internal(Object* root,
 {
   fragments.reserve(init_fragments_size);
   fragments.resize(0);
+  fragments.vertices.resize(0);
+  fragments.splitvertices.resize(0);
   draworder.resize(0);
 
-  // get fragments for whole scene
-  root->getFragments(cam.perspM, cam.viewM, fragments);
+  // With a fixed scale, skip objects outside the drawing area.
+  // Otherwise the scene is scaled to fit everything in. The drawing
+  // is not clipped, so the area is enlarged by a margin to keep wide
+  // lines just outside it, which can be partly visible.
+  Frustum frustum;
+  const double fixedscaling = 0.5*std::min(x2-x1, y2-y1)*scale;
+  if(fixedscaling > 0)
+    frustum = Frustum(cam.perspM,
+                      (0.5+FRUSTUM_MARGIN)*std::abs(x2-x1)/fixedscaling,
+                      (0.5+FRUSTUM_MARGIN)*std::abs(y2-y1)/fixedscaling);
+
+  // get fragments for whole scene, using a pool of threads for the
+  // objects and larger datasets (kept between renders)
+  if(numthreads != 1 && !pool)
+    pool.reset(new TaskPool(numthreads));
+  {
+    TaskPoolScope poolscope(pool.get());
 
-  switch(mode)
-    {
-    case RENDER_BSP:
-      renderBSP(cam);
-      break;
-    case RENDER_PAINTERS:
-      renderPainters(cam);
-      break;
-    default:
-      break;
-    }
+    // the BSP tree can be cached if the view is only set by the root
+    ObjectContainer* cont = dynamic_cast<ObjectContainer*>(root);
+    if(mode == RENDER_BSP && cont != 0 && cont->reusableAsRoot())
+      renderBSPCached(cont, cam, frustum);
+    else
+      {
+        root->getVisibleFragments(cam.perspM, cam.viewM, frustum, fragments);
+
+        switch(mode)
+          {
+          case RENDER_BSP:
+            renderBSP(cam);
+            break;
+          case RENDER_PAINTERS:
+            renderPainters(cam);
+            break;
+          default:
+            break;
+          }
+      }
+  }
 
   // how to transform projected points to screen (screenM is member)
   screenM = scale<=0 ?
@@ -620,4 +1278,9 @@ void Scene::render_internal(Object* root,
   init_fragments_size = fragments.size();
   if(init_fragments_size > 65536)
     init_fragments_size /= 2;
+
+  // release the fragments of this render, so that only the cache is
+  // held between renders
+  fragments = FragmentVector();
+  draworder = std::vector<unsigned>();
 }
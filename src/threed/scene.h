@@ -21,11 +21,14 @@
 #ifndef SCENE_H
 #define SCENE_H
 
+#include <memory>
 #include <vector>
 #include <QtGui/QPainter>
 #include "mmaths.h"
 #include "objects.h"
 #include "camera.h"
+#include "bsp.h"
+#include "parallel.h"
 
 class Scene
 {
@@ -38,6 +41,11 @@ private:
   {
     Vec3 posn;
     double r, g, b;
+
+    bool operator==(const Light& o) const
+    {
+      return posn==o.posn && r==o.r && g==o.g && b==o.b;
+    }
   };
 
   // if passed to drawing routine, this is called after drawing each
@@ -52,12 +60,41 @@ private:
 
 public:
   Scene(RenderMode _mode)
-    : mode(_mode)
+    : mode(_mode), numthreads(0), bspplanesamples(BSP_DEFAULT_PLANE_SAMPLES),
+      smoothshading(false), pointsprites(false),
+      cacheroot(0), cachestamp(0), cacheplanesamples(0),
+      litvalid(false), litsmooth(false)
   {
   }
 
+  // number of threads used to generate fragments (0 for one per
+  // core, 1 to not use extra threads)
+  void setNumThreads(unsigned n)
+  {
+    if(n != numthreads)
+      {
+        numthreads = n;
+        pool.reset();
+      }
+  }
+
+  // number of planes sampled when splitting each BSP node (default
+  // BSP_DEFAULT_PLANE_SAMPLES, or 0 to use the largest triangle; see
+  // BSPBuilder)
+  void setBSPPlaneSamples(unsigned n) { bspplanesamples = n; }
+
+  // light triangles using normals averaged around mesh vertices,
+  // rather than the normal of each triangle
+  void setSmoothShading(bool smooth) { smoothshading = smooth; }
+
+  // draw markers as images made once for each style and quantised
+  // size, for output to bitmaps (otherwise markers of the same style
+  // drawn in succession are merged into single paths)
+  void setPointSprites(bool sprites) { pointsprites = sprites; }
+
   // add a light to a list
   void addLight(Vec3 posn, QColor col, double intensity);
+  void clearLights() { lights.clear(); }
 
   // render scene to painter in coordinate range given
   // (if scale<=0 then automatic scaling)
@@ -74,10 +111,12 @@ public:
   // last screen matrix
   Mat3 screenM;
 
+  // statistics from the last BSP tree built
+  BSPStats bspstats;
+
 private:
-  // calculate lighting norms for triangles
-  void calcLighting();
-  void calcLightingTriangle(Fragment& frag);
+  // calculate lighting colours for fragments from start to end
+  void calcLighting(unsigned start, unsigned end);
   void calcLightingLine(Fragment& frag);
 
   // compute projected coordinates
@@ -93,6 +132,9 @@ private:
   // different rendering modes
   void renderPainters(const Camera& cam);
   void renderBSP(const Camera& cam);
+  // BSP rendering reusing the tree from the last render if possible
+  void renderBSPCached(ObjectContainer* root, const Camera& cam,
+                       const Frustum& frustum);
 
   // render scene to painter in coordinate range given
   // (if scale<=0 then automatic scaling)
@@ -102,6 +144,7 @@ private:
                        DrawCallback* callback=0);
 
   // create pens/brushes
+  QColor lineProp2QColor(const Fragment& frag) const;
   QPen lineProp2QPen(const Fragment& frag, double linescale) const;
   QColor surfaceProp2QColor(const Fragment& frag) const;
   QBrush surfaceProp2QBrush(const Fragment& frag) const;
@@ -109,9 +152,30 @@ private:
 
 private:
   RenderMode mode;
+  unsigned numthreads;
+  std::unique_ptr<TaskPool> pool;
+  unsigned bspplanesamples;
+  bool smoothshading;
+  bool pointsprites;
   FragmentVector fragments;
   std::vector<unsigned> draworder;
   std::vector<Light> lights;
+
+  // view-independent fragments and BSP tree from the last render
+  Object* cacheroot;
+  unsigned long long cachestamp;
+  unsigned cacheplanesamples;
+  FragmentVector cachefrags;
+  FragmentVector cachelines;    // lines and paths, not in the tree
+  BSPBuilder cachebsp;
+
+  // lighting of the cached fragments, with the view and lights used
+  bool litvalid;
+  Mat4 litM;
+  std::vector<Light> litlights;
+  bool litsmooth;
+  std::vector<QRgb> litcolors;
+  std::vector<bool> litused;
 };
 
 #endif
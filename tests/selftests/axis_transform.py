@@ -0,0 +1,95 @@
+# Check that AxisTransform converts data to plotter coordinates as the
+# Python code in Axis does
+
+import sys
+
+import numpy as N
+import veusz.qtall as qt
+from veusz.helpers import qtloops
+from veusz.widgets.axis import Axis
+
+class PythonAxis:
+    """Just enough of an axis to use the Python conversion in Axis."""
+
+    _graphToPlotter = Axis._graphToPlotter
+    linearConvertToPlotter = Axis.linearConvertToPlotter
+    logConvertToPlotter = Axis.logConvertToPlotter
+
+    def __init__(self, log, datascale, minval, maxval, pix1, pix2):
+        self.log = log
+        self.datascale = datascale
+        self.plottedrange = [minval, maxval]
+        self.coordParr1, self.coordParr2 = pix1, pix2
+
+    def plottedLog(self):
+        return self.log
+
+    def convert(self, data):
+        return self._graphToPlotter(data*self.datascale)
+
+    def transform(self):
+        AT = qtloops.AxisTransform
+        return AT(
+            AT.LOG if self.log else AT.LINEAR, self.datascale,
+            self.plottedrange[0], self.plottedrange[1],
+            self.coordParr1, self.coordParr2)
+
+def testData(log):
+    """Values to convert, including non-finite ones."""
+    rng = N.random.RandomState(42)
+    if log:
+        vals = 10**rng.uniform(-5, 5, size=1000)
+        special = [0., -1., 1e-120, 1e120]
+    else:
+        vals = rng.uniform(-100, 100, size=1000)
+        special = [0., -0.]
+    return N.concatenate((
+        vals, special, [N.nan, N.inf, -N.inf], vals[:3]))
+
+def main(outfile):
+    out = []
+    axes = [
+        PythonAxis(False, 1, 0, 1, 0, 1),
+        PythonAxis(False, 2.5, -50, 80, 310, 20),
+        PythonAxis(True, 1, 1e-3, 1e4, 15, 400),
+        PythonAxis(True, 0.1, 1e2, 1e-2, 300, 50),
+    ]
+    for i, axis in enumerate(axes):
+        data = testData(axis.log)
+        trans = axis.transform()
+        converted = trans.convertArray(data)
+        expected = axis.convert(data)
+        if axis.log:
+            # the C library log may differ from numpy's in the last bit
+            assert N.allclose(converted, expected, rtol=1e-12, atol=1e-9,
+                              equal_nan=True), 'axis %i differs' % i
+        else:
+            assert N.array_equal(converted, expected, equal_nan=True), (
+                'axis %i differs' % i)
+
+        # single values
+        for v in data[:10]:
+            assert abs(trans.convert(v) - axis.convert(v)) < 1e-9
+
+        # converting straight into a polygon gives the same points as
+        # converting the columns first
+        ydata = data[::-1].copy()
+        ytrans = axes[1].transform()
+        poly1 = qt.QPolygonF()
+        qtloops.addTransformedToPolygonF(poly1, data, ydata, trans, ytrans)
+        poly2 = qt.QPolygonF()
+        qtloops.addNumpyToPolygonF(
+            poly2, trans.convertArray(data), ytrans.convertArray(ydata))
+        assert len(poly1) == len(poly2), 'polygon %i has wrong length' % i
+        pts1 = N.array([(p.x(), p.y()) for p in poly1])
+        pts2 = N.array([(p.x(), p.y()) for p in poly2])
+        assert N.array_equal(pts1, pts2, equal_nan=True), (
+            'polygon %i differs' % i)
+
+        out.append('axis %i ok' % i)
+
+    with open(outfile, 'w') as f:
+        f.write('\n'.join(out) + '\n')
+
+if __name__ == '__main__':
+    main(sys.argv[1])
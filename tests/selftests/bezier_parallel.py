@@ -0,0 +1,90 @@
+# Check that fitting beziers to a long line in parallel spans gives a
+# joined curve within the fitting error of the data, and that short
+# lines are fitted as by bezier_fit_cubic_multi
+
+import sys
+
+import numpy as N
+import veusz.qtall as qt
+from veusz.helpers import qtloops
+
+ERROR = 0.1
+
+def makePoly(npts):
+    """Smooth line, with a corner at x=50."""
+    x = N.linspace(0, 100, npts)
+    y = 10*N.sin(x/3) + 0.5*N.abs(x-50)
+    poly = qt.QPolygonF()
+    qtloops.addNumpyToPolygonF(poly, x, y)
+    return x, y, poly
+
+def toArray(poly):
+    """Convert QPolygonF to numpy array of points."""
+    return N.array([(p.x(), p.y()) for p in poly])
+
+def bezierPoints(c, t):
+    """Points on cubic c (4x2 array) at parameters t."""
+    t = t[:, N.newaxis]
+    s = 1-t
+    return s**3*c[0] + 3*s*s*t*c[1] + 3*s*t*t*c[2] + t**3*c[3]
+
+def checkLong():
+    """Fit a long line, checking the fit."""
+    x, y, poly = makePoly(20001)
+    out = toArray(qtloops.bezier_fit_cubic_parallel(
+        poly, ERROR, len(poly)+1))
+    assert len(out) > 0 and len(out) % 4 == 0, 'fit failed'
+    cubics = out.reshape(-1, 4, 2)
+
+    data = N.column_stack((x, y))
+    assert N.all(cubics[0,0] == data[0]), 'wrong start'
+    assert N.all(cubics[-1,3] == data[-1]), 'wrong end'
+
+    t = N.linspace(0, 1, 1001)
+    tol = N.sqrt(ERROR + 1e-9) * 1.01
+    start = 0
+    for i, c in enumerate(cubics):
+        # cubics end at data points
+        end = N.nonzero(N.all(data == c[3], axis=1))[0]
+        assert len(end) == 1 and end[0] > start, 'cubic not ending at data'
+        end = end[0]
+
+        # each data point should be close to the cubic
+        pts = bezierPoints(c, t)
+        seg = data[start:end+1]
+        dist = N.sqrt(
+            ((seg[:, N.newaxis, :] - pts[N.newaxis, :, :])**2).sum(axis=2))
+        assert dist.min(axis=1).max() < tol, 'fit not within error'
+
+        if i+1 < len(cubics):
+            nextc = cubics[i+1]
+            assert N.all(nextc[0] == c[3]), 'cubics not joined'
+
+            # tangents are continuous, except at the corner
+            if x[end] != 50:
+                t1 = c[3] - c[2]
+                t2 = nextc[1] - nextc[0]
+                cross = t1[0]*t2[1] - t1[1]*t2[0]
+                norm = N.sqrt((t1**2).sum() * (t2**2).sum())
+                assert abs(cross) < 1e-6*norm and N.dot(t1, t2) > 0, (
+                    'tangent not continuous at join %i' % i)
+        start = end
+    assert start == len(data)-1
+
+def checkShort():
+    """Short lines should be fitted as bezier_fit_cubic_multi."""
+    x, y, poly = makePoly(2001)
+    multi = qtloops.bezier_fit_cubic_multi(poly, ERROR, len(poly)+1)
+    parallel = qtloops.bezier_fit_cubic_parallel(poly, ERROR, len(poly)+1)
+    assert len(multi) > 0
+    assert multi == parallel, 'short line fitted differently'
+
+def main(outfile):
+    checkLong()
+    checkShort()
+    with open(outfile, 'w') as f:
+        f.write('long line fitted in spans ok\n')
+        f.write('short line fitted as before ok\n')
+
+if __name__ == '__main__':
+    main(sys.argv[1])
@@ -0,0 +1,116 @@
+# Check that contour lines and fills converted to plotter coordinates
+# in C++ match converting each traced line in Python
+
+import sys
+
+import numpy as N
+import veusz.qtall as qt
+from veusz.helpers import qtloops
+from veusz.helpers._nc_cntr import Cntr
+
+SIZE = 200
+CLIP = qt.QRectF(30, 25, 140, 150)
+
+def traceField():
+    """Trace lines and fills of a field, with some non-finite points
+    added to the lines."""
+    yw, xw = 31, 41
+    x = N.tile(N.arange(xw, dtype=N.float64)+1, (yw, 1))
+    y = N.tile(N.arange(yw, dtype=N.float64)[:, N.newaxis], (1, xw))
+    z = N.sin(x*0.3) * N.cos(y*0.25) + 0.02*x
+    c = Cntr(x, y, z)
+
+    lines = []
+    for i, (xy, offsets) in enumerate(c.trace_levels([-0.5, 0, 0.5, 1])):
+        xy = N.array(xy)
+        xy[::7+i] = N.nan
+        lines.append((xy, offsets))
+    fills = c.trace_levels([-0.5, 0, 0.5, 1, 1.5], filled=True)
+    return lines, fills
+
+def transforms(log):
+    """Transforms for x and y axes."""
+    AT = qtloops.AxisTransform
+    return (
+        AT(AT.LOG if log else AT.LINEAR, 1, 1, 41, 10, 190),
+        AT(AT.LINEAR, 2, 0, 60, 190, 10))
+
+def splitPolys(xy, offsets, xtrans, ytrans):
+    """Convert traced lines to polygons one at a time."""
+    polys = []
+    for line in N.split(xy, offsets[1:-1]):
+        line = line[N.all(N.isfinite(line), axis=1)]
+        poly = qt.QPolygonF()
+        qtloops.addNumpyToPolygonF(
+            poly, xtrans.convertArray(line[:,0]),
+            ytrans.convertArray(line[:,1]))
+        polys.append(poly)
+    return polys
+
+def fillImage(path, clip):
+    """Fill path, clipping if clip is set."""
+    img = qt.QImage(SIZE, SIZE, qt.QImage.Format.Format_ARGB32_Premultiplied)
+    img.fill(qt.QColor('white'))
+    painter = qt.QPainter(img)
+    if clip is not None:
+        painter.setClipRect(clip)
+    painter.fillPath(path, qt.QBrush(qt.QColor('black')))
+    painter.end()
+    return img
+
+def checkLines(lines, xtrans, ytrans):
+    """Lines added to labeller should be the same."""
+    size = qt.QSizeF(0, 0)
+    lab1 = qtloops.LineLabeller(qt.QRectF(0, 0, SIZE, SIZE), False)
+    lab2 = qtloops.LineLabeller(qt.QRectF(0, 0, SIZE, SIZE), False)
+    for xy, offsets in lines:
+        nlines = qtloops.addContoursToLabeller(
+            lab1, xy, offsets, xtrans, ytrans, size)
+        polys = splitPolys(xy, offsets, xtrans, ytrans)
+        assert nlines == len(polys), 'wrong number of lines'
+        for poly in polys:
+            lab2.addLine(poly, size)
+
+    assert lab1.getNumPolySets() == lab2.getNumPolySets()
+    for i in range(lab1.getNumPolySets()):
+        assert lab1.getPolySet(i) == lab2.getPolySet(i), (
+            'line %i differs' % i)
+
+def checkFills(fills, xtrans, ytrans):
+    """Fill paths should be the same, and clip the same as the
+    painter."""
+    for xy, offsets in fills:
+        path1 = qt.QPainterPath()
+        qtloops.addContoursToPath(path1, xy, offsets, xtrans, ytrans)
+        path2 = qt.QPainterPath()
+        for poly in splitPolys(xy, offsets, xtrans, ytrans):
+            path2.addPolygon(poly)
+            path2.closeSubpath()
+        assert path1 == path2, 'fill paths differ'
+
+        clipped = qt.QPainterPath()
+        qtloops.addContoursToPath(
+            clipped, xy, offsets, xtrans, ytrans, CLIP)
+        img1 = fillImage(clipped, None)
+        img2 = fillImage(path2, CLIP)
+        ndiff = sum(
+            img1.pixel(x, y) != img2.pixel(x, y)
+            for y in range(SIZE) for x in range(SIZE))
+        # allow for pixels on the edge of the clip rectangle
+        assert ndiff <= 2*(CLIP.width()+CLIP.height()), (
+            '%i pixels differ in clipped fill' % ndiff)
+
+def main(outfile):
+    lines, fills = traceField()
+    out = []
+    for log in (False, True):
+        xtrans, ytrans = transforms(log)
+        checkLines(lines, xtrans, ytrans)
+        checkFills(fills, xtrans, ytrans)
+        out.append('%s contours ok' % ('log' if log else 'linear'))
+
+    with open(outfile, 'w') as f:
+        f.write('\n'.join(out) + '\n')
+
+if __name__ == '__main__':
+    main(sys.argv[1])
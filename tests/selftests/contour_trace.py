@@ -0,0 +1,72 @@
+# Check the flat output of the contour tracer, where the polygons
+# between levels include curves joined by slit cutting on masked grids,
+# and lines are traced in pieces which are joined into open curves
+
+import sys
+
+import numpy as N
+from veusz.helpers._nc_cntr import Cntr
+
+def main(outfile):
+    out = []
+    for seed in range(20):
+        rng = N.random.RandomState(seed)
+        z = rng.randint(0, 5, size=(21, 34)).astype(N.float64)
+        mask = rng.rand(*z.shape) < 0.1
+        yw, xw = z.shape
+        x = N.tile(N.arange(xw, dtype=N.float64), (yw, 1))
+        y = N.tile(N.arange(yw, dtype=N.float64)[:, N.newaxis], (1, xw))
+
+        c = Cntr(x, y, z, mask)
+        traced = c.trace_levels([0.7225, 2.9492], filled=True)
+        traced.append(c.trace(0.7225, 2.9492, flat=True))
+        traced += c.trace_levels([0.5, 1.5, 2.5])
+
+        for xy, offsets in traced:
+            # the points are exactly those of the parts
+            if xy.shape[0] != offsets[-1]:
+                raise RuntimeError(
+                    'seed %i: %i points but offsets end at %i' % (
+                        seed, xy.shape[0], offsets[-1]))
+            if not N.all(N.isfinite(xy)):
+                raise RuntimeError('seed %i: non-finite points' % seed)
+            out.append('%i %i %i\n' % (seed, len(offsets)-1, xy.shape[0]))
+
+    # without a mask, each line is closed or has both ends on the edge
+    # of the grid, so no pieces of open curves are left unjoined
+    for seed in range(20):
+        rng = N.random.RandomState(seed)
+        z = rng.rand(25, 31)
+        yw, xw = z.shape
+        x = N.tile(N.arange(xw, dtype=N.float64), (yw, 1))
+        y = N.tile(N.arange(yw, dtype=N.float64)[:, N.newaxis], (1, xw))
+
+        c = Cntr(x, y, z)
+        for level in 0.3, 0.5, 0.7:
+            xy, offsets = c.trace(level, flat=True)
+            nopen = 0
+            for start, end in zip(offsets[:-1], offsets[1:]):
+                ends = xy[[start, end-1]]
+                if N.all(ends[0] == ends[1]):
+                    continue
+                onedge = ((ends[:,0] == 0) | (ends[:,0] == xw-1) |
+                          (ends[:,1] == 0) | (ends[:,1] == yw-1))
+                if not N.all(onedge):
+                    raise RuntimeError(
+                        'seed %i: open line does not end on edge' % seed)
+                nopen += 1
+
+            # the same lines are given as a list
+            parts = c.trace(level)
+            if len(parts) != len(offsets)-1 or not all(
+                    N.all(p == xy[s:e]) for p, s, e in
+                    zip(parts, offsets[:-1], offsets[1:])):
+                raise RuntimeError('seed %i: list and flat lines differ' % seed)
+            out.append('%i %i %i %i\n' % (
+                seed, len(offsets)-1, nopen, xy.shape[0]))
+
+    with open(outfile, 'w') as f:
+        f.writelines(out)
+
+if __name__ == '__main__':
+    main(sys.argv[1])
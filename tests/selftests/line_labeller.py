@@ -0,0 +1,103 @@
+# Check that LineLabeller places labels at the same positions along
+# lines as walking along each line to the fraction wanted
+
+import math
+import random
+import sys
+
+import numpy as N
+import veusz.qtall as qt
+from veusz.helpers import qtloops
+
+TEXTSIZE = qt.QSizeF(6, 3)
+CLIP = qt.QRectF(-1000, -1000, 2000, 2000)
+
+class Labeller(qtloops.LineLabeller):
+    """Keep the rectangles of the labels."""
+    def __init__(self, rot):
+        qtloops.LineLabeller.__init__(self, CLIP, rot)
+        self.rects = []
+
+    def drawAt(self, idx, rect):
+        self.rects.append((idx, rect.cx, rect.cy, rect.angle))
+
+def walkLine(poly, frac, rot):
+    """Position of label at frac along poly, found by walking along the
+    line, or None if too short."""
+
+    pts = [(poly[i].x(), poly[i].y()) for i in range(len(poly))]
+    seglens = [
+        math.sqrt((x1-x0)*(x1-x0) + (y1-y0)*(y1-y0))
+        for (x0, y0), (x1, y1) in zip(pts[:-1], pts[1:])]
+    # summed in order, as math.fsum or sum may round differently
+    totlength = 0
+    for seglen in seglens:
+        totlength += seglen
+    if totlength/2 < max(TEXTSIZE.width(), TEXTSIZE.height()):
+        return None
+
+    length = 0
+    for i, seglen in enumerate(seglens):
+        if length + seglen >= totlength*frac:
+            fseg = (totlength*frac - length) / seglen
+            (x0, y0), (x1, y1) = pts[i], pts[i+1]
+            angle = math.atan2(y1-y0, x1-x0) if rot else 0.
+            return (x0*(1-fseg) + x1*fseg, y0*(1-fseg) + y1*fseg, angle)
+        length += seglen
+    return None
+
+def makeLine(rng, npts):
+    """Random walk, with some repeated points."""
+    x, y = rng.uniform(-100, 100), rng.uniform(-100, 100)
+    poly = qt.QPolygonF()
+    for i in range(npts):
+        poly.append(qt.QPointF(x, y))
+        if rng.random() > 0.1:
+            x += rng.uniform(-5, 5)
+            y += rng.uniform(-5, 5)
+    return poly
+
+def main(outfile):
+    rng = random.Random(1234)
+    fracs = [0.5, 1/3., 0.01, 0.25, 0.999, 1.]
+    nlabels = 0
+    for npts in (2, 3, 10, 300):
+        for rot in (False, True):
+            line = makeLine(rng, npts)
+            for frac in fracs:
+                lab = Labeller(rot)
+                lab.addLine(line, TEXTSIZE)
+                lab.setLabelPositions(N.array([frac]))
+                lab.process()
+
+                clipped = lab.getPolySet(0)
+                assert len(clipped) == 1, 'line was clipped'
+                expect = walkLine(clipped[0], frac, rot)
+                if expect is None:
+                    assert not lab.rects, 'short line labelled'
+                    continue
+                assert len(lab.rects) == 1, 'label not placed'
+                idx, cx, cy, angle = lab.rects[0]
+                assert idx == 0
+                assert max(abs(cx-expect[0]), abs(cy-expect[1]),
+                           abs(angle-expect[2])) < 1e-9, (
+                    'label at different position')
+                nlabels += 1
+    assert nlabels >= 4*len(fracs), 'too few labels tested'
+    out = ['label positions ok']
+
+    # the default positions start at the middle of the line
+    line = makeLine(rng, 100)
+    lab = Labeller(True)
+    lab.addLine(line, TEXTSIZE)
+    lab.process()
+    expect = walkLine(lab.getPolySet(0)[0], 0.5, True)
+    assert abs(lab.rects[0][1]-expect[0]) < 1e-9
+    assert abs(lab.rects[0][2]-expect[1]) < 1e-9
+    out.append('default position ok')
+
+    with open(outfile, 'w') as f:
+        f.write('\n'.join(out) + '\n')
+
+if __name__ == '__main__':
+    main(sys.argv[1])
@@ -0,0 +1,100 @@
+# Check boolean operations between sets of polygons with degenerate
+# edges, such as retraced or repeated edges and several edges
+# crossing at a point, and that time scales close to linearly
+
+import math
+import sys
+import time
+
+import veusz.qtall as qt
+from veusz.helpers import qtloops
+
+def scaled(polys, scale):
+    """Multiply integer points, giving points which are not exact."""
+    return [[(x*scale, y*scale) for x, y in p] for p in polys]
+
+# pairs of polygon sets
+cases = [
+    # retraced edge through a triangle
+    ([[(0,1), (0,2), (9,2), (0,2), (9,2)]],
+     [[(4,0), (5,3), (1,2)]]),
+    # polygon repeated in its own set cancels out
+    ([[(0,0), (4,0), (4,4), (0,4)], [(0,0), (4,0), (4,4), (0,4)]],
+     [[(2,2), (6,2), (6,6), (2,6)]]),
+    # collinear overlapping edges
+    ([[(0,0), (4,0), (4,2), (0,2)]],
+     [[(2,0), (6,0), (6,2), (2,2)]]),
+    # edges crossing at shared points, retraced edges and a polygon
+    # also in the other set
+    ([[(1,7), (5,3), (2,6)], [(4,1), (3,3), (5,6), (4,0), (6,6)]],
+     [[(4,5), (1,3), (6,1)], [(5,4), (1,3), (5,4), (1,3), (0,3)],
+      [(1,7), (5,3), (2,6)]]),
+    # self-intersecting star and a square through its points
+    ([[(0,0), (6,3), (0,6), (3,-1), (5,7)]],
+     [[(1,1), (5,1), (5,5), (1,5)]]),
+    # integer points with shared vertices, collinear edges and many
+    # edges crossing at the same points
+    ([[(1,8), (9,8), (10,6), (1,3), (0,3)],
+      [(8,0), (2,2), (4,5), (9,0), (5,2), (4,3), (9,10), (7,7), (10,0)],
+      [(4,1), (4,0), (9,10), (2,2), (0,6), (10,6), (3,1), (8,10)]],
+     [[(2,10), (8,5), (4,6), (9,3)], [(8,3), (4,10), (9,9)]]),
+    # crossings which are rounded to either side of a vertical edge
+    (scaled([[(4,5), (5,0), (2,2)]], 0.1),
+     scaled([[(4,2), (3,4), (3,1)], [(5,4), (2,0), (3,1)]], 0.1)),
+    # a crossing rounded close to a vertex of another edge
+    (scaled([[(7,1), (9,3), (9,7)]], 0.1),
+     scaled([[(8,2), (9,9), (1,10)], [(3,3), (10,3), (6,1)]], 0.1)),
+]
+
+ops = (
+    ('intersection', qtloops.polygonIntersection),
+    ('union', qtloops.polygonUnion),
+    ('difference', qtloops.polygonDifference),
+)
+
+def toPolys(pts):
+    return [qt.QPolygonF([qt.QPointF(x, y) for x, y in p]) for p in pts]
+
+def area(polys):
+    """Total area of rings, with holes going the other way."""
+    tot = 0.
+    for poly in polys:
+        n = len(poly)
+        for i in range(n):
+            p1, p2 = poly[i], poly[(i+1) % n]
+            tot += p1.x()*p2.y() - p2.x()*p1.y()
+    return 0.5*tot
+
+def circle(n, x0):
+    """Polygon of n points around a circle centred at x0."""
+    return qt.QPolygonF([
+        qt.QPointF(x0+100*math.cos(2*math.pi*i/n), 100*math.sin(2*math.pi*i/n))
+        for i in range(n)])
+
+def timeIntersection(n):
+    """Best time to intersect two overlapping circles of n points."""
+    a, b = [circle(n, 0)], [circle(n, 50)]
+    best = None
+    for i in range(3):
+        start = time.perf_counter()
+        qtloops.polygonIntersection(a, b)
+        t = time.perf_counter() - start
+        best = t if best is None else min(best, t)
+    return best
+
+def main(outfile):
+    out = []
+    for i, (a, b) in enumerate(cases):
+        for name, fn in ops:
+            out.append('%i %s %.6g\n' % (i, name, area(fn(toPolys(a), toPolys(b)))))
+
+    # eight times the points should take far less than the 64 times
+    # longer a quadratic method would
+    ratio = timeIntersection(32000) / timeIntersection(4000)
+    out.append('scaling %s\n' % ('ok' if ratio < 24 else 'bad (%.3g)' % ratio))
+
+    with open(outfile, 'w') as f:
+        f.writelines(out)
+
+if __name__ == '__main__':
+    main(sys.argv[1])
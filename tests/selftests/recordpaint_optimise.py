@@ -0,0 +1,75 @@
+# Check that optimising a recording merges primitives and drops
+# repeated states, while playing back the same
+
+import sys
+
+import veusz.qtall as qt
+from veusz.helpers.recordpaint import RecordPaintDevice
+
+SIZE = 200
+
+def record(alpha):
+    """Record rows of lines and rectangles, with a pen of opacity
+    alpha, setting the pen and brush again between each."""
+
+    dev = RecordPaintDevice(SIZE, SIZE, 100, 100)
+    painter = qt.QPainter(dev)
+    pen = qt.QPen(qt.QColor(0, 0, 255, alpha), 2)
+    otherpen = qt.QPen(qt.QColor('red'), 1)
+    brush = qt.QBrush(qt.QColor('yellow'))
+    otherbrush = qt.QBrush(qt.QColor('green'))
+    painter.setPen(pen)
+    painter.setBrush(brush)
+    for row in range(5):
+        y = 10 + 40*row
+        for i in range(10):
+            x = 10 + 18*i
+            painter.drawLine(qt.QLineF(x, y, x+12, y+10))
+            painter.setPen(otherpen)
+            painter.setPen(pen)
+        for i in range(10):
+            x = 10 + 18*i
+            painter.drawRect(qt.QRectF(x, y+16, 12, 12))
+            painter.setBrush(otherbrush)
+            painter.setBrush(brush)
+    painter.end()
+    return dev
+
+def play(dev):
+    """Play recording to an image."""
+    img = qt.QImage(SIZE, SIZE, qt.QImage.Format.Format_ARGB32_Premultiplied)
+    img.fill(qt.QColor('white'))
+    painter = qt.QPainter(img)
+    dev.play(painter)
+    painter.end()
+    return img
+
+def counts(dev):
+    """Number of elements of each type."""
+    return dict(zip(RecordPaintDevice.elementTypeNames(),
+                    dev.elementTypeCounts()))
+
+def main(outfile):
+    out = []
+
+    orig, opt = record(255), record(255)
+    opt.optimise()
+    co, cn = counts(orig), counts(opt)
+    assert cn['linesf'] == 5 and co['linesf'] == 50, 'lines not merged'
+    assert cn['rectsf'] == 5 and co['rectsf'] == 50, 'rects not merged'
+    assert sum(cn.values()) < sum(co.values())//4, 'states not dropped'
+    assert play(opt) == play(orig), 'optimised recording plays differently'
+    out.append('opaque primitives merged ok')
+
+    orig, opt = record(128), record(128)
+    opt.optimise()
+    co, cn = counts(orig), counts(opt)
+    assert cn['linesf'] == co['linesf'], 'translucent lines merged'
+    assert play(opt) == play(orig), 'optimised recording plays differently'
+    out.append('translucent primitives kept ok')
+
+    with open(outfile, 'w') as f:
+        f.write('\n'.join(out) + '\n')
+
+if __name__ == '__main__':
+    main(sys.argv[1])
@@ -0,0 +1,98 @@
+# Check that a recording saved by RecordPaintDevice and loaded again
+# plays back the same as the original
+
+import sys
+import os
+import tempfile
+
+import veusz.qtall as qt
+from veusz.helpers.recordpaint import RecordPaintDevice
+
+SIZE = 200
+
+def record():
+    """Record a selection of primitives and state changes."""
+
+    dev = RecordPaintDevice(SIZE, SIZE, 100, 100)
+    painter = qt.QPainter(dev)
+
+    pens = [qt.QPen(qt.QColor(c), w) for c, w in (
+        ('red', 1), ('blue', 3), ('green', 2))]
+    brushes = [qt.QBrush(qt.QColor(c)) for c in (
+        'yellow', 'cyan', 'magenta')]
+    for i in range(12):
+        # repeat states, which are stored once
+        painter.setPen(pens[i % 3])
+        painter.setBrush(brushes[i % 3])
+        x = 15*i
+        painter.drawRect(qt.QRectF(x, 10, 12, 20))
+        painter.drawLine(qt.QLineF(x, 40, x+12, 60))
+        painter.drawEllipse(qt.QRectF(x, 70, 12, 12))
+
+    poly = qt.QPolygonF([
+        qt.QPointF(20, 100), qt.QPointF(80, 110), qt.QPointF(50, 150)])
+    painter.drawPolygon(poly)
+    painter.drawPolyline(poly.translated(100, 0))
+
+    path = qt.QPainterPath()
+    path.moveTo(20, 160)
+    path.cubicTo(60, 120, 100, 200, 140, 160)
+    painter.save()
+    painter.translate(10, 5)
+    painter.rotate(5)
+    painter.setClipRect(qt.QRectF(0, 140, 120, 60))
+    painter.drawPath(path)
+    painter.restore()
+
+    img = qt.QImage(8, 8, qt.QImage.Format.Format_ARGB32_Premultiplied)
+    img.fill(qt.QColor('black'))
+    painter.drawImage(qt.QRectF(170, 170, 16, 16), img)
+    painter.end()
+    return dev
+
+def play(dev):
+    """Play recording to an image."""
+    img = qt.QImage(SIZE, SIZE, qt.QImage.Format.Format_ARGB32_Premultiplied)
+    img.fill(qt.QColor('white'))
+    painter = qt.QPainter(img)
+    dev.play(painter)
+    painter.end()
+    return img
+
+def main(outfile):
+    out = []
+    orig = record()
+    first = play(orig)
+    assert play(orig) == first, 'playing twice differs'
+    out.append('repeat play ok')
+
+    fd, filename = tempfile.mkstemp(suffix='.vzrp')
+    os.close(fd)
+    try:
+        assert orig.save(filename), 'could not save'
+        loaded = RecordPaintDevice.load(filename)
+        assert loaded is not None, 'could not load'
+
+        assert loaded.drawItemCount() == orig.drawItemCount(), (
+            'draw item count differs')
+        assert loaded.elementTypeCounts() == orig.elementTypeCounts(), (
+            'elements differ')
+        assert play(loaded) == first, 'loaded recording plays differently'
+        out.append('save and load ok')
+
+        # a truncated file should not load
+        with open(filename, 'rb') as f:
+            data = f.read()
+        with open(filename, 'wb') as f:
+            f.write(data[:len(data)//2])
+        assert RecordPaintDevice.load(filename) is None, (
+            'truncated recording loaded')
+        out.append('truncated file rejected ok')
+    finally:
+        os.unlink(filename)
+
+    with open(outfile, 'w') as f:
+        f.write('\n'.join(out) + '\n')
+
+if __name__ == '__main__':
+    main(sys.argv[1])
@@ -0,0 +1,104 @@
+# Check that simplifying geometry while recording drops points and
+# off-page shapes, while playing back nearly the same
+
+import sys
+import math
+
+import veusz.qtall as qt
+from veusz.helpers.recordpaint import RecordPaintDevice
+
+SIZE = 200
+
+def record(draw, tol):
+    """Record drawing with simplification tolerance tol."""
+    dev = RecordPaintDevice(SIZE, SIZE, 100, 100)
+    dev.setSimplifyTolerance(tol)
+    painter = qt.QPainter(dev)
+    painter.setRenderHint(qt.QPainter.RenderHint.Antialiasing)
+    painter.setPen(qt.QPen(qt.QColor('black'), 2))
+    draw(painter)
+    painter.end()
+    return dev
+
+def play(dev):
+    """Play recording to an image."""
+    img = qt.QImage(SIZE, SIZE, qt.QImage.Format.Format_ARGB32_Premultiplied)
+    img.fill(qt.QColor('white'))
+    painter = qt.QPainter(img)
+    dev.play(painter)
+    painter.end()
+    return img
+
+def maxdiff(img1, img2):
+    """Largest difference in a colour component between images."""
+    diff = 0
+    for y in range(SIZE):
+        for x in range(SIZE):
+            c1 = qt.QColor(img1.pixel(x, y))
+            c2 = qt.QColor(img2.pixel(x, y))
+            diff = max(diff, abs(c1.red()-c2.red()),
+                       abs(c1.green()-c2.green()),
+                       abs(c1.blue()-c2.blue()))
+    return diff
+
+def drawLines(painter):
+    """Densely sampled polyline, path and polygon."""
+    line = qt.QPolygonF([
+        qt.QPointF(10+0.05*i, 20+0.02*i+0.01*math.sin(i))
+        for i in range(3000)])
+    painter.drawPolyline(line)
+
+    path = qt.QPainterPath()
+    path.moveTo(10, 60)
+    for i in range(1, 2000):
+        path.lineTo(10+0.09*i, 60+20*math.sin(i*0.002))
+    painter.drawPath(path)
+
+    poly = qt.QPolygonF([
+        qt.QPointF(100+50*math.cos(i*0.001), 150+40*math.sin(i*0.001))
+        for i in range(6283)])
+    painter.setBrush(qt.QBrush(qt.QColor('cyan')))
+    painter.drawPolygon(poly)
+
+def drawOffPage(painter):
+    """Shapes lying outside the page."""
+    poly = qt.QPolygonF([
+        qt.QPointF(-100+i, -50+(i % 7)) for i in range(50)])
+    painter.drawPolyline(poly)
+    path = qt.QPainterPath()
+    path.addRect(qt.QRectF(SIZE+20, 10, 30, 30))
+    painter.drawPath(path)
+
+def drawCurves(painter):
+    """Paths with curves, which are not simplified."""
+    path = qt.QPainterPath()
+    path.moveTo(20, 100)
+    for i in range(20):
+        path.cubicTo(20+8*i, 60, 24+8*i, 140, 28+8*i, 100)
+    painter.drawPath(path)
+
+def main(outfile):
+    out = []
+
+    orig, simple = record(drawLines, 0), record(drawLines, 0.25)
+    assert simple.drawItemCount() < orig.drawItemCount()//10, (
+        'lines not simplified')
+    assert maxdiff(play(orig), play(simple)) <= 96, (
+        'simplified lines look different')
+    out.append('lines simplified ok')
+
+    assert record(drawOffPage, 0).drawItemCount() > 0
+    assert record(drawOffPage, 0.25).drawItemCount() == 0, (
+        'shapes off page recorded')
+    out.append('off page shapes dropped ok')
+
+    orig, simple = record(drawCurves, 0), record(drawCurves, 0.25)
+    assert simple.elementTypeCounts() == orig.elementTypeCounts()
+    assert play(simple) == play(orig), 'curves changed'
+    out.append('curves unchanged ok')
+
+    with open(outfile, 'w') as f:
+        f.write('\n'.join(out) + '\n')
+
+if __name__ == '__main__':
+    main(sys.argv[1])
@@ -0,0 +1,71 @@
+# Check the statistics RecordPaintDevice keeps about a recording and
+# its playback
+
+import sys
+
+import veusz.qtall as qt
+from veusz.helpers.recordpaint import RecordPaintDevice
+
+SIZE = 200
+
+def record(imgsize):
+    """Record some primitives, and an image of imgsize pixels square."""
+
+    dev = RecordPaintDevice(SIZE, SIZE, 100, 100)
+    painter = qt.QPainter(dev)
+    for i, col in enumerate(('red', 'green', 'blue')):
+        painter.setPen(qt.QPen(qt.QColor(col), i+1))
+        painter.drawRect(qt.QRectF(10+20*i, 10, 15, 15))
+        painter.drawLine(qt.QLineF(10+20*i, 40, 25+20*i, 50))
+    img = qt.QImage(imgsize, imgsize, qt.QImage.Format.Format_ARGB32)
+    img.fill(qt.QColor('black'))
+    painter.drawImage(qt.QRectF(100, 100, 50, 50), img)
+    painter.end()
+    return dev
+
+def play(dev):
+    """Play recording to an image."""
+    img = qt.QImage(SIZE, SIZE, qt.QImage.Format.Format_ARGB32_Premultiplied)
+    img.fill(qt.QColor('white'))
+    painter = qt.QPainter(img)
+    dev.play(painter)
+    painter.end()
+
+def main(outfile):
+    out = []
+
+    dev = record(4)
+    counts = dict(zip(RecordPaintDevice.elementTypeNames(),
+                      dev.elementTypeCounts()))
+    assert counts['rectsf'] == 3, 'wrong rect count'
+    assert counts['linesf'] == 3, 'wrong line count'
+    assert counts['image'] == 1, 'wrong image count'
+    assert counts['pen'] >= 3, 'pens not counted'
+    out.append('element counts ok')
+
+    # a larger image should be counted in the memory used
+    big = record(100)
+    extra = big.memoryUsage() - dev.memoryUsage()
+    assert 0.9*100*100*4 <= extra < 2*100*100*4, 'image memory not counted'
+    out.append('memory usage ok')
+
+    assert dev.stateChangeCount() >= 3, 'state changes not counted'
+    out.append('state changes ok')
+
+    assert dev.playCount() == 0 and dev.playTime() == 0
+    assert dev.playTargets() == []
+    for i in range(3):
+        play(dev)
+    raster = qt.QPaintEngine.Type.Raster.value
+    assert dev.playCount() == 3, 'plays not counted'
+    assert dev.playTargets() == [raster], 'wrong play target'
+    assert dev.playTime() > 0, 'play time not kept'
+    assert dev.playTime(raster) == dev.playTime(), 'play time by target differs'
+    assert dev.playTime(raster+1) == 0, 'play time for other target'
+    out.append('play timing ok')
+
+    with open(outfile, 'w') as f:
+        f.write('\n'.join(out) + '\n')
+
+if __name__ == '__main__':
+    main(sys.argv[1])
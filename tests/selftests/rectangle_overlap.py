@@ -0,0 +1,61 @@
+# Check that RectangleOverlapTester, which only tests rectangles in
+# nearby grid cells, gives the same results as testing every placed
+# rectangle
+
+import math
+import random
+import sys
+
+from veusz.helpers import qtloops
+
+def makeRect(rng):
+    """Random rectangle, mostly label sized, but sometimes large."""
+    if rng.random() < 0.05:
+        xw, yw = rng.uniform(100, 800), rng.uniform(2, 20)
+    else:
+        xw, yw = rng.uniform(10, 40), rng.uniform(5, 12)
+    angle = rng.choice((0, rng.uniform(-math.pi, math.pi)))
+    return qtloops.RotatedRectangle(
+        rng.uniform(-50, 550), rng.uniform(-50, 550), xw, yw, angle)
+
+def check(rng, num):
+    """Place num rectangles which do not overlap earlier ones, returning
+    the number placed."""
+
+    tester = qtloops.RectangleOverlapTester()
+    placed = []
+    for i in range(num):
+        rect = makeRect(rng)
+        poly = rect.makePolygon()
+        expected = any(qtloops.doPolygonsIntersect(poly, p) for p in placed)
+        assert tester.willOverlap(rect) == expected, (
+            'overlap differs for rectangle %i' % i)
+
+        # also add some overlapping rectangles, as for forced labels
+        if not expected or i % 10 == 0:
+            tester.addRect(rect)
+            placed.append(poly)
+    return len(placed)
+
+def main(outfile):
+    rng = random.Random(4321)
+    out = []
+    for num in (10, 200, 1000):
+        nplaced = check(rng, num)
+        assert nplaced > 1
+        out.append('%i rectangles tested ok' % num)
+
+    # reset should forget placed rectangles and the grid size
+    tester = qtloops.RectangleOverlapTester()
+    tester.addRect(qtloops.RotatedRectangle(0, 0, 1000, 1000, 0))
+    tester.reset()
+    tester.addRect(qtloops.RotatedRectangle(0, 0, 2, 2, 0))
+    assert not tester.willOverlap(qtloops.RotatedRectangle(10, 10, 2, 2, 0))
+    assert tester.willOverlap(qtloops.RotatedRectangle(1, 1, 2, 2, 0.5))
+    out.append('reset ok')
+
+    with open(outfile, 'w') as f:
+        f.write('\n'.join(out) + '\n')
+
+if __name__ == '__main__':
+    main(sys.argv[1])
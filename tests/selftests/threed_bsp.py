@@ -0,0 +1,55 @@
+# Check that sampling planes when building the BSP tree (the default)
+# splits a scene of crossing triangles into fewer fragments than
+# always splitting by the first triangle
+
+import os
+import sys
+import math
+
+from veusz.helpers import threed
+
+sys.path.insert(
+    0, os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+from threedtesthelpers import makeCamera, renderImage
+
+SIZE = 200
+
+def crossingTriangles(num):
+    """A fan of long thin triangles, each crossing all the others."""
+    root = threed.ObjectContainer()
+    for i in range(num):
+        a = math.pi*i/num
+        c, s, z = math.cos(a), math.sin(a), 0.02*i
+        root.addObject(threed.Triangle(
+            threed.Vec3(-c, -s, z-0.5), threed.Vec3(c, s, z-0.5),
+            threed.Vec3(0.1*s, -0.1*c, 0.5-z),
+            threed.SurfaceProp(r=0.3, g=0.6, b=0.2, refl=0.7)))
+    return root
+
+def fragsOut(samples):
+    """Number of fragments after building the BSP tree, using the
+    default number of plane samples if samples is None."""
+
+    scene = threed.Scene(threed.Scene.RenderMode.RENDER_BSP)
+    if samples is not None:
+        scene.setBSPPlaneSamples(samples)
+    renderImage(
+        scene, crossingTriangles(12),
+        makeCamera((0.5, 0.7, -4), up=(0, -1, 0), fov=60), SIZE)
+
+    assert scene.bspstats.fragsin == 12, 'unexpected input fragments'
+    return scene.bspstats.fragsout
+
+def main(outfile):
+    unsampled = fragsOut(0)
+    default = fragsOut(None)
+    assert default < unsampled, (
+        'sampled splitter made %i fragments, first-plane splitter %i' % (
+            default, unsampled))
+    assert fragsOut(8) == default, 'default is not 8 plane samples'
+
+    with open(outfile, 'w') as f:
+        f.write('sampled splitter fewer fragments ok\n')
+
+if __name__ == '__main__':
+    main(sys.argv[1])
@@ -0,0 +1,89 @@
+# Check that a scene drawn with the BSP tree cached between views
+# (used if the root is a plain ObjectContainer) looks the same as one
+# where the tree is built for each view, with lines and markers lying
+# on a surface drawn over it in both
+
+import os
+import sys
+
+import numpy as N
+import veusz.qtall as qt
+from veusz.helpers import threed
+
+sys.path.insert(
+    0, os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+from threedtesthelpers import makeCamera, renderImage
+
+SIZE = 300
+NPTS = 20
+
+def makeObjects():
+    """A surface with its grid lines and markers at its vertices."""
+    pos = N.linspace(-1, 1, NPTS)
+    heights = (
+        0.4*N.sin(3*pos)[:,N.newaxis]*N.cos(2*pos)[N.newaxis,:]).ravel()
+    V = threed.ValVector
+    mesh = threed.Mesh(
+        V(pos), V(pos), V(heights), threed.Mesh.Direction.Z_DIRN,
+        threed.LineProp(r=0, g=0, b=0, width=1),
+        threed.SurfaceProp(r=0.9, g=0.8, b=0.3, refl=0))
+
+    x, y = N.meshgrid(pos[::2], pos[::2], indexing='ij')
+    z = heights.reshape(NPTS, NPTS)[::2,::2]
+    path = qt.QPainterPath()
+    path.addRect(qt.QRectF(-3, -3, 6, 6))
+    points = threed.Points(
+        V(x.ravel()), V(y.ravel()), V(z.ravel()), path, None,
+        threed.SurfaceProp(r=0, g=0, b=1, refl=0))
+    return mesh, points
+
+def render(cached):
+    """Render the objects, returning an image."""
+
+    if cached:
+        root = threed.ObjectContainer()
+    else:
+        # a container which changes what is drawn is not cached
+        root = threed.ClipContainer(
+            threed.Vec3(-10, -10, -10), threed.Vec3(10, 10, 10))
+    for obj in makeObjects():
+        root.addObject(obj)
+
+    # draw from another view first, so the cached tree is reused
+    scene = threed.Scene(threed.Scene.RenderMode.RENDER_BSP)
+    for eye in (-2, 3, 3), (2, -3, 3):
+        img = renderImage(scene, root, makeCamera(eye), SIZE)
+    return img
+
+def classify(img):
+    """Return lists of pixels which are mostly line and marker."""
+    line, marker = [], []
+    for y in range(SIZE):
+        for x in range(SIZE):
+            c = qt.QColor(img.pixel(x, y))
+            if max(c.red(), c.green(), c.blue()) < 100:
+                line.append((x, y))
+            elif c.blue() > 150 and c.red() < 100:
+                marker.append((x, y))
+    return line, marker
+
+def main(outfile):
+    cached, uncached = render(True), render(False)
+
+    ndiff = sum(
+        1 for y in range(SIZE) for x in range(SIZE)
+        if cached.pixel(x, y) != uncached.pixel(x, y))
+    assert ndiff < 0.02*SIZE*SIZE, '%i pixels differ' % ndiff
+
+    for name, c, u in zip(('line', 'marker'), classify(cached),
+                          classify(uncached)):
+        assert u, 'no %s pixels' % name
+        assert abs(len(c)-len(u)) < 0.05*len(u), (
+            '%s pixels differ: %i cached, %i uncached' % (
+                name, len(c), len(u)))
+
+    with open(outfile, 'w') as f:
+        f.write('cached and uncached trees match ok\n')
+
+if __name__ == '__main__':
+    main(sys.argv[1])
@@ -0,0 +1,79 @@
+# Check that a grid of cells with holes, drawn with only its outside
+# faces (merged into rectangles if not lit), looks the same as drawing
+# every cell as a separate cuboid
+
+import os
+import sys
+
+import numpy as N
+import veusz.qtall as qt
+from veusz.helpers import threed
+
+sys.path.insert(
+    0, os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+from threedtesthelpers import addLight, makeCamera, renderImage
+
+SIZE = 200
+NCELLS = 5
+
+def render(grid, refl):
+    """Render cells, with every few missing, returning an image."""
+
+    edges = N.linspace(-1, 1, NCELLS+1)
+    idx = N.indices((NCELLS, NCELLS, NCELLS)).reshape(3, -1)
+    idx = idx[:, (7*idx[0] + 3*idx[1] + 5*idx[2]) % 10 >= 3]
+    surfprop = threed.SurfaceProp(r=0.2, g=0.2, b=0.2, refl=refl)
+
+    V = threed.ValVector
+    if grid:
+        obj = threed.CuboidGrid(
+            V(edges[:-1]), V(edges[1:]), V(edges[:-1]), V(edges[1:]),
+            V(edges[:-1]), V(edges[1:]),
+            V(idx[0].astype(N.float64)), V(idx[1].astype(N.float64)),
+            V(idx[2].astype(N.float64)), None, surfprop)
+    else:
+        obj = threed.MultiCuboid(
+            V(edges[idx[0]]), V(edges[idx[0]+1]),
+            V(edges[idx[1]]), V(edges[idx[1]+1]),
+            V(edges[idx[2]]), V(edges[idx[2]+1]), None, surfprop)
+    root = threed.ObjectContainer()
+    root.addObject(obj)
+
+    scene = threed.Scene(threed.Scene.RenderMode.RENDER_BSP)
+    addLight(scene)
+    return renderImage(scene, root, makeCamera((3, -4, 2.5)), SIZE)
+
+def uniform(img, x, y):
+    """Is the pixel the same colour as its neighbours?"""
+    col = img.pixel(x, y)
+    return all(
+        img.pixel(x+dx, y+dy) == col
+        for dx in (-1, 0, 1) for dy in (-1, 0, 1))
+
+def compare(refl):
+    """Compare colours inside the faces drawn by both methods. Edges
+    are antialiased over the hidden faces of the separate cuboids, so
+    may differ."""
+
+    grid, cuboids = render(True, refl), render(False, refl)
+    white = qt.QColor('white').rgba()
+    ndiff = ninside = 0
+    for y in range(1, SIZE-1):
+        for x in range(1, SIZE-1):
+            if uniform(grid, x, y) and uniform(cuboids, x, y):
+                if grid.pixel(x, y) != cuboids.pixel(x, y):
+                    ndiff += 1
+                elif grid.pixel(x, y) != white:
+                    ninside += 1
+    assert ndiff == 0, '%i pixels differ' % ndiff
+    assert ninside > 0.05*SIZE*SIZE, 'only %i pixels compared' % ninside
+
+def main(outfile):
+    with open(outfile, 'w') as f:
+        for refl in (0, 0.6):
+            compare(refl)
+            f.write('cuboid grid matches cuboids with reflectivity %g ok\n' %
+                    refl)
+
+if __name__ == '__main__':
+    main(sys.argv[1])
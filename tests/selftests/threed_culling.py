@@ -0,0 +1,53 @@
+# Check that objects outside the drawing area are skipped when the
+# scale is fixed, without changing what is drawn
+
+import os
+import sys
+
+from veusz.helpers import threed
+
+sys.path.insert(
+    0, os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+from threedtesthelpers import MODES, makeCamera, renderImage
+
+SIZE = 200
+
+def render(mode, expand):
+    """Render a grid of triangles larger than the drawing area,
+    optionally with a drawing area expand times as large but at the
+    same scale. Returns image and number of fragments."""
+
+    # not a plain ObjectContainer, so the BSP tree is not cached
+    root = threed.ClipContainer(
+        threed.Vec3(-100, -100, -100), threed.Vec3(100, 100, 100))
+    for i in range(-10, 11):
+        for j in range(-10, 11):
+            x, y = 1.5*i, 1.5*j
+            root.addObject(threed.Triangle(
+                threed.Vec3(x-0.5, y-0.5, 0), threed.Vec3(x+0.5, y-0.5, 0),
+                threed.Vec3(x, y+0.5, 0),
+                threed.SurfaceProp(r=0.3, g=0.6, b=0.2, refl=0)))
+
+    camera = makeCamera((0, 0, -5), up=(0, -1, 0), fov=90)
+    scene = threed.Scene(mode)
+    d = 0.5*SIZE*(expand-1)
+    img = renderImage(
+        scene, root, camera, SIZE, bounds=(-d, -d, SIZE+d, SIZE+d),
+        scale=1./expand)
+    return img, scene.bspstats.fragsin
+
+def main(outfile):
+    out = []
+    for name, mode in MODES:
+        culled, nculled = render(mode, 1)
+        full, nfull = render(mode, 3)
+        assert culled == full, 'skipping objects changed drawing'
+        if mode == threed.Scene.RenderMode.RENDER_BSP:
+            assert nculled < nfull, 'no objects were skipped'
+        out.append('culling %s ok' % name)
+
+    with open(outfile, 'w') as f:
+        f.write('\n'.join(out) + '\n')
+
+if __name__ == '__main__':
+    main(sys.argv[1])
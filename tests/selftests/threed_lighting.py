@@ -0,0 +1,102 @@
+# Check lighting of 3D surfaces: smooth shading should vary less
+# between neighbouring triangles than flat shading, the AVX2 kernels
+# should give exactly the same image as the scalar code, and meshes
+# split into bands for several threads should draw as with one
+
+import os
+import sys
+
+import numpy as N
+import veusz.qtall as qt
+from veusz.helpers import threed
+
+sys.path.insert(
+    0, os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+from threedtesthelpers import MODES, addLight, makeCamera, renderImage
+
+SIZE = 200
+NPTS = 9
+
+# enough points for meshes to be split into several bands
+NPTS_BANDS = 150
+
+def render(mode, smooth, npts=NPTS, datamesh=False, threads=0):
+    """Render a lit bump, returning an image."""
+
+    pos = N.linspace(-1, 1, npts)
+    heights = N.exp(
+        -2*(pos[:,N.newaxis]**2 + pos[N.newaxis,:]**2)).ravel()
+    V = threed.ValVector
+    surfprop = threed.SurfaceProp(r=0.6, g=0.6, b=0.6, refl=1)
+    root = threed.ObjectContainer()
+    if datamesh:
+        # edges of cells around the points
+        edges = N.linspace(-1, 1, npts+1)
+        root.addObject(threed.DataMesh(
+            V(edges), V(edges), V(heights), 2, 0, 1, True, None, surfprop))
+    else:
+        root.addObject(threed.Mesh(
+            V(pos), V(pos), V(heights), threed.Mesh.Direction.Z_DIRN,
+            None, surfprop))
+
+    scene = threed.Scene(mode)
+    scene.setNumThreads(threads)
+    scene.setSmoothShading(smooth)
+    addLight(scene)
+    return renderImage(
+        scene, root, makeCamera((2, -3, 3), target=(0, 0, 0.3)), SIZE)
+
+def variation(img):
+    """Sum of colour differences between neighbouring surface pixels."""
+    white = qt.QColor('white').rgb()
+    tot = 0
+    for y in range(SIZE-1):
+        for x in range(SIZE-1):
+            p = img.pixel(x, y)
+            if p == white:
+                continue
+            c = qt.QColor(p)
+            for q in img.pixel(x+1, y), img.pixel(x, y+1):
+                if q != white:
+                    d = qt.QColor(q)
+                    tot += (abs(c.red()-d.red()) +
+                            abs(c.green()-d.green()) +
+                            abs(c.blue()-d.blue()))
+    return tot
+
+def main(outfile):
+    out = []
+    for name, mode in MODES:
+        flat = variation(render(mode, False))
+        smooth = variation(render(mode, True))
+        assert smooth < 0.8*flat, (
+            'smooth shading varies by %i, flat by %i' % (smooth, flat))
+        out.append('smooth shading %s ok' % name)
+
+        # the SIMD kernels are only used if the CPU supports them
+        for smooth in False, True:
+            threed.setSIMDKernels(True)
+            simd = render(mode, smooth)
+            threed.setSIMDKernels(False)
+            scalar = render(mode, smooth)
+            threed.setSIMDKernels(True)
+            assert simd == scalar, 'SIMD and scalar lighting differ'
+        out.append('SIMD lighting %s ok' % name)
+
+        # the bands share the vertices on the rows between them, so
+        # there are no seams in the shading (more threads than cores
+        # are used, so there are several bands on any machine)
+        for datamesh in False, True:
+            for smooth in False, True:
+                one = render(mode, smooth, npts=NPTS_BANDS,
+                             datamesh=datamesh, threads=1)
+                many = render(mode, smooth, npts=NPTS_BANDS,
+                              datamesh=datamesh, threads=8)
+                assert one == many, 'lighting differs with threads'
+        out.append('threaded lighting %s ok' % name)
+
+    with open(outfile, 'w') as f:
+        f.write('\n'.join(out) + '\n')
+
+if __name__ == '__main__':
+    main(sys.argv[1])
@@ -0,0 +1,89 @@
+# Check that overlapping 3D markers look the same as if they were
+# drawn one by one, both when merged into paths and drawn as images
+
+import os
+import sys
+
+import numpy as N
+import veusz.qtall as qt
+from veusz.helpers import threed
+
+sys.path.insert(
+    0, os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+from threedtesthelpers import makeCamera, renderImage
+
+SIZE = 500
+
+def render(xs, zs, lineprop, surfprop, sprites):
+    """Render square markers at the positions, returning an image."""
+
+    path = qt.QPainterPath()
+    path.addRect(qt.QRectF(-40, -40, 80, 80))
+    pts = threed.Points(
+        threed.ValVector(N.array(xs, dtype=N.float64)),
+        threed.ValVector(N.zeros(len(xs))),
+        threed.ValVector(N.array(zs, dtype=N.float64)),
+        path, lineprop, surfprop)
+    pts.scalepersp = False
+    root = threed.ObjectContainer()
+    root.addObject(pts)
+
+    scene = threed.Scene(threed.Scene.RenderMode.RENDER_PAINTERS)
+    scene.setPointSprites(sprites)
+    return renderImage(
+        scene, root, makeCamera((0, 0, -5), up=(0, -1, 0), fov=90), SIZE,
+        scale=1)
+
+def centreRow(img):
+    """Return the colours along the middle row of the markers."""
+    rows = [
+        y for y in range(SIZE)
+        if any(img.pixel(x, y) != qt.QColor('white').rgb()
+               for x in range(0, SIZE, 2))
+    ]
+    assert rows, 'nothing drawn'
+    y = (rows[0] + rows[-1]) // 2
+    return [qt.QColor(img.pixel(x, y)) for x in range(SIZE)]
+
+def checkTranslucent(sprites):
+    """Overlapping translucent fills should composite twice."""
+
+    img = render(
+        [-0.2, 0.2], [0, 0], None,
+        threed.SurfaceProp(r=0, g=0, b=1, refl=0, trans=0.5), sprites)
+    row = centreRow(img)
+    drawn = [i for i, c in enumerate(row) if c.red() < 250]
+    single = row[drawn[0]+5].red()
+    double = row[(drawn[0]+drawn[-1])//2].red()
+    assert 50 < single < 200, 'unexpected fill %i' % single
+    assert abs(double - single*single/255.) <= 3, (
+        'overlap composited wrongly (%i for %i)' % (double, single))
+
+def checkOutlines(sprites):
+    """The fill of a nearer marker should hide the outline behind."""
+
+    img = render(
+        [-0.2, 0.2], [0.5, -0.5],
+        threed.LineProp(r=0, g=0, b=0, width=4),
+        threed.SurfaceProp(r=0, g=1, b=0, refl=0), sprites)
+    row = centreRow(img)
+    drawn = [i for i, c in enumerate(row) if c.red() < 250 or c.blue() < 250]
+    assert len(drawn) == drawn[-1]-drawn[0]+1, 'hole in markers'
+
+    dark = [max(c.red(), c.green(), c.blue()) < 80 for c in row]
+    runs = sum(1 for i in range(1, SIZE) if dark[i] and not dark[i-1])
+    assert runs == 3, '%i outlines crossed instead of 3' % runs
+
+def main(outfile):
+    out = []
+    for sprites in False, True:
+        checkTranslucent(sprites)
+        out.append('translucent sprites=%s ok' % sprites)
+        checkOutlines(sprites)
+        out.append('outlines sprites=%s ok' % sprites)
+
+    with open(outfile, 'w') as f:
+        f.write('\n'.join(out) + '\n')
+
+if __name__ == '__main__':
+    main(sys.argv[1])
@@ -0,0 +1,61 @@
+# Check that a lit mesh, whose triangles share their vertices, draws
+# the same as the same triangles made as separate objects
+
+import os
+import sys
+
+import numpy as N
+from veusz.helpers import threed
+
+sys.path.insert(
+    0, os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+from threedtesthelpers import MODES, addLight, makeCamera, renderImage
+
+SIZE = 200
+NPTS = 12
+
+# corners of the two triangles in each square of the mesh, which
+# alternate between squares (as in Mesh)
+TRIANGLES = (((0,1,2), (3,1,2)), ((1,0,3), (2,0,3)))
+
+def render(mode, mesh):
+    """Render a surface as a Mesh or Triangles, returning an image."""
+
+    pos = N.linspace(-1, 1, NPTS)
+    heights = 0.5*N.sin(3*pos)[:,N.newaxis]*N.cos(2*pos)[N.newaxis,:]
+    surfprop = threed.SurfaceProp(r=0.2, g=0.2, b=0.6, refl=0.6)
+
+    root = threed.ObjectContainer()
+    if mesh:
+        V = threed.ValVector
+        root.addObject(threed.Mesh(
+            V(pos), V(pos), V(heights.ravel()), threed.Mesh.Direction.Z_DIRN,
+            None, surfprop))
+    else:
+        for i1 in range(NPTS-1):
+            for i2 in range(NPTS-1):
+                corners = [
+                    threed.Vec3(pos[j1], pos[j2], heights[j1,j2])
+                    for j1, j2 in ((i1,i2), (i1+1,i2), (i1,i2+1),
+                                   (i1+1,i2+1))
+                ]
+                for idxs in TRIANGLES[(i1+i2)%2]:
+                    root.addObject(threed.Triangle(
+                        *[corners[i] for i in idxs], surfprop))
+
+    scene = threed.Scene(mode)
+    addLight(scene)
+    return renderImage(scene, root, makeCamera((2, -3, 3)), SIZE)
+
+def main(outfile):
+    out = []
+    for name, mode in MODES:
+        assert render(mode, True) == render(mode, False), (
+            'mesh differs from triangles')
+        out.append('indexed mesh %s ok' % name)
+
+    with open(outfile, 'w') as f:
+        f.write('\n'.join(out) + '\n')
+
+if __name__ == '__main__':
+    main(sys.argv[1])
@@ -0,0 +1,104 @@
+# Check that the 3D object tree kept by a scene3d widget between
+# draws only rebuilds the objects of changed graphs, keeps one key
+# per graph as graphs are changed and removed, and draws the same as
+# a document made from scratch
+
+import sys
+
+import veusz.qtall as qt
+import veusz.document as document
+import veusz.widgets as widgets
+
+DPI = (100, 100)
+
+# count of graphs whose objects were made
+built = [0]
+_drawToObject = widgets.Graph3D.drawToObject
+def countingDrawToObject(self, painter, painthelper):
+    built[0] += 1
+    return _drawToObject(self, painter, painthelper)
+widgets.Graph3D.drawToObject = countingDrawToObject
+
+def makeDoc(graphs):
+    """Make a document with a scene containing graphs, given as a list
+    of (name, marker colour)."""
+
+    doc = document.Document()
+    ifc = document.CommandInterface(doc)
+    ifc.SetData('x', [0, 1, 2, 3])
+    ifc.SetData('y', [1, 3, 0, 2])
+    ifc.SetData('z', [2, 0, 3, 1])
+    ifc.Add('page', name='page')
+    ifc.Add('scene3d', name='scene', widget='/page')
+    for name, color in graphs:
+        ifc.Add('graph3d', name=name, widget='/page/scene')
+        ifc.Add(
+            'point3d', name='pts', widget='/page/scene/'+name,
+            xData='x', yData='y', zData='z', MarkerFill__color=color)
+    return doc, ifc
+
+def draw(doc, raster=False):
+    """Draw document, returning image and the number of graphs whose
+    objects were made."""
+
+    built[0] = 0
+    size = doc.pageSize(0, dpi=DPI, integer=False)
+    helper = document.PaintHelper(doc, size, dpi=DPI, raster=raster)
+    doc.paintTo(helper, 0)
+
+    img = qt.QImage(
+        int(size[0]), int(size[1]),
+        qt.QImage.Format.Format_ARGB32_Premultiplied)
+    img.fill(qt.QColor('white'))
+    painter = qt.QPainter(img)
+    helper.renderToPainter(painter)
+    painter.end()
+    return img, built[0]
+
+def checkKeys(doc):
+    """The scene should have one key and one object per graph."""
+    scene = doc.basewidget.getChild('page').getChild('scene')
+    n = len(scene.children)
+    assert len(scene.objkeys) == n, '%i keys for %i graphs' % (
+        len(scene.objkeys), n)
+    assert scene.root.numObjects() == n, '%i objects for %i graphs' % (
+        scene.root.numObjects(), n)
+
+def main(outfile):
+    app = qt.QApplication([])
+    out = []
+
+    doc, ifc = makeDoc([('g1', 'blue'), ('g2', 'green')])
+    img, n = draw(doc)
+    assert n == 2, 'made %i graphs on first draw' % n
+    checkKeys(doc)
+
+    img, n = draw(doc)
+    assert n == 0, 'made %i graphs without changes' % n
+    out.append('unchanged graphs reused ok')
+
+    ifc.Set('/page/scene/g2/pts/MarkerFill/color', 'red')
+    img, n = draw(doc)
+    assert n == 1, 'made %i graphs after changing one' % n
+    checkKeys(doc)
+    out.append('changed graph replaced ok')
+
+    img, n = draw(doc, raster=True)
+    assert n == 2, 'made %i graphs after changing output type' % n
+    img, n = draw(doc)
+    out.append('output type change rebuilds ok')
+
+    ifc.Remove('/page/scene/g1')
+    img, n = draw(doc)
+    checkKeys(doc)
+    out.append('removed graph dropped ok')
+
+    fresh, n = draw(makeDoc([('g2', 'red')])[0])
+    assert img == fresh, 'reused scene differs from new document'
+    out.append('reused scene matches new document ok')
+
+    with open(outfile, 'w') as f:
+        f.write('\n'.join(out) + '\n')
+
+if __name__ == '__main__':
+    main(sys.argv[1])
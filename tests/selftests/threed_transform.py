@@ -0,0 +1,57 @@
+# Check that transforming the points of 3D objects with the AVX2
+# kernel gives exactly the same drawing as the scalar code
+
+import os
+import sys
+
+import numpy as N
+import veusz.qtall as qt
+from veusz.helpers import threed
+
+sys.path.insert(
+    0, os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+from threedtesthelpers import MODES, makeCamera, renderImage
+
+SIZE = 200
+NPTS = 15
+
+def render(mode):
+    """Render a mesh with lines and markers, returning an image."""
+
+    pos = N.linspace(-1, 1, NPTS)
+    heights = 0.5*N.sin(3*pos)[:,N.newaxis]*N.cos(2*pos)[N.newaxis,:]
+    V = threed.ValVector
+    root = threed.ObjectContainer()
+    root.objM = threed.rotate3M4(0.3, 0.2, 0.1)
+    root.addObject(threed.Mesh(
+        V(pos), V(pos), V(heights.ravel()), threed.Mesh.Direction.Z_DIRN,
+        threed.LineProp(r=0, g=0, b=0, width=1),
+        threed.SurfaceProp(r=0.9, g=0.8, b=0.3, refl=0)))
+
+    x, y = N.meshgrid(pos, pos, indexing='ij')
+    path = qt.QPainterPath()
+    path.addEllipse(qt.QRectF(-2, -2, 4, 4))
+    root.addObject(threed.Points(
+        V(x.ravel()), V(y.ravel()), V(heights.ravel()+0.2), path, None,
+        threed.SurfaceProp(r=0, g=0, b=1, refl=0)))
+
+    return renderImage(
+        threed.Scene(mode), root, makeCamera((2, -3, 3)), SIZE)
+
+def main(outfile):
+    out = []
+    for name, mode in MODES:
+        # the SIMD kernel is only used if the CPU supports it
+        threed.setSIMDKernels(True)
+        simd = render(mode)
+        threed.setSIMDKernels(False)
+        scalar = render(mode)
+        threed.setSIMDKernels(True)
+        assert simd == scalar, 'SIMD and scalar transforms differ'
+        out.append('SIMD transform %s ok' % name)
+
+    with open(outfile, 'w') as f:
+        f.write('\n'.join(out) + '\n')
+
+if __name__ == '__main__':
+    main(sys.argv[1])
@@ -0,0 +1,59 @@
+# Check that a solid volume cut by its clipping box (as when the axis
+# ranges of a volume3d widget cut through the data) is not drawn as a
+# hollow, see-through shell
+
+import os
+import sys
+
+import numpy as N
+import veusz.qtall as qt
+from veusz.helpers import threed
+
+sys.path.insert(
+    0, os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+from threedtesthelpers import makeCamera, renderImage
+
+SIZE = 200
+NCELLS = 6
+
+def render(setclip):
+    """Render a solid block of cells, clipped at x=0.1."""
+
+    edges = N.linspace(-1, 1, NCELLS+1)
+    idx = N.indices((NCELLS, NCELLS, NCELLS)).reshape(3, -1).astype(N.float64)
+    V = threed.ValVector
+    grid = threed.CuboidGrid(
+        V(edges[:-1]), V(edges[1:]), V(edges[:-1]), V(edges[1:]),
+        V(edges[:-1]), V(edges[1:]), V(idx[0]), V(idx[1]), V(idx[2]),
+        None, threed.SurfaceProp(r=0.3, g=0.6, b=0.2, refl=0))
+
+    minpt, maxpt = threed.Vec3(-1, -1, -1), threed.Vec3(0.1, 1, 1)
+    if setclip:
+        grid.setClipBox(minpt, maxpt)
+    clipcont = threed.ClipContainer(minpt, maxpt)
+    clipcont.addObject(grid)
+    root = threed.ObjectContainer()
+    root.addObject(clipcont)
+
+    return renderImage(
+        threed.Scene(threed.Scene.RenderMode.RENDER_BSP), root,
+        makeCamera((4, 1.5, -3), up=(0, -1, 0), fov=60), SIZE)
+
+def holes(img):
+    """Count background pixels around the centre, which looks at the
+    cut face of the block."""
+    white = qt.QColor('white').rgb()
+    c = SIZE//2
+    return sum(
+        1 for x in range(c-10, c+11, 2) for y in range(c-10, c+11, 2)
+        if img.pixel(x, y) == white)
+
+def main(outfile):
+    n = holes(render(True))
+    assert n == 0, 'clipped volume has %i background pixels at the cut' % n
+
+    with open(outfile, 'w') as f:
+        f.write('clipped volume solid ok\n')
+
+if __name__ == '__main__':
+    main(sys.argv[1])
@@ -0,0 +1,35 @@
+# Helpers shared by the 3D self tests in selftests, which render
+# objects and check the images
+
+import veusz.qtall as qt
+from veusz.helpers import threed
+
+# names and render modes to run tests in both modes
+MODES = (
+    ('painters', threed.Scene.RenderMode.RENDER_PAINTERS),
+    ('bsp', threed.Scene.RenderMode.RENDER_BSP),
+)
+
+def makeCamera(eye, up=(0, 0, 1), target=(0, 0, 0), fov=50):
+    """Camera at eye looking at target."""
+    camera = threed.Camera()
+    camera.setPointing(
+        threed.Vec3(*eye), threed.Vec3(*target), threed.Vec3(*up))
+    camera.setPerspective(fov, 1, 100)
+    return camera
+
+def addLight(scene):
+    """Add the white light used to test lit surfaces."""
+    scene.addLight(threed.Vec3(-3, -2, 4), qt.QColor('white'), 1)
+
+def renderImage(scene, root, camera, size, bounds=None, scale=-1):
+    """Render root onto a white size x size image, which is returned.
+    bounds are the drawing area, which is the image if None."""
+    if bounds is None:
+        bounds = (0, 0, size, size)
+    img = qt.QImage(size, size, qt.QImage.Format.Format_ARGB32_Premultiplied)
+    img.fill(qt.QColor('white'))
+    painter = qt.QPainter(img)
+    scene.render(root, painter, camera, *bounds, scale)
+    painter.end()
+    return img
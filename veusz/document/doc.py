@@ -101,6 +101,7 @@ class Document(qt.QObject):
 
         # change tracking of document as a whole
         self.changeset = 0            # increased when the document changes
+        self.datachangeset = 0        # increased when datasets or definitions change
         self.compatlevel = 0          # for non-backward compatible changes
 
         # map tags to dataset names
@@ -122,6 +123,7 @@ class Document(qt.QObject):
     def wipe(self):
         """Wipe out any stored data."""
         self.data = {}
+        self.datachangeset += 1
 
         self.basewidget = widgetfactory.thefactory.makeWidget(
             'document', None, self)
@@ -266,16 +268,19 @@ class Document(qt.QObject):
         dataset.document = self
 
         # update the change tracking
+        self.datachangeset += 1
         self.setModified()
 
     def deleteData(self, name):
         """Remove a dataset"""
         del self.data[name]
+        self.datachangeset += 1
         self.setModified()
 
     def modifiedData(self, dataset):
         """Notify dataset was modified"""
         assert dataset in self.data.values()
+        self.datachangeset += 1
         self.setModified()
 
     def getLinkedFiles(self, filenames=None):
@@ -329,6 +334,7 @@ class Document(qt.QObject):
         del self.data[oldname]
         self.data[newname] = d
 
+        self.datachangeset += 1
         self.setModified()
 
     def getData(self, name):
@@ -115,6 +115,9 @@ class Evaluate:
         This sets up a safe environment where things can be evaluated
         """
 
+        # expressions may now evaluate differently
+        self.doc.datachangeset += 1
+
         c = self.context
         c.clear()
 
@@ -445,12 +445,20 @@ class AsyncExport(qt.QObject):
         ext = os.path.splitext(filename)[1].lower()
         dpi = self.getDPI(ext)
 
+        # shapes may be drawn as antialiased images in bitmaps
+        raster = self.antialias and ext in {
+            '.png', '.jpg', '.jpeg', '.bmp', '.tiff', '.xpm'}
+
         # render each page to a PaintHelper
         phelpers = []
         for page in pages:
             size = self.doc.pageSize(page, dpi=dpi, integer=False)
-            phelper = painthelper.PaintHelper(self.doc, size, dpi=dpi)
+            phelper = painthelper.PaintHelper(
+                self.doc, size, dpi=dpi, raster=raster)
             self.doc.paintTo(phelper, page)
+            if ext in {'.pdf', '.eps', '.ps', '.svg', '.emf'}:
+                # fewer drawing calls give smaller vector output
+                phelper.optimiseRecordings()
             phelpers.append(phelper)
 
         # single page only formats
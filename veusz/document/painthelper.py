@@ -19,7 +19,10 @@
 """Helper for doing the plotting of the document.
 """
 
+import sys
+
 from .. import qtall as qt
+from .. import setting
 from .. import utils
 
 try:
@@ -41,6 +44,9 @@ class DrawState:
         self.record = RecordPaintDevice(
             int(helper.pagesize[0]), int(helper.pagesize[1]),
             int(helper.dpi[0]), int(helper.dpi[1]))
+        if helper.simplify > 0 and hasattr(self.record, 'setSimplifyTolerance'):
+            # tolerance is in native pixels, but recording in graph pixels
+            self.record.setSimplifyTolerance(helper.simplify / helper.scaling)
         self.bounds = bounds
         self.clip = clip
 
@@ -113,7 +119,7 @@ class PaintHelper:
 
     def __init__(self, document, pagesize,
                  scaling=1, devicepixelratio=1, dpi=(100, 100),
-                 directpaint=None):
+                 directpaint=None, simplify=0, raster=False):
         """
         pagesize: tuple (pixelw, pixelh), which can be float.
          This is the page size in the coordinates presented to graph drawing.
@@ -122,6 +128,10 @@ class PaintHelper:
         dpi: tuple of X and Y dpi for graph coordinates
         directpaint: use this painter directly, rather than using RecordPainter
           to store each widget painting
+        simplify: if > 0, simplify recorded paths and polygons to this
+          tolerance in native pixels, dropping those off the page
+        raster: if output is to a bitmap at the native size, so that
+          widgets may draw repeated shapes as images
         """
 
         self.document = document
@@ -130,6 +140,8 @@ class PaintHelper:
         # scaling factor, excluding high-DPI factor (for controlgraphs)
         self.cgscale = scaling / devicepixelratio
         self.devicepixelratio = devicepixelratio
+        self.simplify = simplify
+        self.raster = raster
         self.pixperpt = self.dpi[1] / 72.
 
         # page size in native pixels (without default zoom)
@@ -229,11 +241,24 @@ class PaintHelper:
         except KeyError:
             return None
 
+    def optimiseRecordings(self):
+        """Compact the recorded output of each widget, merging adjacent
+        primitives of the same type.
+
+        This reduces the number of separate drawing operations in
+        vector output formats."""
+        for state in self.states.values():
+            if hasattr(state.record, 'optimise'):
+                state.record.optimise()
+
     def renderToPainter(self, painter):
         """Render saved output to painter.
         """
         self._renderState(self.rootstate, painter)
 
+        if setting.transient_settings.get('paint_stats'):
+            self.dumpRecordingStatistics()
+
     def _renderState(self, state, painter, indent=0):
         """Render state to painter."""
 
@@ -245,6 +270,80 @@ class PaintHelper:
             #print '  '*indent, child.widget
             self._renderState(child, painter, indent=indent+1)
 
+    def recordingStatistics(self):
+        """Return statistics for the recorded output of each widget.
+
+        Returns a dict mapping widget path to a dict with keys
+         elements: number of recorded elements
+         bytes: estimate of memory held by the recordings
+         statechanges: number of painter state changes
+         drawitems: estimate of the number of items drawn
+         playtime: total time in seconds spent playing back
+         plays: number of times played back
+         types: dict of element type name to number of elements
+
+        Empty if the native recording device is not available."""
+
+        if not hasattr(RecordPaintDevice, 'elementTypeNames'):
+            return {}
+        names = RecordPaintDevice.elementTypeNames()
+
+        stats = {}
+        for (widget, layer), state in self.states.items():
+            rec = state.record
+            path = widget.path
+            if path not in stats:
+                stats[path] = {
+                    'elements': 0, 'bytes': 0, 'statechanges': 0,
+                    'drawitems': 0, 'playtime': 0., 'plays': 0,
+                    'types': {},
+                }
+            out = stats[path]
+
+            counts = rec.elementTypeCounts()
+            out['elements'] += sum(counts)
+            out['bytes'] += rec.memoryUsage()
+            out['statechanges'] += rec.stateChangeCount()
+            out['drawitems'] += rec.drawItemCount()
+            out['playtime'] += rec.playTime()
+            out['plays'] += rec.playCount()
+            for name, count in zip(names, counts):
+                if count > 0:
+                    out['types'][name] = out['types'].get(name, 0) + count
+
+        return stats
+
+    def dumpRecordingStatistics(self, fileobj=None, num=20):
+        """Write the widgets which are most costly to draw to fileobj
+        (default stderr).
+
+        num: maximum number of widgets to show
+        """
+
+        if fileobj is None:
+            fileobj = sys.stderr
+        stats = self.recordingStatistics()
+        if not stats:
+            return
+
+        paths = sorted(
+            stats, key=lambda p: (stats[p]['playtime'], stats[p]['bytes']),
+            reverse=True)
+
+        fileobj.write(
+            '%-30s %9s %9s %8s %10s  %s\n' % (
+                'widget', 'elements', 'kbytes', 'states', 'play (ms)',
+                'types'))
+        for path in paths[:num]:
+            st = stats[path]
+            types = ' '.join(
+                '%s=%i' % (n, c) for n, c in sorted(
+                    st['types'].items(), key=lambda x: -x[1])[:4])
+            fileobj.write(
+                '%-30s %9i %9.1f %8i %10.2f  %s\n' % (
+                    path, st['elements'], st['bytes']/1024.,
+                    st['statechanges'], st['playtime']*1e3, types))
+
     def identifyWidgetAtPoint(self, x, y, antialias=True):
         """What widget has drawn at the point x,y?
 
@@ -244,6 +244,8 @@ settingdb = _SettingDB()
 transient_settings = {
     # disable safety checks on evaluated code
     'unsafe_mode': False,
+    # print recording statistics when painting
+    'paint_stats': False,
 }
 
 def updateUILocale():
@@ -26,7 +26,7 @@ import math
 import numpy as N
 
 from .. import qtall as qt
-from ..helpers.qtloops import plotLinesToPainter, polygonClip
+from ..helpers.qtloops import plotLinesToPainter, polygonIntersection
 
 def dumppath(p):
     i =0
@@ -243,8 +243,8 @@ def brushExtFillPath(painter, extbrush, path, ignorehide=False,
 
 def brushExtFillPolygon(painter, extbrush, cliprect, polygon, ignorehide=False):
     """Fill a polygon with an extended brush."""
-    clipped = qt.QPolygonF()
-    polygonClip(polygon, cliprect, clipped)
     path = qt.QPainterPath()
-    path.addPolygon(clipped)
+    for clipped in polygonIntersection([polygon], [qt.QPolygonF(cliprect)]):
+        path.addPolygon(clipped)
+        path.closeSubpath()
     brushExtFillPath(painter, extbrush, path, ignorehide=ignorehide)
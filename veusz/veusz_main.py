@@ -180,6 +180,11 @@ class VeuszApp(qt.QApplication):
             action='store_true',
             help='disable safety checks when running documents'
             ' or scripts')
+        parser.add_argument(
+            '--paint-stats',
+            action='store_true',
+            help='print recording statistics for each widget'
+            ' when pages are drawn')
         parser.add_argument(
             '--listen',
             action='store_true',
@@ -305,6 +310,10 @@ class VeuszApp(qt.QApplication):
         setting.transient_settings['unsafe_mode'] = bool(
             args.unsafe_mode)
 
+        # show which widgets are slow to draw
+        setting.transient_settings['paint_stats'] = bool(
+            args.paint_stats)
+
         # optionally load a translation
         txfile = args.translation or setting.settingdb['translation_file']
         if txfile:
@@ -26,6 +26,7 @@ from .. import qtall as qt
 from .. import document
 from .. import setting
 from .. import utils
+from ..helpers import qtloops
 
 from . import widget
 from . import axisticks
@@ -721,9 +722,41 @@ class Axis(widget.Widget):
 
     def dataToPlotterCoords(self, posn, data):
         """Convert data values to plotter coordinates, scaling if necessary."""
+
+        # convert 1D arrays in a single pass without temporaries
+        if (
+                isinstance(data, N.ndarray) and data.ndim == 1 and
+                data.dtype == N.float64
+        ):
+            trans = self.plotterTransform(posn)
+            if trans is not None:
+                return trans.convertArray(data)
+
         self.updateAxisLocation(posn)
         return self._graphToPlotter(data*self.settings.datascale)
 
+    def plotterTransform(self, posn):
+        """Return a qtloops.AxisTransform which converts data values to
+        plotter coordinates, as dataToPlotterCoords, or None if the
+        conversion cannot be described by one."""
+
+        klass = type(self)
+        for name in (
+                '_graphToPlotter', 'linearConvertToPlotter',
+                'logConvertToPlotter'):
+            if getattr(klass, name) is not getattr(Axis, name):
+                return None
+
+        self.updateAxisLocation(posn)
+        if self.plottedLog():
+            ttype = qtloops.AxisTransform.LOG
+        else:
+            ttype = qtloops.AxisTransform.LINEAR
+        return qtloops.AxisTransform(
+            ttype, self.settings.datascale,
+            self.plottedrange[0], self.plottedrange[1],
+            self.coordParr1, self.coordParr2)
+
     def plotterToGraphCoords(self, bounds, vals):
         """Convert plotter coordinates on this axis to graph coordinates.
 
@@ -35,7 +35,8 @@ from .. import utils
 from . import plotters
 
 from ..helpers._nc_cntr import Cntr
-from ..helpers.qtloops import LineLabeller
+from ..helpers.qtloops import LineLabeller, addContoursToLabeller, \
+    addContoursToPath
 
 def _(text, disambiguation=None, context='Contour'):
     """Translate text."""
@@ -50,6 +51,13 @@ def finitePoly(poly):
         out.append( line[validrows] )
     return out
 
+def splitTraced(xy, offsets):
+    """Convert a level traced by Cntr.trace_levels, with points xy and
+    line offsets, to a list of finite coordinate arrays."""
+    if len(offsets) <= 1:
+        return []
+    return finitePoly(N.split(xy, offsets[1:-1]))
+
 class ContourLineLabeller(LineLabeller):
     def __init__(self, clip, rot, painter, font, doc):
         LineLabeller.__init__(self, clip, rot)
@@ -178,6 +186,12 @@ class Contour(plotters.GenericPlotter):
         self._cachedpolygons = None
         self._cachedsubcontours = None
 
+        # the tracer is kept while the data are unchanged, as it caches
+        # the traced levels
+        self._datahash = None
+        self._tracerkey = None
+        self._tracer = None
+
     @classmethod
     def addSettings(klass, s):
         """Construct list of settings."""
@@ -448,6 +462,7 @@ class Contour(plotters.GenericPlotter):
         )
 
         if contsettings != self.contsettings:
+            self._datahash = hashval
             self.updateContours()
             self.contsettings = contsettings
 
@@ -478,14 +493,7 @@ class Contour(plotters.GenericPlotter):
         if data is None or data.dimensions != 2 or data.data.size == 0:
             return
 
-        rangex, rangey = data.getDataRanges()
-        yw, xw = data.data.shape
         xc, yc = data.getPixelCentres()
-        xpts = N.reshape( N.tile(xc, yw), (yw, xw) )
-        ypts = N.tile(yc[:, N.newaxis], xw)
-
-        # only keep finite data points
-        mask = N.logical_not(N.isfinite(data.data))
 
         # iterate over the levels and trace the contours
         self._cachedcontours = None
@@ -493,28 +501,39 @@ class Contour(plotters.GenericPlotter):
         self._cachedsubcontours = None
 
         if Cntr is not None:
-            c = Cntr(xpts, ypts, data.data, mask)
+            tracerkey = (self._datahash, xc.tobytes(), yc.tobytes())
+            if self._datahash is None or tracerkey != self._tracerkey:
+                yw, xw = data.data.shape
+                xpts = N.reshape( N.tile(xc, yw), (yw, xw) )
+                ypts = N.tile(yc[:, N.newaxis], xw)
+
+                # only keep finite data points
+                mask = N.logical_not(N.isfinite(data.data))
+
+                self._tracer = Cntr(xpts, ypts, data.data, mask)
+                self._tracerkey = tracerkey
+
+            # only levels not traced before are traced by this
+            c = self._tracer
+
+            # keep room for the lines, fills and sub-levels of this
+            # and the previous update
+            nlines = len(levels) + len(sublevels)
+            nfills = max(len(levels)-1, 0)
+            c.set_cache_size(2*(nlines+nfills))
 
             # trace the contour levels
             if len(s.Lines.lines) != 0:
-                self._cachedcontours = []
-                for level in levels:
-                    linelist = c.trace(level)
-                    self._cachedcontours.append( finitePoly(linelist) )
+                self._cachedcontours = c.trace_levels(levels)
 
             # trace the polygons between the contours
-            if len(s.Fills.fills) != 0 and len(levels) > 1 and not s.Fills.hide:
-                self._cachedpolygons = []
-                for level1, level2 in zip(levels[:-1], levels[1:]):
-                    linelist = c.trace(level1, level2)
-                    self._cachedpolygons.append( finitePoly(linelist) )
+            if ( len(s.Fills.fills) != 0 and len(levels) > 1 and
+                 not s.Fills.hide ):
+                self._cachedpolygons = c.trace_levels(levels, filled=True)
 
             # trace sub-levels
             if len(sublevels) > 0:
-                self._cachedsubcontours = []
-                for level in sublevels:
-                    linelist = c.trace(level)
-                    self._cachedsubcontours.append( finitePoly(linelist) )
+                self._cachedsubcontours = c.trace_levels(sublevels)
 
     def _plotContours(self, painter, posn, axes, linestyles,
                       contours, showlabels, hidelines, clip):
@@ -536,9 +555,10 @@ class Contour(plotters.GenericPlotter):
         linelabeller = ContourLineLabeller(
             clip, cl.rotate, painter, font, self.document)
         levels = []
+        trans = plotters.plotterTransforms(axes, posn)
 
-        # iterate over each level, and list of lines
-        for num, linelist in enumerate(contours):
+        # iterate over each level, and its traced lines
+        for num, (xy, offsets) in enumerate(contours):
 
             if showlabels and num<len(s.levelsOut):
                 number = s.levelsOut[num]
@@ -553,21 +573,25 @@ class Contour(plotters.GenericPlotter):
             else:
                 textdims = qt.QSizeF(0, 0)
 
-            # iterate over each complete line of the contour
-            for curve in linelist:
-                # convert coordinates from graph to plotter
-                xplt = axes[0].dataToPlotterCoords(posn, curve[:,0])
-                yplt = axes[1].dataToPlotterCoords(posn, curve[:,1])
+            if trans is not None:
+                # convert and add all the lines in one go
+                nlines = addContoursToLabeller(
+                    linelabeller, xy, offsets, trans[0], trans[1], textdims)
+            else:
+                # iterate over each complete line of the contour
+                linelist = splitTraced(xy, offsets)
+                for curve in linelist:
+                    # convert coordinates from graph to plotter
+                    xplt = axes[0].dataToPlotterCoords(posn, curve[:,0])
+                    yplt = axes[1].dataToPlotterCoords(posn, curve[:,1])
 
-                pts = qt.QPolygonF()
-                utils.addNumpyToPolygonF(pts, xplt, yplt)
-                linelabeller.addLine(pts, textdims)
+                    pts = qt.QPolygonF()
+                    utils.addNumpyToPolygonF(pts, xplt, yplt)
+                    linelabeller.addLine(pts, textdims)
+                nlines = len(linelist)
 
-                if showlabels:
-                    linelabeller.labels.append(text)
-                else:
-                    linelabeller.labels.append(None)
-                levels.append(num)
+            linelabeller.labels += [text if showlabels else None]*nlines
+            levels += [num]*nlines
 
         painter.save()
         painter.setPen(labelpen)
@@ -609,22 +633,28 @@ class Contour(plotters.GenericPlotter):
         if self._cachedpolygons is None or s.Fills.hide:
             return
 
-        # iterate over each level, and list of lines
-        for num, polylist in enumerate(self._cachedpolygons):
-
-            # iterate over each complete line of the contour
-            path = qt.QPainterPath()
-            for poly in polylist:
-                # convert coordinates from graph to plotter
-                xplt = axes[0].dataToPlotterCoords(posn, poly[:,0])
-                yplt = axes[1].dataToPlotterCoords(posn, poly[:,1])
+        trans = plotters.plotterTransforms(axes, posn)
 
-                pts = qt.QPolygonF()
-                utils.addNumpyToPolygonF(pts, xplt, yplt)
+        # iterate over each level, and its traced polygons
+        for num, (xy, offsets) in enumerate(self._cachedpolygons):
 
-                clippedpoly = qt.QPolygonF()
-                utils.polygonClip(pts, clip, clippedpoly)
-                path.addPolygon(clippedpoly)
+            path = qt.QPainterPath()
+            if trans is not None:
+                addContoursToPath(
+                    path, xy, offsets, trans[0], trans[1], clip)
+            else:
+                # iterate over each complete line of the contour
+                for poly in splitTraced(xy, offsets):
+                    # convert coordinates from graph to plotter
+                    xplt = axes[0].dataToPlotterCoords(posn, poly[:,0])
+                    yplt = axes[1].dataToPlotterCoords(posn, poly[:,1])
+
+                    pts = qt.QPolygonF()
+                    utils.addNumpyToPolygonF(pts, xplt, yplt)
+
+                    clippedpoly = qt.QPolygonF()
+                    utils.polygonClip(pts, clip, clippedpoly)
+                    path.addPolygon(clippedpoly)
 
             # fill polygons
             brush = s.Fills.get('fills').returnBrushExtended(num)
@@ -233,19 +233,15 @@ class Covariance(plotters.GenericPlotter):
         if axes[1].settings.log:
             self._elpts[1] = N.clip(self._elpts[1], 1e-99, 1e99)
 
-        ptsx = axes[0].dataToPlotterCoords(posn, self._elpts[0])
-        ptsy = axes[1].dataToPlotterCoords(posn, self._elpts[1])
-
         pen = s.Line.makeQPenWHide(painter)
         pw = pen.widthF()*2
         x1, y1, x2, y2 = posn
         lineclip = qt.QRectF(
             qt.QPointF(x1-pw, y1-pw), qt.QPointF(x2+pw, y2+pw))
 
-        for xvals, yvals in zip(ptsx, ptsy):
+        for xvals, yvals in zip(self._elpts[0], self._elpts[1]):
             path = qt.QPainterPath()
-            poly = qt.QPolygonF()
-            utils.addNumpyToPolygonF(poly, xvals, yvals)
+            poly = plotters.dataToPlotterPolygon(axes, posn, xvals, yvals)
             clippedpoly = qt.QPolygonF()
             utils.polygonClip(poly, lineclip, clippedpoly)
             path.addPolygon(clippedpoly)
@@ -25,6 +25,7 @@ from .. import qtall as qt
 import numpy as N
 
 from .. import setting
+from ..helpers import qtloops
 
 from . import widget
 
@@ -32,6 +33,33 @@ def _(text, disambiguation=None, context='Plotters'):
     """Translate text."""
     return qt.QCoreApplication.translate(context, text, disambiguation)
 
+def plotterTransforms(axes, posn):
+    """Get qtloops.AxisTransform objects for the axes, or None if the
+    axes cannot be described by them."""
+    trans = [
+        getattr(axis, 'plotterTransform', lambda posn: None)(posn)
+        for axis in axes]
+    if None in trans:
+        return None
+    return trans
+
+def dataToPlotterPolygon(axes, posn, xvals, yvals):
+    """Convert x and y data values to a QPolygonF in plotter coordinates.
+
+    If the axes can be described by AxisTransforms, the values are
+    converted straight into the polygon in a single pass.
+    """
+    poly = qt.QPolygonF()
+    trans = plotterTransforms(axes, posn)
+    if trans is not None:
+        qtloops.addTransformedToPolygonF(poly, xvals, yvals, trans[0], trans[1])
+    else:
+        qtloops.addNumpyToPolygonF(
+            poly,
+            axes[0].dataToPlotterCoords(posn, xvals),
+            axes[1].dataToPlotterCoords(posn, yvals))
+    return poly
+
 class GenericPlotter(widget.Widget):
     """Generic plotter."""
 
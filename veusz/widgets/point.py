@@ -666,7 +666,7 @@ class PointPlotter(GenericPlotter):
                 if beziertype == "tight-Bezier":
                     npts = qtloops.bezier_fit_cubic_tight(lpoly, 0.5)
                 else:
-                    npts = qtloops.bezier_fit_cubic_multi(
+                    npts = qtloops.bezier_fit_cubic_parallel(
                         lpoly, 0.1, len(lpoly)+1)
                 qtloops.addCubicsToPainterPath(path, npts)
         return path
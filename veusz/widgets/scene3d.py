@@ -50,6 +50,19 @@ class Scene3D(widget.Widget):
     allowusercreation = True
     description = _('3d scene')
 
+    def __init__(self, parent, name=None):
+        """Initialise scene."""
+
+        widget.Widget.__init__(self, parent, name=name)
+
+        # scene and object tree kept between draws, so that unchanged
+        # objects and the caches of the scene are reused
+        self.scene = None
+        self.scenemode = None
+        self.root = None
+        # keys of the state the object of each child was made from
+        self.objkeys = []
+
     @classmethod
     def addSettings(klass, s):
         """Construct list of settings."""
@@ -97,6 +110,12 @@ class Scene3D(widget.Widget):
                     "Accurate (BSP)"),
             usertext=_('Render method'),
             descr=_('Method used to draw 3D plot') ))
+        s.add( setting.Bool(
+            'smoothShading',
+            False,
+            descr=_('Light surfaces using normals averaged around their '
+                    'vertices, rather than the normal of each triangle'),
+            usertext=_('Smooth shading') ))
 
         s.add( setting.Distance(
             'leftMargin',
@@ -154,26 +173,98 @@ class Scene3D(widget.Widget):
             s.get('bottomMargin').convert(painthelper)
         )
 
+    def objectKey(self, child, painthelper):
+        """Key for the state the 3D objects of child depend on.
+
+        This covers the settings of the child and its descendents, the
+        data and definitions of the document, and the paint scaling and
+        type of output, so objects are not reused between outputs.
+        """
+
+        vals = []
+        def addsettings(settings):
+            for setn in settings.getSettingList():
+                vals.append(setn.val)
+            for subsettings in settings.getSettingsList():
+                addsettings(subsettings)
+        def addwidget(w):
+            vals.append(id(w))
+            addsettings(w.settings)
+            for c in w.children:
+                addwidget(c)
+        addwidget(child)
+
+        doc = self.document
+        return (
+            doc.datachangeset, doc.basewidget.settings.colorTheme,
+            painthelper.dpi, painthelper.scaling, painthelper.pagesize,
+            painthelper.devicepixelratio, painthelper.raster,
+            vals)
+
+    def releaseScene(self):
+        """Drop the scene and object tree kept between draws."""
+        self.scene = None
+        self.scenemode = None
+        self.root = None
+        self.objkeys = []
+
+    def releaseCaches(self):
+        """Release scene when removed from the document."""
+        self.releaseScene()
+        widget.Widget.releaseCaches(self)
+
     def makeObjects(self, painter, bounds, painthelper):
-        """Make objects, returning root"""
+        """Make objects, returning root.
+
+        Only the objects of children whose key has changed since the
+        last draw are rebuilt.
+        """
 
         s = self.settings
 
-        # do no painting if hidden
+        # do no painting if hidden, and do not keep the scene
         if s.hide:
+            self.releaseScene()
             return
 
-        root = threed.ObjectContainer()
+        if self.root is None:
+            self.root = threed.ObjectContainer()
+            self.objkeys = []
+        root = self.root
+        keys = self.objkeys
+
         root.objM = threed.rotate3M4(
             s.xRotation/180.*math.pi,
             s.yRotation/180.*math.pi,
             s.zRotation/180.*math.pi)
 
-        # build 3d scene from children
-        for c in self.children:
-           obj = c.drawToObject(painter, painthelper)
-           if obj:
-               root.addObject(obj)
+        # update 3d scene from children
+        for i, c in enumerate(self.children):
+            key = self.objectKey(c, painthelper)
+            if i < len(keys):
+                try:
+                    if keys[i] == key:
+                        continue
+                except ValueError:
+                    # settings which cannot be compared
+                    pass
+
+            obj = c.drawToObject(painter, painthelper)
+            if obj is None:
+                # empty placeholder keeps objects in order of children
+                obj = threed.ObjectContainer()
+
+            if i < len(keys):
+                root.replaceObject(i, obj)
+                keys[i] = key
+            else:
+                root.addObject(obj)
+                keys.append(key)
+
+        # remove objects of deleted children
+        while len(keys) > len(self.children):
+            root.removeObject(len(keys)-1)
+            keys.pop()
 
         return root
 
@@ -196,9 +287,14 @@ class Scene3D(widget.Widget):
             'painters': threed.Scene.RenderMode.RENDER_PAINTERS,
             'bsp': threed.Scene.RenderMode.RENDER_BSP,
         }[s.rendermode]
-        scene = threed.Scene(mode)
+        if self.scene is None or self.scenemode != mode:
+            self.scene = threed.Scene(mode)
+            self.scenemode = mode
+        scene = self.scene
+        scene.setSmoothShading(s.smoothShading)
 
         # add lighting if enabled
+        scene.clearLights()
         for light in s.Lighting1, s.Lighting2, s.Lighting3:
             if light.enable:
                 scene.addLight(
@@ -229,6 +325,9 @@ class Scene3D(widget.Widget):
         #     pt_screen = threed.projVecToScreen(scene.screenM, pt_proj)
         #     return pt_screen,qt.QPointF(pt_screen.get(0), pt_screen.get(1))
 
+        # markers can be drawn as images for bitmap output
+        scene.setPointSprites(painthelper.raster)
+
         # finally render the scene
         scale = self.settings.size
         if scale == 'Auto':
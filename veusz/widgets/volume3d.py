@@ -263,17 +263,17 @@ class Volume3D(plotters3d.GenericPlotter3D):
         yedges = axes[1].dataToLogicalCoords(data.yedges)
         zedges = axes[2].dataToLogicalCoords(data.zedges)
 
-        # get minimum and maximum of cubes
-        xmin = threed.ValVector(xedges[data.xidxs,0])
-        xmax = threed.ValVector(xedges[data.xidxs,1])
-        ymin = threed.ValVector(yedges[data.yidxs,0])
-        ymax = threed.ValVector(yedges[data.yidxs,1])
-        zmin = threed.ValVector(zedges[data.zidxs,0])
-        zmax = threed.ValVector(zedges[data.zidxs,1])
-
+        # the cuboids are cells on a grid, so only the outside faces
+        # need to be drawn, apart from cells cut open by the clipping
+        V = threed.ValVector
         clipcont = self.makeClipContainer(axes)
-        cuboids = threed.MultiCuboid(
-            xmin, xmax, ymin, ymax, zmin, zmax, lineprop, surfprop)
+        cuboids = threed.CuboidGrid(
+            V(xedges[:,0]), V(xedges[:,1]),
+            V(yedges[:,0]), V(yedges[:,1]),
+            V(zedges[:,0]), V(zedges[:,1]),
+            V(data.xidxs), V(data.yidxs), V(data.zidxs),
+            lineprop, surfprop)
+        cuboids.setClipBox(clipcont.minpt, clipcont.maxpt)
         clipcont.addObject(cuboids)
 
         clipcont.assignWidgetId(id(self))
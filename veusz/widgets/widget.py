@@ -242,10 +242,16 @@ class Widget:
             i += 1
 
         if i < nc:
-            self.children.pop(i)
+            self.children.pop(i).releaseCaches()
         else:
             raise ValueError("Cannot remove graph '%s' - does not exist" % name)
 
+    def releaseCaches(self):
+        """Release data kept between draws by widget and its children,
+        when they are removed from the document."""
+        for c in self.children:
+            c.releaseCaches()
+
     def widgetSiblingIndex(self):
         """Get index of widget in its siblings."""
         if self.parent is None:
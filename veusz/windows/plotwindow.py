@@ -1079,7 +1079,9 @@ class PlotWindow( qt.QGraphicsView ):
                     self.document, size,
                     scaling=scaling,
                     dpi=self.dpi,
-                    devicepixelratio=devicepixelratio)
+                    devicepixelratio=devicepixelratio,
+                    simplify=0.25,
+                    raster=self.antialias)
                 self.document.paintTo(phelper, self.pagenumber)
 
             except Exception: